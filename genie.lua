@@ -168,6 +168,7 @@ project "scopesrt"
         "src/utils.cpp",
         "src/symbol.cpp",
         "src/timer.cpp",
+        "src/profiler.cpp",
         "src/source_file.cpp",
         "src/anchor.cpp",
         "src/type.cpp",
@@ -284,7 +285,7 @@ project "scopesrt"
         }
 
         links {
-            "pthread", "m", "tinfo", "dl", "z",
+            "pthread", "m", "tinfo", "dl", "z", "rt",
         }
 
         linkoptions {
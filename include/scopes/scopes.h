@@ -112,6 +112,7 @@ typedef struct sc_symbol_valueref_tuple_ { sc_symbol_t _0; sc_valueref_t _1; } s
 typedef struct sc_symbol_type_tuple_ { sc_symbol_t _0; const sc_type_t *_1; } sc_symbol_type_tuple_t;
 
 typedef struct sc_i32_i32_i32_tuple_ { int32_t _0, _1, _2; } sc_i32_i32_i32_tuple_t;
+typedef struct sc_u64_u64_i64_tuple_ { uint64_t _0, _1; int64_t _2; } sc_u64_u64_i64_tuple_t;
 
 typedef struct sc_rawstring_size_t_tuple_ { const char *_0; size_t _1; } sc_rawstring_size_t_tuple_t;
 
@@ -170,9 +171,25 @@ SCOPES_LIBEXPORT sc_valueref_raises_t sc_typify_template(sc_valueref_t f, int nu
 SCOPES_LIBEXPORT sc_valueref_raises_t sc_compile(sc_valueref_t srcl, uint64_t flags);
 SCOPES_LIBEXPORT sc_string_raises_t sc_compile_spirv(int version, sc_symbol_t target, sc_valueref_t srcl, uint64_t flags);
 SCOPES_LIBEXPORT sc_string_raises_t sc_compile_glsl(int version, sc_symbol_t target, sc_valueref_t srcl, uint64_t flags);
+SCOPES_LIBEXPORT sc_void_raises_t sc_compile_spirv_batch(int version, int count, const sc_symbol_t *targets, const sc_valueref_t *funcs, uint64_t flags, const sc_string_t **results);
+SCOPES_LIBEXPORT sc_void_raises_t sc_compile_glsl_batch(int version, int count, const sc_symbol_t *targets, const sc_valueref_t *funcs, uint64_t flags, const sc_string_t **results);
 SCOPES_LIBEXPORT const sc_string_t *sc_spirv_to_glsl(const sc_string_t *binary);
 SCOPES_LIBEXPORT const sc_string_t *sc_default_target_triple();
 SCOPES_LIBEXPORT sc_void_raises_t sc_compile_object(const sc_string_t *target_triple, int file_kind, const sc_string_t *path, const sc_scope_t *table, uint64_t flags);
+SCOPES_LIBEXPORT sc_void_raises_t sc_set_profile(const sc_string_t *path);
+SCOPES_LIBEXPORT sc_void_raises_t sc_write_profile(const sc_string_t *path);
+SCOPES_LIBEXPORT sc_void_raises_t sc_profiler_start(int frequency);
+SCOPES_LIBEXPORT void sc_profiler_stop();
+SCOPES_LIBEXPORT sc_void_raises_t sc_profiler_write(const sc_string_t *path);
+// called by functions compiled with the profile-alloc flag
+SCOPES_LIBEXPORT void *sc_alloc_profile_malloc(uint64_t size, const void *site);
+SCOPES_LIBEXPORT void sc_alloc_profile_free(void *ptr);
+SCOPES_LIBEXPORT void sc_alloc_profile_print(int max_sites);
+SCOPES_LIBEXPORT void sc_alloc_profile_reset();
+// returns the allocation count, bytes and live bytes of all sites
+SCOPES_LIBEXPORT sc_u64_u64_i64_tuple_t sc_alloc_profile_totals();
+SCOPES_LIBEXPORT void sc_alloc_profile_set_dump_interval(int milliseconds);
+SCOPES_LIBEXPORT sc_void_raises_t sc_link_objects(int count, const sc_string_t **inputs, const sc_string_t **outputs, const sc_scope_t *exports, uint64_t flags);
 SCOPES_LIBEXPORT void sc_enter_solver_cli ();
 SCOPES_LIBEXPORT sc_valueref_raises_t sc_eval_inline(const sc_anchor_t *anchor, const sc_list_t *expr, const sc_scope_t *scope);
 SCOPES_LIBEXPORT sc_rawstring_i32_array_tuple_t sc_launch_args();
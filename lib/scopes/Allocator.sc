@@ -0,0 +1,125 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""Allocator
+    =========
+
+    Provides allocators that can be passed to growing containers so that
+    their memory is taken from somewhere else than the C heap.
+
+    An allocator is a plain value implementing two methods, `alloc-array`,
+    which returns uninitialized memory for `count` elements of type `T`, and
+    `free-array`, which releases memory previously returned by `alloc-array`.
+    `GrowingArray` and `GrowingString` accept an allocator type as optional
+    second type argument, and an allocator value as `allocator` option of
+    their constructors:
+
+        :::scopes
+        using import Allocator
+        using import Array
+
+        local arena : Arena
+        local values = ((GrowingArray i32 ArenaAllocator) (allocator = (ArenaAllocator arena)))
+        'append values 1
+        # values must not be used after this point
+        'reset arena
+
+using import struct
+
+# size of the list link at the start of every arena chunk
+let ChunkHeaderSize = (sizeof voidstar)
+
+inline align-offset (offset alignment)
+    (offset + alignment - 1:usize) & (~ (alignment - 1:usize))
+
+""""A bump allocator which carves allocations out of large chunks taken from
+    the C heap. Individual allocations can not be released; instead, all
+    memory is released at once when the arena is reset or dropped.
+struct Arena
+    let DefaultChunkSize = (1:usize << 16:usize)
+
+    _chunk : (mutable pointer u8)
+    _offset : usize
+    _size : usize
+    _chunk-size : usize
+
+    inline __typecall (cls chunk-size)
+        """"Constructs a new, empty arena which allocates memory in chunks of
+            `chunk-size` bytes, or 64 KiB if `chunk-size` is omitted. Larger
+            allocations receive a chunk of their own.
+        Struct.__typecall cls
+            _chunk = (nullof (mutable pointer u8))
+            _offset = 0:usize
+            _size = 0:usize
+            _chunk-size =
+                static-if (none? chunk-size) cls.DefaultChunkSize
+                else (chunk-size as usize)
+
+    fn alloc-bytes (self size alignment)
+        """"Returns a pointer to `size` bytes of uninitialized memory aligned to
+            `alignment` bytes, which must be a power of two.
+        let size = (size as usize)
+        let alignment = (alignment as usize)
+        inline aligned-offset ()
+            let base = (ptrtoint (deref self._chunk) usize)
+            (align-offset (base + self._offset) alignment) - base
+        if ((self._chunk == null) or (((aligned-offset) + size) > self._size))
+            let chunk-size =
+                max (deref self._chunk-size) (ChunkHeaderSize + size + alignment)
+            let chunk = (malloc-array u8 chunk-size)
+            # chunks are linked through their first bytes
+            store (deref self._chunk)
+                bitcast (view chunk) (mutable pointer (mutable pointer u8))
+            assign chunk self._chunk
+            self._offset = ChunkHeaderSize
+            self._size = chunk-size
+        let offset = (aligned-offset)
+        self._offset = offset + size
+        getelementptr (deref self._chunk) offset
+
+    inline alloc-array (self T count)
+        """"Returns a pointer to uninitialized memory for `count` elements of
+            type `T`.
+        bitcast
+            alloc-bytes self ((sizeof T) * (count as usize)) (alignof T)
+            mutable pointer T
+
+    inline free-array (self ptr)
+        # memory is released in bulk by `reset`
+        ;
+
+    fn reset (self)
+        """"Releases all memory allocated from the arena. Pointers returned by
+            the arena are invalid afterwards.
+        loop (chunk = (deref self._chunk))
+            if (chunk == null)
+                break;
+            let previous =
+                load (bitcast chunk (mutable pointer (mutable pointer u8)))
+            free chunk
+            previous
+        assign (nullof (mutable pointer u8)) self._chunk
+        self._offset = 0:usize
+        self._size = 0:usize
+        return;
+
+    inline __drop (self)
+        reset self
+
+""""A plain handle to an `Arena`, to be stored in containers. The arena must
+    outlive every container using it.
+typedef ArenaAllocator : (mutable pointer Arena)
+    inline __typecall (cls arena)
+        bitcast (& arena) cls
+
+    inline alloc-array (self T count)
+        'alloc-array (@ (storagecast self)) T count
+
+    inline free-array (self ptr)
+        'free-array (@ (storagecast self)) ptr
+
+do
+    let Arena ArenaAllocator
+    locals;
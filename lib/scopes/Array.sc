@@ -10,6 +10,7 @@
     than in registers or the stack.
 
 using import struct
+from (import processor) let hardware-concurrency
 
 # declare void @llvm.memcpy.p0i8.p0i8.i64(i8* <dest>, i8* <src>,
                                         i64 <len>, i1 <isvolatile>)
@@ -25,6 +26,49 @@ fn iLeftChild (i)
 fn iRightChild (i)
     2:i64 * i + 2:i64
 
+# tuning constants of the sort implementations
+let InsertionSortThreshold = 24:i64
+let NintherThreshold = 128:i64
+let PartialInsertionSortLimit = 8:i64
+let StableSortRunSize = 32:i64
+# minimum number of elements per thread of a parallel sort
+let ParallelSortChunkSize = 32768:i64
+
+# threads for parallel sorting; declared directly so that importing this
+  module does not require parsing C headers.
+let pthread_create =
+    extern 'pthread_create
+        function i32 (mutable pointer voidstar) voidstar
+            \ (pointer (function voidstar voidstar)) voidstar
+let pthread_join =
+    extern 'pthread_join
+        function i32 voidstar (mutable pointer voidstar)
+
+inline move-items (dst src count)
+    """"Moves `count` elements from `src` to the uninitialized memory at `dst`.
+    llvm.memcpy.p0i8.p0i8.i64
+        bitcast dst (mutable rawstring)
+        bitcast src rawstring
+        (count * (sizeof (elementof (typeof dst)))) as i64
+        false
+
+inline alloc-items (self count)
+    """"Allocates uninitialized storage for `count` elements of array `self`,
+        from its allocator if it has one.
+    let cls = (typeof self)
+    static-if (none? cls.AllocatorType)
+        malloc-array cls.ElementType count
+    else
+        'alloc-array self._allocator cls.ElementType count
+
+inline free-items (self items)
+    """"Releases storage returned by `alloc-items` for array `self`.
+    let cls = (typeof self)
+    static-if (none? cls.AllocatorType)
+        free items
+    else
+        'free-array self._allocator items
+
 inline... array-generator (self, offset : usize = 0:usize)
     Generator
         inline () offset
@@ -44,10 +88,13 @@ inline array-collector (self)
 typedef Array < Struct
 typedef FixedArray < Array
 typedef GrowingArray < Array
+typedef SmallArray < Array
 
 """"The abstract supertype of both `FixedArray` and `GrowingArray` which
     supplies methods shared by both implementations.
 typedef+ Array
+    # arrays without an allocator use the C heap
+    let AllocatorType = none
 
     """"Implements support for the `as` operator. Arrays can be cast to
         `Generator`, or directly passed to `for`.
@@ -95,6 +142,15 @@ typedef+ Array
     inline __countof (self)
         deref self._count
 
+    """"Implements support for chunked iteration with `itertools.chunked`.
+        Returns the element type, the number of elements and an inline that
+        loads the element at an index.
+    inline __chunks (self)
+        let cls = (typeof self)
+        let items = (deref self._items)
+        _ cls.ElementType (deref self._count)
+            inline (i) (deref (items @ i))
+
     """"Implements support for the `@` operator. Returns a view reference to the
         element at `index` of array `self`.
     fn __@ (self index)
@@ -117,34 +173,37 @@ typedef+ Array
                 inline (a b) (< a b)
             else predicate
 
+        inline less? (a b ...)
+            pred (key a ...) (key b ...) ...
+
+        inline swap-at (items a b)
+            swap (items @ a) (items @ b)
+
+        inline sort2 (items a b ...)
+            if (less? (items @ b) (items @ a) ...)
+                swap-at items a b
+
+        inline sort3 (items a b c ...)
+            sort2 items a b ...
+            sort2 items b c ...
+            sort2 items a b ...
+
         fn siftDown (items start end ...)
             loop (root = start)
-                if ((iLeftChild root) > end)
-                    break;
                 let child = (iLeftChild root)
-                let v_root = (items @ root)
-                let k_root = (key v_root ...)
-                let v_child = (items @ child)
-                let k_child = (key v_child ...)
-                inline step2 (iswap v_swap k_swap)
-                    if (iswap == root)
-                        break;
-                    swap v_root v_swap
-                    repeat iswap
-                inline step1 (iswap v_swap k_swap)
-                    let child1 = (child + 1:i64)
-                    if (child1 <= end)
-                        let v_child1 = (items @ child1)
-                        let k_child1 = (key v_child1 ...)
-                        if (pred k_swap k_child1 ...)
-                            step2 child1 v_child1 k_child1
-                    step2 iswap v_swap k_swap
-                if (pred k_root k_child ...)
-                    step1 child v_child k_child
-                else
-                    step1 root v_root k_root
+                if (child > end)
+                    break;
+                let child =
+                    if ((child < end)
+                        and (less? (items @ child) (items @ (iRightChild root)) ...))
+                        iRightChild root
+                    else child
+                if (less? (items @ root) (items @ child) ...)
+                    swap-at items root child
+                    repeat child
+                break;
 
-        fn "sort-array" (items count ...)
+        fn heap-sort (items count ...)
             let count-1 = (count - 1:i64)
 
             # heapify
@@ -157,19 +216,323 @@ typedef+ Array
             loop (end = count-1)
                 if (end <= 0:i64)
                     break;
-                let v_0 = (items @ 0)
-                let v_end = (items @ end)
-                swap v_0 v_end
+                swap-at items 0:i64 end
                 let end = (end - 1:i64)
                 siftDown items 0:i64 end ...
                 repeat end
 
+        fn insertion-sort (items begin end ...)
+            for i in (range (begin + 1:i64) end)
+                loop (j = i)
+                    if ((j > begin) and (less? (items @ j) (items @ (j - 1:i64)) ...))
+                        swap-at items j (j - 1:i64)
+                        repeat (j - 1:i64)
+                    break;
+
+        fn partial-insertion-sort (items begin end ...)
+            """"Attempts to insertion sort the range, giving up and returning
+                false as soon as more than `PartialInsertionSortLimit` elements
+                had to be moved.
+            loop (i limit = (begin + 1:i64) 0:i64)
+                if (i >= end)
+                    break true
+                let limit =
+                    loop (j limit = i limit)
+                        if ((j > begin) and (less? (items @ j) (items @ (j - 1:i64)) ...))
+                            swap-at items j (j - 1:i64)
+                            repeat (j - 1:i64) (limit + 1:i64)
+                        break limit
+                if (limit > PartialInsertionSortLimit)
+                    break false
+                repeat (i + 1:i64) limit
+
+        fn partition-right (items begin end ...)
+            """"Partitions the range around the pivot at `begin` so that all
+                elements smaller than the pivot precede it. Returns the new
+                position of the pivot and whether the range was already
+                partitioned.
+            let pivot = (items @ begin)
+            let first =
+                loop (i = (begin + 1:i64))
+                    if ((i < end) and (less? (items @ i) pivot ...))
+                        repeat (i + 1:i64)
+                    break i
+            let last =
+                loop (j = (end - 1:i64))
+                    if ((j >= first) and (not (less? (items @ j) pivot ...)))
+                        repeat (j - 1:i64)
+                    break j
+            let already-partitioned? = (first >= last)
+            let first =
+                loop (first last = first last)
+                    if (first >= last)
+                        break first
+                    swap-at items first last
+                    # the swapped elements bound both scans
+                    let first =
+                        loop (i = (first + 1:i64))
+                            if (less? (items @ i) pivot ...)
+                                repeat (i + 1:i64)
+                            break i
+                    let last =
+                        loop (j = (last - 1:i64))
+                            if (not (less? (items @ j) pivot ...))
+                                repeat (j - 1:i64)
+                            break j
+                    repeat first last
+            let pivot-pos = (first - 1:i64)
+            swap-at items begin pivot-pos
+            _ pivot-pos already-partitioned?
+
+        fn partition-left (items begin end ...)
+            """"Partitions the range around the pivot at `begin` so that all
+                elements equal to the pivot precede it, and returns the new
+                position of the pivot. Used when the range can not contain
+                elements smaller than the pivot.
+            let pivot = (items @ begin)
+            let last =
+                loop (j = (end - 1:i64))
+                    if (less? pivot (items @ j) ...)
+                        repeat (j - 1:i64)
+                    break j
+            let first =
+                loop (i = (begin + 1:i64))
+                    if ((i < last) and (not (less? pivot (items @ i) ...)))
+                        repeat (i + 1:i64)
+                    break i
+            let last =
+                loop (first last = first last)
+                    if (first >= last)
+                        break last
+                    swap-at items first last
+                    let last =
+                        loop (j = (last - 1:i64))
+                            if (less? pivot (items @ j) ...)
+                                repeat (j - 1:i64)
+                            break j
+                    let first =
+                        loop (i = (first + 1:i64))
+                            if (not (less? pivot (items @ i) ...))
+                                repeat (i + 1:i64)
+                            break i
+                    repeat first last
+            swap-at items begin last
+            last
+
+        fn pdqsort-loop (items begin end bad-allowed leftmost? ...)
+            # tag return type
+            if false
+                return;
+            loop (begin bad-allowed leftmost? = begin bad-allowed leftmost?)
+                let size = (end - begin)
+                if (size < InsertionSortThreshold)
+                    insertion-sort items begin end ...
+                    return;
+
+                # choose pivot as median of 3 or pseudomedian of 9 and move it
+                  to the front of the range
+                let s2 = (size // 2:i64)
+                if (size > NintherThreshold)
+                    sort3 items begin (begin + s2) (end - 1:i64) ...
+                    sort3 items (begin + 1:i64) (begin + s2 - 1:i64) (end - 2:i64) ...
+                    sort3 items (begin + 2:i64) (begin + s2 + 1:i64) (end - 3:i64) ...
+                    sort3 items (begin + s2 - 1:i64) (begin + s2) (begin + s2 + 1:i64) ...
+                    swap-at items begin (begin + s2)
+                else
+                    sort3 items (begin + s2) begin (end - 1:i64) ...
+
+                # if the element preceding the range is not smaller than the
+                  pivot, the range holds many elements equal to the pivot;
+                  put them in place and continue with the elements to the
+                  right of them.
+                if ((not leftmost?)
+                    and (not (less? (items @ (begin - 1:i64)) (items @ begin) ...)))
+                    repeat ((partition-left items begin end ...) + 1:i64)
+                        \ bad-allowed leftmost?
+
+                let pivot-pos already-partitioned? =
+                    partition-right items begin end ...
+                let l-size = (pivot-pos - begin)
+                let r-size = (end - pivot-pos - 1:i64)
+                let bad-allowed =
+                    if ((l-size < (size // 8:i64)) or (r-size < (size // 8:i64)))
+                        # too many bad pivot choices; fall back to heapsort
+                          to guarantee O(n log n)
+                        let bad-allowed = (bad-allowed - 1)
+                        if (bad-allowed == 0)
+                            heap-sort (& (items @ begin)) size ...
+                            return;
+                        # break up patterns that caused the bad partition
+                        if (l-size >= InsertionSortThreshold)
+                            let q = (l-size // 4:i64)
+                            swap-at items begin (begin + q)
+                            swap-at items (pivot-pos - 1:i64) (pivot-pos - q)
+                            if (l-size > NintherThreshold)
+                                swap-at items (begin + 1:i64) (begin + q + 1:i64)
+                                swap-at items (begin + 2:i64) (begin + q + 2:i64)
+                                swap-at items (pivot-pos - 2:i64) (pivot-pos - q - 1:i64)
+                                swap-at items (pivot-pos - 3:i64) (pivot-pos - q - 2:i64)
+                        if (r-size >= InsertionSortThreshold)
+                            let q = (r-size // 4:i64)
+                            swap-at items (pivot-pos + 1:i64) (pivot-pos + q + 1:i64)
+                            swap-at items (end - 1:i64) (end - q)
+                            if (r-size > NintherThreshold)
+                                swap-at items (pivot-pos + 2:i64) (pivot-pos + q + 2:i64)
+                                swap-at items (pivot-pos + 3:i64) (pivot-pos + q + 3:i64)
+                                swap-at items (end - 2:i64) (end - q - 1:i64)
+                                swap-at items (end - 3:i64) (end - q - 2:i64)
+                        bad-allowed
+                    else
+                        # a well balanced partition of already partitioned
+                          input is likely to be sorted already
+                        if (already-partitioned?
+                            and (partial-insertion-sort items begin pivot-pos ...)
+                            and (partial-insertion-sort items (pivot-pos + 1:i64) end ...))
+                            return;
+                        bad-allowed
+
+                # recurse into the left partition, loop on the right one
+                this-function items begin pivot-pos bad-allowed leftmost? ...
+                repeat (pivot-pos + 1:i64) bad-allowed false
+
+        fn merge-runs (src dst lo mid hi ...)
+            """"Moves the sorted runs `src[lo..mid]` and `src[mid..hi]` into
+                `dst[lo..hi]` in sorted order, preferring elements from the
+                left run on ties.
+            loop (i j k = lo mid lo)
+                if (k == hi)
+                    break;
+                if ((j == hi)
+                    or ((i < mid) and (not (less? (src @ j) (src @ i) ...))))
+                    assign (dupe (src @ i)) (dst @ k)
+                    repeat (i + 1:i64) j (k + 1:i64)
+                else
+                    assign (dupe (src @ j)) (dst @ k)
+                    repeat i (j + 1:i64) (k + 1:i64)
+
+        fn sort-array (items count ...)
+            if (count > 1:i64)
+                # allow one bad partition per level of a balanced sort
+                let bad-allowed = ((findmsb (count as u64)) as i32)
+                pdqsort-loop items 0:i64 count bad-allowed true ...
+            ;
+
+        fn stable-sort-array (items count ...)
+            if (count <= 1:i64)
+                return;
+            # sort runs by insertion, then merge them bottom up, moving the
+              elements back and forth between the array and a buffer.
+            for lo in (range 0:i64 count StableSortRunSize)
+                insertion-sort items lo (min (lo + StableSortRunSize) count) ...
+            let buffer = (malloc-array (elementof (typeof items)) count)
+            let result =
+                loop (width src dst = StableSortRunSize items buffer)
+                    if (width >= count)
+                        break src
+                    for lo in (range 0:i64 count (width * 2:i64))
+                        let mid = (min (lo + width) count)
+                        merge-runs src dst lo mid (min (mid + width) count) ...
+                    repeat (width * 2:i64) dst src
+            if (result == buffer)
+                move-items items buffer count
+            free buffer
+
+        do
+            let sort-array stable-sort-array merge-runs
+            locals;
+
+    @@ memo
+    inline gen-parallel-sort (element-type key predicate)
+        let sorter = (gen-sort key predicate)
+
+        struct SortTask plain
+            src : (mutable pointer element-type)
+            dst : (mutable pointer element-type)
+            lo : i64
+            mid : i64
+            hi : i64
+
+        let sort-task =
+            static-typify
+                fn (arg)
+                    let task = (@ (bitcast arg (mutable pointer SortTask)))
+                    sorter.sort-array (& (task.src @ task.lo)) (task.hi - task.lo)
+                    null as voidstar
+                voidstar
+        let merge-task =
+            static-typify
+                fn (arg)
+                    let task = (@ (bitcast arg (mutable pointer SortTask)))
+                    sorter.merge-runs task.src task.dst task.lo task.mid task.hi
+                    null as voidstar
+                voidstar
+
+        fn run-tasks (f tasks count)
+            let threads = (malloc-array voidstar count)
+            for i in (range count)
+                let err =
+                    pthread_create (& (threads @ i)) null f
+                        bitcast (& (tasks @ i)) voidstar
+                assert (err == 0) "failed to start sort thread"
+            for i in (range count)
+                pthread_join (threads @ i) null
+            free threads
+
+        fn "parallel-sort-array" (items count)
+            static-if (operating-system == 'windows)
+                return (sorter.sort-array items count)
+            let nchunks = (min (hardware-concurrency) (count // ParallelSortChunkSize))
+            if (nchunks < 2:i64)
+                return (sorter.sort-array items count)
+            # sort equally sized chunks concurrently, then merge adjacent
+              chunks pairwise until one remains, with one thread per merge.
+            let chunk-size = (count // nchunks)
+            inline bound (i)
+                if (i >= nchunks) count
+                else (i * chunk-size)
+            let tasks = (malloc-array SortTask nchunks)
+            for i in (range nchunks)
+                tasks @ i =
+                    SortTask
+                        src = items
+                        dst = items
+                        lo = (bound i)
+                        mid = 0:i64
+                        hi = (bound (i + 1:i64))
+            run-tasks sort-task tasks nchunks
+            let buffer = (malloc-array element-type count)
+            let result =
+                loop (width src dst = 1:i64 items buffer)
+                    if (width >= nchunks)
+                        break src
+                    let ntasks =
+                        fold (ntasks = 0:i64) for c in (range 0:i64 nchunks (width * 2:i64))
+                            tasks @ ntasks =
+                                SortTask
+                                    src = src
+                                    dst = dst
+                                    lo = (bound c)
+                                    mid = (bound (min (c + width) nchunks))
+                                    hi = (bound (min (c + width * 2:i64) nchunks))
+                            ntasks + 1:i64
+                    run-tasks merge-task tasks ntasks
+                    repeat (width * 2:i64) dst src
+            if (result == buffer)
+                move-items items buffer count
+            free buffer
+            free tasks
+
     """"Sort elements of array `self` from smallest to largest, either using
         the `<` operator supplied by the element type, or by using the key
         supplied by the callable `key`, which is expected to return a comparable
         value for each element value supplied.
+
+        The sort is an unstable pattern-defeating quicksort, which runs in
+        linear time on sorted and reverse sorted input and in O(n log n) time
+        in the worst case.
     inline sort (self key ...)
-        (gen-sort key) (deref self._items) ((deref self._count) as i64) ...
+        let sorter = (gen-sort key)
+        sorter.sort-array (deref self._items) ((deref self._count) as i64) ...
 
     """"Sort elements of array `self` from smallest to largest, either using
         the `<` operator supplied by the element type, or by using the predicate
@@ -177,7 +540,37 @@ typedef+ Array
         is expected to return true if the first argument is smaller than the
         second one.
     inline predicated-sort (self predicate ...)
-        (gen-sort (predicate = predicate)) (deref self._items) ((deref self._count) as i64) ...
+        let sorter = (gen-sort (predicate = predicate))
+        sorter.sort-array (deref self._items) ((deref self._count) as i64) ...
+
+    """"Sort elements of array `self` like `sort`, but preserve the relative
+        order of elements that compare equal. The merge sort used requires a
+        temporary buffer of the same size as the array.
+    inline stable-sort (self key ...)
+        let sorter = (gen-sort key)
+        sorter.stable-sort-array (deref self._items) ((deref self._count) as i64) ...
+
+    """"Sort elements of array `self` like `predicated-sort`, but preserve the
+        relative order of elements that compare equal.
+    inline predicated-stable-sort (self predicate ...)
+        let sorter = (gen-sort (predicate = predicate))
+        sorter.stable-sort-array (deref self._items) ((deref self._count) as i64) ...
+
+    """"Sort elements of array `self` like `sort`, distributing the work over
+        one thread per hardware thread for large arrays. The array is split
+        into chunks which are sorted concurrently and then merged pairwise.
+        Unlike `sort`, `key` can not take additional arguments.
+    inline parallel-sort (self key)
+        (gen-parallel-sort ((typeof self) . ElementType) key)
+            deref self._items
+            (deref self._count) as i64
+
+    """"Sort elements of array `self` like `predicated-sort`, distributing the
+        work over multiple threads like `parallel-sort`.
+    inline predicated-parallel-sort (self predicate)
+        (gen-parallel-sort ((typeof self) . ElementType) (predicate = predicate))
+            deref self._items
+            (deref self._count) as i64
 
     fn append-slots (self n)
         let idx = (deref self._count)
@@ -284,7 +677,7 @@ typedef+ Array
         returning void
         for idx in (range (deref self._count))
             __drop (self._items @ idx)
-        free self._items
+        free-items self (deref self._items)
 
     """"Safely swap the contents of two indices.
     fn swap (self a b)
@@ -299,7 +692,7 @@ typedef+ Array
         let old-items = (deref self._items)
         let T = (typeof self)
         let capacity = ('capacity self)
-        let new-items = (malloc-array T.ElementType capacity)
+        let new-items = (alloc-items self capacity)
         loop (idx = 0)
             if (idx < count)
                 assign (copy (old-items @ idx)) (new-items @ idx)
@@ -321,7 +714,7 @@ typedef+ Array
                                 break false
                         else true
 
-    unlet gen-sort append-slots
+    unlet gen-sort gen-parallel-sort append-slots
 
 ################################################################################
 
@@ -416,6 +809,12 @@ typedef+ FixedArray
 
 let DEFAULT_CAPACITY = (1:usize << 2:usize)
 
+fn nearest-capacity (capacity count)
+    loop (new-capacity = capacity)
+        if (new-capacity < count)
+            repeat (new-capacity * 27:usize // 10:usize)
+        break new-capacity
+
 """"The supertype and constructor for arrays of growing size. New instances
     have a default capacity of 4, and grow by a factor of 2.7 each time their
     capacity is exceeded.
@@ -423,37 +822,57 @@ let DEFAULT_CAPACITY = (1:usize << 2:usize)
     To construct a new growing array type:
 
         :::scopes
-        GrowingArray element-type
+        GrowingArray element-type [allocator-type]
 
     Instantiate a new array with mutable memory:
 
         :::scopes
         local new-array : (GrowingArray element-type) [(capacity = ...)]
+
+    If `allocator-type` is specified, the array takes its memory from an
+    allocator of that type (see the `Allocator` module), which must be passed
+    to the constructor:
+
+        :::scopes
+        local new-array = ((GrowingArray element-type allocator-type) (allocator = ...))
 typedef+ GrowingArray
     let parent-type = this-type
 
     @@ memo
-    inline gen-growing-array-type (element-type)
+    inline gen-growing-array-type (element-type allocator-type)
         static-assert ((typeof element-type) == type)
         let parent-type = this-type
-        struct
-            .. "<GrowingArray "
-                tostring element-type
-                ">"
-            \ < parent-type
-            _items : (mutable pointer element-type)
-            _count : usize
-            _capacity : usize
-
-            let
-                ElementType = element-type
-                PointerType = (pointer element-type)
-
-    fn nearest-capacity (capacity count)
-        loop (new-capacity = capacity)
-            if (new-capacity < count)
-                repeat (new-capacity * 27:usize // 10:usize)
-            break new-capacity
+        static-if (none? allocator-type)
+            struct
+                .. "<GrowingArray "
+                    tostring element-type
+                    ">"
+                \ < parent-type
+                _items : (mutable pointer element-type)
+                _count : usize
+                _capacity : usize
+
+                let
+                    ElementType = element-type
+                    PointerType = (pointer element-type)
+        else
+            static-assert ((typeof allocator-type) == type)
+            struct
+                .. "<GrowingArray "
+                    tostring element-type
+                    " "
+                    tostring allocator-type
+                    ">"
+                \ < parent-type
+                _items : (mutable pointer element-type)
+                _count : usize
+                _capacity : usize
+                _allocator : allocator-type
+
+                let
+                    ElementType = element-type
+                    PointerType = (pointer element-type)
+                    AllocatorType = allocator-type
 
     inline __typecall (cls opts...)
         static-if (cls == this-type)
@@ -465,12 +884,26 @@ typedef+ GrowingArray
             let items... = (filter-items opts...)
             let count = (va-countof items...)
             let capacity = (nearest-capacity capacity count)
-            let items = (malloc-array cls.ElementType capacity)
-            assign-items cls count items items...
-            Struct.__typecall cls
-                _items = items
-                _count = count
-                _capacity = capacity
+            static-if (none? cls.AllocatorType)
+                let items = (malloc-array cls.ElementType capacity)
+                assign-items cls count items items...
+                Struct.__typecall cls
+                    _items = items
+                    _count = count
+                    _capacity = capacity
+            else
+                let allocator =
+                    imply
+                        va-option allocator opts...
+                            static-error "allocator option required"
+                        cls.AllocatorType
+                let items = ('alloc-array allocator cls.ElementType capacity)
+                assign-items cls count items items...
+                Struct.__typecall cls
+                    _items = items
+                    _count = count
+                    _capacity = capacity
+                    _allocator = allocator
 
 
     """"Implements support for the `repr` operation.
@@ -501,20 +934,146 @@ typedef+ GrowingArray
             let T = (typeof self)
             let count = (deref self._count)
             let old-items = (deref self._items)
-            let new-items = (malloc-array T.ElementType new-capacity)
+            let new-items = (alloc-items self new-capacity)
             llvm.memcpy.p0i8.p0i8.i64
                 bitcast (view new-items) (mutable rawstring)
                 bitcast old-items rawstring
                 (count * (sizeof T.ElementType)) as i64
                 false
-            free old-items
+            free-items self old-items
             assign new-items self._items
             self._capacity = new-capacity
         return;
 
-    unlet gen-growing-array-type parent-type nearest-capacity
+    unlet gen-growing-array-type parent-type
+
+""""The supertype and constructor for arrays which store up to a fixed number
+    of elements within the array value itself, and move their elements to the
+    heap once that number is exceeded, growing by a factor of 2.7 from there
+    on. Arrays that usually hold few elements and live briefly can so avoid
+    heap allocations entirely.
+
+    To construct a new small array type:
+
+        :::scopes
+        SmallArray element-type inline-capacity
+
+    Instantiate a new array with mutable memory:
+
+        :::scopes
+        local new-array : (SmallArray element-type inline-capacity)
+typedef+ SmallArray
+    let parent-type = this-type
+
+    inline small-array-items (self key)
+        let cls = (typeof self)
+        let heap = (deref self._heap)
+        if (heap == null)
+            bitcast (& (self._store @ 0)) (mutable pointer cls.ElementType)
+        else heap
+
+    @@ memo
+    inline gen-small-array-type (element-type capacity)
+        static-assert ((typeof element-type) == type)
+        static-assert ((typeof capacity) == i32)
+        static-assert (capacity > 0)
+        let parent-type = this-type
+        struct
+            .. "<SmallArray "
+                tostring element-type
+                " x "
+                tostring capacity
+                ">"
+            \ < parent-type
+            # heap storage, or null while the elements are stored inline
+            _heap : (mutable pointer element-type)
+            _count : usize
+            _capacity : usize
+            _store : (array element-type capacity)
+
+            let
+                ElementType = element-type
+                PointerType = (pointer element-type)
+                InlineCapacity = capacity
+                # pointer to the storage currently in use
+                _items = (Accessor small-array-items)
+
+    inline __typecall (cls opts...)
+        static-if (cls == this-type)
+            let element-type capacity = opts...
+            gen-small-array-type element-type (capacity as i32)
+        else
+            let items... = (filter-items opts...)
+            let count = (va-countof items...)
+            local self =
+                Struct.__typecall cls
+                    _heap = (nullof (mutable pointer cls.ElementType))
+                    _count = 0:usize
+                    _capacity = (cls.InlineCapacity as usize)
+                    _store = (nullof (array cls.ElementType cls.InlineCapacity))
+            'reserve self count
+            assign-items cls count self._items items...
+            self._count = count
+            deref self
+
+    """"Implements support for the `repr` operation.
+    fn __repr (self)
+        ..
+            "[count="
+            repr self._count
+            " capacity="
+            repr self._capacity
+            " items="
+            repr self._items
+            "]"
+
+    """"Returns the current maximum capacity of array `self`.
+    inline capacity (self)
+        deref self._capacity
+
+    """"Returns true if the elements of array `self` are stored inline.
+    inline inline? (self)
+        self._heap == null
+
+    """"Internally used by the type. Ensures that array `self` can hold at least
+        `count` elements, moving its elements to the heap when the inline
+        capacity is exceeded.
+    fn reserve (self count)
+        if (count <= self._capacity)
+            return;
+        let T = (typeof self)
+        let new-capacity =
+            nearest-capacity (deref self._capacity) count
+        let old-heap = (deref self._heap)
+        let new-items = (malloc-array T.ElementType new-capacity)
+        move-items (view new-items) self._items (deref self._count)
+        # null while the elements were stored inline
+        free old-heap
+        assign new-items self._heap
+        self._capacity = new-capacity
+        return;
+
+    """"Implements support for freeing the array's memory when it goes out
+        of scope.
+    fn __drop (self)
+        returning void
+        for idx in (range (deref self._count))
+            __drop (self._items @ idx)
+        free (deref self._heap)
+
+    """"Implements support for the `copy` operation.
+    fn __copy (self)
+        viewing self
+        let T = (typeof self)
+        local newarr : T
+        'reserve newarr (deref self._count)
+        for item in self
+            'append newarr (copy item)
+        deref newarr
+
+    unlet gen-small-array-type parent-type small-array-items
 
 do
-    let Array FixedArray GrowingArray
+    let Array FixedArray GrowingArray SmallArray
     locals;
 
@@ -0,0 +1,25 @@
+vvv bind lib
+include
+    """"#define _GNU_SOURCE
+        #include "sys/epoll.h"
+        #include "sys/timerfd.h"
+        #include "sys/socket.h"
+        #include "netinet/in.h"
+        #include "netinet/tcp.h"
+        #include "fcntl.h"
+        #include "errno.h"
+        #include "time.h"
+
+        int scopes_errno () { return errno; }
+
+do
+    using lib.define filter "^(EPOLL(.+)|O_NONBLOCK|O_CLOEXEC|F_GETFL|F_SETFL|TFD_(.+)|CLOCK_MONOTONIC|SOL_SOCKET|SO_REUSEADDR|SO_REUSEPORT|TCP_NODELAY|E(AGAIN|WOULDBLOCK|INTR|INPROGRESS))$"
+    using lib.const filter "^(EPOLL(.+)|SOCK_NONBLOCK|SOCK_CLOEXEC|MSG_(.+))$"
+    using lib.struct filter "^(epoll_event|mmsghdr|msghdr|iovec|itimerspec|timespec)$"
+    using lib.union filter "^(epoll_data)$"
+    using lib.extern filter "^(epoll_(.+)|fcntl|timerfd_(.+)|recvmmsg|sendmmsg|accept4|getsockopt)$"
+
+    # errno is thread-local and can not be bound directly
+    let errno = lib.extern.scopes_errno
+
+    locals;
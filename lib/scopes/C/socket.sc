@@ -10,7 +10,7 @@ do
     #using lib.const filter "^(INADDR_(.+))$"
     #using lib.typedef filter "^(sockaddr)$"
     using lib.struct filter "^(sockaddr|sockaddr_(.+))$"
-    using lib.extern filter "^(socket|bind|listen|accept|connect|htons|htonl|close|read|recv|write|shutdown|setsockopt|inet_(.+))$"
+    using lib.extern filter "^(socket|bind|listen|accept|connect|getsockname|htons|htonl|close|read|recv|write|shutdown|setsockopt|inet_(.+))$"
 
     let
         INADDR_ANY       = 0x00000000:u32
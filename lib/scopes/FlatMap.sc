@@ -0,0 +1,362 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""FlatMap
+    =======
+
+    This module implements a key -> value store using open addressing with
+    SIMD group probing.
+
+# group probing hashtable in the style of Swiss tables, see
+    https://abseil.io/about/design/swisstables
+
+    every slot owns one control byte, which is either `Empty`, `Deleted` or
+    holds the lower 7 bits of the hash of the key stored in the slot (its
+    fingerprint). control bytes are stored in 16-byte aligned groups of 16
+    slots, so that a lookup can compare all fingerprints of a group against
+    the fingerprint of the key in a single vector comparison, and only needs
+    to compare full keys for slots whose fingerprint matches. a probe ends at
+    the first group that has an empty slot.
+
+using import struct
+using import Map
+
+let GroupSize = 16:u64
+let GroupType = (vector i8 16)
+let Empty = -128:i8
+let Deleted = -2:i8
+
+inline h1 (keyhash)
+    keyhash >> 7:u64
+
+inline h2 (keyhash)
+    (keyhash & 0x7f:u64) as i8
+
+inline match-byte (group value)
+    """"Returns a mask with one bit set for every control byte in `group` that
+        is equal to `value`.
+    bitcast (group == (vector.smear value 16)) u16
+
+inline match-free (group)
+    """"Returns a mask with one bit set for every control byte in `group` that
+        is either `Empty` or `Deleted`.
+    bitcast (group < (vector.smear 0:i8 16)) u16
+
+inline max-load (capacity)
+    # maximum load factor of 7/8
+    capacity - (capacity // 8:u64)
+
+fn alloc-ctrl (capacity)
+    let numgroups = (capacity // GroupSize)
+    let ctrl = (malloc-array GroupType numgroups)
+    for i in (range numgroups)
+        ctrl @ i = (vector.smear Empty 16)
+    ctrl
+
+typedef FlatMap < Struct
+    let MinCapacity = GroupSize
+
+    @@ memo
+    inline gen-type (key-type value-type hash-function)
+        let parent-type = this-type
+        let hash-function =
+            static-if (none? hash-function) hash
+            else hash-function
+        struct (.. "<FlatMap " (tostring key-type) "=" (tostring value-type) ">") < parent-type
+            let KeyType = key-type
+            let ValueType = value-type
+            let HashFunction = hash-function
+
+            _ctrl : (mutable pointer GroupType)
+            _keys : (mutable pointer KeyType)
+            _values : (mutable pointer ValueType)
+            _count : u64
+            _deleted : u64
+            _capacity : u64
+
+    inline ctrl-bytes (self)
+        bitcast (deref self._ctrl) (mutable pointer i8)
+
+    inline lookup (self key keyhash successf failf)
+        """"Finds the index of the slot associated with key and passes it to
+            successf, or invokes failf on failure.
+        let groupmask = ((self._capacity // GroupSize) - 1:u64)
+        let fingerprint = (h2 keyhash)
+        loop (g step = ((h1 keyhash) & groupmask) 0:u64)
+            let group = (deref (self._ctrl @ g))
+            let base = (g * GroupSize)
+            loop (m = (match-byte group fingerprint))
+                if (m == 0:u16)
+                    break;
+                let idx = (base + ((findlsb m) as u64))
+                if ((self._keys @ idx) == key)
+                    return (successf idx)
+                repeat (m & (m - 1:u16))
+            if ((match-byte group Empty) != 0:u16)
+                return (failf)
+            # triangular probing visits every group once
+            let step = (step + 1:u64)
+            repeat ((g + step) & groupmask) step
+
+    fn find-free-slot (self keyhash)
+        let groupmask = ((self._capacity // GroupSize) - 1:u64)
+        loop (g step = ((h1 keyhash) & groupmask) 0:u64)
+            let m = (match-free (deref (self._ctrl @ g)))
+            if (m != 0:u16)
+                break ((g * GroupSize) + ((findlsb m) as u64))
+            let step = (step + 1:u64)
+            repeat ((g + step) & groupmask) step
+
+    inline insert_entry (self key keyhash value)
+        let cls = (typeof self)
+        let idx = (find-free-slot self keyhash)
+        let ctrl = (ctrl-bytes self)
+        if ((ctrl @ idx) == Deleted)
+            self._deleted -= 1:u64
+        ctrl @ idx = (h2 keyhash)
+        assign (imply key cls.KeyType) (self._keys @ idx)
+        assign (imply value cls.ValueType) (self._values @ idx)
+        self._count += 1:u64
+        idx
+
+    inline erase_pos (self idx)
+        let ctrl = (ctrl-bytes self)
+        let group = (deref (self._ctrl @ (idx // GroupSize)))
+        # if the group still has an empty slot, no probe ever continued past
+            it, and the slot can be made empty again.
+        if ((match-byte group Empty) != 0:u16)
+            ctrl @ idx = Empty
+        else
+            ctrl @ idx = Deleted
+            self._deleted += 1:u64
+        self._count -= 1:u64
+        _
+            dupe (deref (self._keys @ idx))
+            dupe (deref (self._values @ idx))
+
+    fn resize (self new-capacity)
+        let cls = (typeof self)
+        let hash = cls.HashFunction
+        let old-capacity = (deref self._capacity)
+        let old-ctrl = (deref self._ctrl)
+        let old-keys = (deref self._keys)
+        let old-values = (deref self._values)
+        assign (alloc-ctrl new-capacity) self._ctrl
+        assign (malloc-array cls.KeyType new-capacity) self._keys
+        assign (malloc-array cls.ValueType new-capacity) self._values
+        self._capacity = new-capacity
+        self._count = 0:u64
+        self._deleted = 0:u64
+        let old-bytes = (bitcast old-ctrl (mutable pointer i8))
+        for i in (range old-capacity)
+            if ((old-bytes @ i) >= 0:i8)
+                # extract as new uniques
+                let key = (dupe (deref (old-keys @ i)))
+                let value = (dupe (deref (old-values @ i)))
+                let keyhash = ((hash key) as u64)
+                insert_entry self key keyhash value
+        free old-ctrl
+        free old-keys
+        free old-values
+        return;
+
+    fn auto-grow (self)
+        let capacity = (deref self._capacity)
+        if ((self._count + self._deleted) >= (max-load capacity))
+            # if at least half of the used slots are tombstones, rehashing
+                at the same capacity is enough
+            resize self
+                if (((self._count + 1:u64) * 2:u64) <= (max-load capacity)) capacity
+                else (capacity * 2:u64)
+
+    fn reserve (self count)
+        """"Ensures that the map can hold at least `count` entries without
+            having to rehash.
+        let count = (count as u64)
+        let capacity =
+            loop (capacity = (deref self._capacity))
+                if ((max-load capacity) >= count)
+                    break capacity
+                repeat (capacity * 2:u64)
+        if (capacity != self._capacity)
+            resize self capacity
+        return;
+
+    inline capacity (self)
+        """"Returns the number of slots currently allocated by the map.
+        deref self._capacity
+
+    fn hash-key (self key)
+        """"Returns the hash of `key` as used by the map, for use with the
+            `-hashed` variants of `set`, `in?` and `get`.
+        let cls = (typeof self)
+        (cls.HashFunction (key as cls.KeyType)) as u64
+
+    fn clear (self)
+        let ctrl = (ctrl-bytes self)
+        for i in (range (deref self._capacity))
+            if ((ctrl @ i) >= 0:i8)
+                __drop (self._keys @ i)
+                __drop (self._values @ i)
+        for i in (range (self._capacity // GroupSize))
+            self._ctrl @ i = (vector.smear Empty 16)
+        self._count = 0:u64
+        self._deleted = 0:u64
+        return;
+
+    fn set-hashed (self key keyhash value)
+        """"Inserts a new key -> value association into map, using the
+            precomputed `keyhash`, which must be the value that `hash-key`
+            returns for `key`. If the key already exists, it will be updated.
+        let keyhash = (keyhash as u64)
+        lookup self key keyhash
+            inline "ok" (idx)
+                self._values @ idx = value
+                return;
+            inline "fail" ()
+                auto-grow self
+                insert_entry self key keyhash value
+                return;
+
+    fn set (self key value)
+        """"Inserts a new key -> value association into map. If the key
+            already exists, it will be updated.
+        set-hashed self key (hash-key self key) value
+
+    fn next-full (self i)
+        let capacity = (deref self._capacity)
+        let ctrl = (ctrl-bytes self)
+        loop (i = i)
+            if (i >= capacity)
+                break i
+            if ((ctrl @ i) >= 0:i8)
+                break i
+            repeat (i + 1:u64)
+
+    inline key-value-generator (self)
+        Generator
+            inline () (next-full self 0:u64)
+            inline (i) (i < self._capacity)
+            inline (i)
+                _ (deref (self._keys @ i)) (deref (self._values @ i))
+            inline (i) (next-full self (i + 1:u64))
+
+    inline __as (cls T)
+        static-if (T == Generator)
+            key-value-generator
+        else
+            ;
+
+    fn in-hashed? (self key keyhash)
+        """"Returns true if map contains key, using the precomputed `keyhash`.
+        lookup self key (keyhash as u64)
+            inline "ok" (idx) true
+            inline "fail" () false
+
+    fn in? (self key)
+        in-hashed? self key (hash-key self key)
+
+    @@ memo
+    inline __rin (elemT cls)
+        let KeyType = cls.KeyType
+        static-if (imply? elemT KeyType)
+            inline (key self)
+                in? self (imply key KeyType)
+
+    fn getdefault (self key value)
+        """"Returns the value associated with key or value if the map does not
+            contain the key.
+        lookup self key (hash-key self key)
+            inline "ok" (idx)
+                return (deref (self._values @ idx))
+            inline "fail" ()
+                return (view value)
+
+    fn get-hashed (self key keyhash)
+        """"Returns the value associated with key or raises an error, using the
+            precomputed `keyhash`.
+        lookup self key (keyhash as u64)
+            inline "ok" (idx)
+                return (self._values @ idx)
+            inline "fail" ()
+                raise (MapError.KeyNotFound)
+
+    fn get (self key)
+        """"Returns the value associated with key or raises an error.
+        get-hashed self key (hash-key self key)
+
+    fn discard (self key)
+        """"Erases a key -> value association from the map; if the map does not
+            contain this key, nothing happens.
+        lookup self key (hash-key self key)
+            inline "ok" (idx)
+                erase_pos self idx
+                return;
+            inline "fail" ()
+                return;
+
+    fn pop (self key)
+        """"Erases a key -> value association from the map and pops the old value
+        lookup self key (hash-key self key)
+            inline "ok" (idx)
+                let k v = (erase_pos self idx)
+                return v
+            inline "fail" ()
+                raise (MapError.KeyNotFound)
+
+    inline __tobool (self)
+        self._count != 0:u64
+
+    inline __countof (self)
+        (deref self._count) as usize
+
+    fn __drop (self)
+        let ctrl = (ctrl-bytes self)
+        for i in (range (deref self._capacity))
+            if ((ctrl @ i) >= 0:i8)
+                __drop (self._keys @ i)
+                __drop (self._values @ i)
+        free self._ctrl
+        free self._keys
+        free self._values
+
+    fn __copy (self)
+        local other : (typeof self)
+        reserve other self._count
+        for k v in self
+            'set other (copy k) (copy v)
+        other
+
+    inline __typecall (cls opts...)
+        static-if (cls == this-type)
+            let key-type value-type function-type = opts...
+            gen-type key-type value-type function-type
+        else
+            Struct.__typecall cls
+                _ctrl = (alloc-ctrl MinCapacity)
+                _keys = (malloc-array cls.KeyType MinCapacity)
+                _values = (malloc-array cls.ValueType MinCapacity)
+                _count = 0:u64
+                _deleted = 0:u64
+                _capacity = MinCapacity
+
+    fn dump (self)
+        let ctrl = (ctrl-bytes self)
+        for i in (range (deref self._capacity))
+            let c = (deref (ctrl @ i))
+            if (c >= 0:i8)
+                print i c (self._keys @ i) "=" (self._values @ i)
+            elseif (c == Deleted)
+                print i "<deleted>"
+            else
+                print i "<empty>"
+        print "capacity" self._capacity "count" self._count "deleted" self._deleted
+
+    unlet ctrl-bytes lookup find-free-slot insert_entry erase_pos resize
+        \ auto-grow next-full key-value-generator gen-type
+
+do
+    let FlatMap MapError
+    locals;
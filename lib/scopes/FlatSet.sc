@@ -0,0 +1,332 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""FlatSet
+    =======
+
+    This module implements mathematical sets using open addressing with SIMD
+    group probing.
+
+# group probing hashtable in the style of Swiss tables; see FlatMap.sc for
+    a description of the layout.
+
+using import struct
+using import Map
+
+let GroupSize = 16:u64
+let GroupType = (vector i8 16)
+let Empty = -128:i8
+let Deleted = -2:i8
+
+inline h1 (keyhash)
+    keyhash >> 7:u64
+
+inline h2 (keyhash)
+    (keyhash & 0x7f:u64) as i8
+
+inline match-byte (group value)
+    """"Returns a mask with one bit set for every control byte in `group` that
+        is equal to `value`.
+    bitcast (group == (vector.smear value 16)) u16
+
+inline match-free (group)
+    """"Returns a mask with one bit set for every control byte in `group` that
+        is either `Empty` or `Deleted`.
+    bitcast (group < (vector.smear 0:i8 16)) u16
+
+inline max-load (capacity)
+    # maximum load factor of 7/8
+    capacity - (capacity // 8:u64)
+
+fn alloc-ctrl (capacity)
+    let numgroups = (capacity // GroupSize)
+    let ctrl = (malloc-array GroupType numgroups)
+    for i in (range numgroups)
+        ctrl @ i = (vector.smear Empty 16)
+    ctrl
+
+#-------------------------------------------------------------------------------
+
+typedef FlatSet < Struct
+    let MinCapacity = GroupSize
+
+    @@ memo
+    inline gen-type (key-type hash-function)
+        let parent-type = this-type
+        let hash-function =
+            static-if (none? hash-function) hash
+            else hash-function
+        struct (.. "<FlatSet " (tostring key-type) ">") < parent-type
+            let KeyType = key-type
+            let HashFunction = hash-function
+
+            _ctrl : (mutable pointer GroupType)
+            _keys : (mutable pointer KeyType)
+            _count : u64
+            _deleted : u64
+            _capacity : u64
+
+    inline ctrl-bytes (self)
+        bitcast (deref self._ctrl) (mutable pointer i8)
+
+    inline lookup (self key keyhash successf failf)
+        """"Finds the index of the slot holding key and passes it to successf,
+            or invokes failf on failure.
+        let groupmask = ((self._capacity // GroupSize) - 1:u64)
+        let fingerprint = (h2 keyhash)
+        loop (g step = ((h1 keyhash) & groupmask) 0:u64)
+            let group = (deref (self._ctrl @ g))
+            let base = (g * GroupSize)
+            loop (m = (match-byte group fingerprint))
+                if (m == 0:u16)
+                    break;
+                let idx = (base + ((findlsb m) as u64))
+                if ((self._keys @ idx) == key)
+                    return (successf idx)
+                repeat (m & (m - 1:u16))
+            if ((match-byte group Empty) != 0:u16)
+                return (failf)
+            # triangular probing visits every group once
+            let step = (step + 1:u64)
+            repeat ((g + step) & groupmask) step
+
+    fn find-free-slot (self keyhash)
+        let groupmask = ((self._capacity // GroupSize) - 1:u64)
+        loop (g step = ((h1 keyhash) & groupmask) 0:u64)
+            let m = (match-free (deref (self._ctrl @ g)))
+            if (m != 0:u16)
+                break ((g * GroupSize) + ((findlsb m) as u64))
+            let step = (step + 1:u64)
+            repeat ((g + step) & groupmask) step
+
+    inline insert_entry (self key keyhash)
+        let cls = (typeof self)
+        let idx = (find-free-slot self keyhash)
+        let ctrl = (ctrl-bytes self)
+        if ((ctrl @ idx) == Deleted)
+            self._deleted -= 1:u64
+        ctrl @ idx = (h2 keyhash)
+        assign (imply key cls.KeyType) (self._keys @ idx)
+        self._count += 1:u64
+        idx
+
+    inline erase_pos (self idx)
+        let ctrl = (ctrl-bytes self)
+        let group = (deref (self._ctrl @ (idx // GroupSize)))
+        # if the group still has an empty slot, no probe ever continued past
+            it, and the slot can be made empty again.
+        if ((match-byte group Empty) != 0:u16)
+            ctrl @ idx = Empty
+        else
+            ctrl @ idx = Deleted
+            self._deleted += 1:u64
+        self._count -= 1:u64
+        dupe (deref (self._keys @ idx))
+
+    fn resize (self new-capacity)
+        let cls = (typeof self)
+        let hash = cls.HashFunction
+        let old-capacity = (deref self._capacity)
+        let old-ctrl = (deref self._ctrl)
+        let old-keys = (deref self._keys)
+        assign (alloc-ctrl new-capacity) self._ctrl
+        assign (malloc-array cls.KeyType new-capacity) self._keys
+        self._capacity = new-capacity
+        self._count = 0:u64
+        self._deleted = 0:u64
+        let old-bytes = (bitcast old-ctrl (mutable pointer i8))
+        for i in (range old-capacity)
+            if ((old-bytes @ i) >= 0:i8)
+                # extract as new unique
+                let key = (dupe (deref (old-keys @ i)))
+                let keyhash = ((hash key) as u64)
+                insert_entry self key keyhash
+        free old-ctrl
+        free old-keys
+        return;
+
+    fn auto-grow (self)
+        let capacity = (deref self._capacity)
+        if ((self._count + self._deleted) >= (max-load capacity))
+            # if at least half of the used slots are tombstones, rehashing
+                at the same capacity is enough
+            resize self
+                if (((self._count + 1:u64) * 2:u64) <= (max-load capacity)) capacity
+                else (capacity * 2:u64)
+
+    fn reserve (self count)
+        """"Ensures that the set can hold at least `count` keys without having
+            to rehash.
+        let count = (count as u64)
+        let capacity =
+            loop (capacity = (deref self._capacity))
+                if ((max-load capacity) >= count)
+                    break capacity
+                repeat (capacity * 2:u64)
+        if (capacity != self._capacity)
+            resize self capacity
+        return;
+
+    inline capacity (self)
+        """"Returns the number of slots currently allocated by the set.
+        deref self._capacity
+
+    fn hash-key (self key)
+        """"Returns the hash of `key` as used by the set, for use with
+            `insert-hashed` and `in-hashed?`.
+        let cls = (typeof self)
+        (cls.HashFunction (key as cls.KeyType)) as u64
+
+    fn clear (self)
+        let ctrl = (ctrl-bytes self)
+        for i in (range (deref self._capacity))
+            if ((ctrl @ i) >= 0:i8)
+                __drop (self._keys @ i)
+        for i in (range (self._capacity // GroupSize))
+            self._ctrl @ i = (vector.smear Empty 16)
+        self._count = 0:u64
+        self._deleted = 0:u64
+        return;
+
+    fn insert-hashed (self key keyhash)
+        """"Inserts a new key into set, using the precomputed `keyhash`, which
+            must be the value that `hash-key` returns for `key`.
+        let keyhash = (keyhash as u64)
+        lookup self key keyhash
+            inline "ok" (idx)
+                deref (self._keys @ idx)
+            inline "fail" ()
+                auto-grow self
+                let idx = (insert_entry self key keyhash)
+                deref (self._keys @ idx)
+
+    fn insert (self key)
+        """"Inserts a new key into set.
+        insert-hashed self key (hash-key self key)
+
+    fn dump (self)
+        let ctrl = (ctrl-bytes self)
+        for i in (range (deref self._capacity))
+            let c = (deref (ctrl @ i))
+            if (c >= 0:i8)
+                print i c (self._keys @ i)
+            elseif (c == Deleted)
+                print i "<deleted>"
+            else
+                print i "<empty>"
+        print "capacity" self._capacity "count" self._count "deleted" self._deleted
+
+    fn in-hashed? (self key keyhash)
+        """"Returns true if set contains key, using the precomputed `keyhash`.
+        lookup self key (keyhash as u64)
+            inline "ok" (idx) true
+            inline "fail" () false
+
+    fn in? (self key)
+        in-hashed? self key (hash-key self key)
+
+    @@ memo
+    inline __rin (elemT cls)
+        let KeyType = cls.KeyType
+        static-if (imply? elemT KeyType)
+            inline (key self)
+                in? self (imply key KeyType)
+
+    fn getdefault (self key value)
+        """"Returns the key stored in the set that is equal to key, or value if
+            the set does not contain the key.
+        lookup self key (hash-key self key)
+            inline "ok" (idx)
+                return (deref (self._keys @ idx))
+            inline "fail" ()
+                return (view value)
+
+    fn get (self key)
+        """"Returns the key stored in the set that is equal to key or raises an
+            error.
+        lookup self key (hash-key self key)
+            inline "ok" (idx)
+                return (deref (self._keys @ idx))
+            inline "fail" ()
+                raise (MapError.KeyNotFound)
+
+    fn discard (self key)
+        """"Erases a key from the set; if the set does not contain this key,
+            nothing happens.
+        lookup self key (hash-key self key)
+            inline "ok" (idx)
+                erase_pos self idx
+                return;
+            inline "fail" ()
+                return;
+
+    fn next-full (self i)
+        let capacity = (deref self._capacity)
+        let ctrl = (ctrl-bytes self)
+        loop (i = i)
+            if (i >= capacity)
+                break i
+            if ((ctrl @ i) >= 0:i8)
+                break i
+            repeat (i + 1:u64)
+
+    inline set-generator (self)
+        Generator
+            inline () (next-full self 0:u64)
+            inline (i) (i < self._capacity)
+            inline (i) (deref (self._keys @ i))
+            inline (i) (next-full self (i + 1:u64))
+
+    fn pop (self)
+        """"Discards an arbitrary key from the set and returns the discarded key.
+        let idx = (next-full self 0:u64)
+        assert (idx < self._capacity) "can't pop from empty set"
+        erase_pos self idx
+
+    inline __as (cls T)
+        static-if (T == Generator)
+            set-generator
+        else
+            ;
+
+    inline __tobool (self)
+        self._count != 0:u64
+
+    inline __countof (self)
+        (deref self._count) as usize
+
+    fn __drop (self)
+        let ctrl = (ctrl-bytes self)
+        for i in (range (deref self._capacity))
+            if ((ctrl @ i) >= 0:i8)
+                __drop (self._keys @ i)
+        free self._ctrl
+        free self._keys
+
+    fn __copy (self)
+        local other : (typeof self)
+        reserve other self._count
+        for k in self
+            'insert other (copy k)
+        other
+
+    inline __typecall (cls opts...)
+        static-if (cls == this-type)
+            let key-type function-type = opts...
+            gen-type key-type function-type
+        else
+            Struct.__typecall cls
+                _ctrl = (alloc-ctrl MinCapacity)
+                _keys = (malloc-array cls.KeyType MinCapacity)
+                _count = 0:u64
+                _deleted = 0:u64
+                _capacity = MinCapacity
+
+    unlet ctrl-bytes lookup find-free-slot insert_entry erase_pos resize
+        \ auto-grow next-full set-generator gen-type
+
+do
+    let FlatSet
+    locals;
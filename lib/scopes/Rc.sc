@@ -10,6 +10,11 @@
     module provides a strong reference type `Rc`, as well as a weak reference
     type `Weak`.
 
+    `Arc` and `AtomicWeak` are variants of `Rc` and `Weak` that update their
+    reference counts with atomic instructions, so that references to the same
+    value can be copied and dropped from multiple threads. They are slower
+    than their non-atomic counterparts, even without contention.
+
 define DEBUG_DOUBLE_FREES false
 
 let
@@ -36,6 +41,8 @@ inline _baseptr (self)
 
 typedef Weak < ReferenceCounted
 typedef Rc < ReferenceCounted
+typedef AtomicWeak < Weak
+typedef Arc < Rc
 
 let use-rc free-rc =
     static-if DEBUG_DOUBLE_FREES
@@ -270,8 +277,8 @@ typedef+ Rc
             selfT as:= type
             otherT as:= type
             static-if (not const?)
-                let WeakT = ('@ selfT 'WeakType)
-                if ((otherT == Weak) or (otherT == (WeakT as type)))
+                let WeakT = (('@ selfT 'WeakType) as type)
+                if ((otherT == ('superof WeakT)) or (otherT == WeakT))
                     return WeakT
             let selfT = (('@ selfT 'Type) as type)
             let conv = (f selfT otherT const?)
@@ -308,6 +315,185 @@ typedef+ Rc
 
     unlet _view _drop
 
+#-------------------------------------------------------------------------------
+# atomic reference counting
+#-------------------------------------------------------------------------------
+
+# as with Rc, the value is dropped when the strong count reaches zero. the
+    strong references collectively hold one additional weak reference, which
+    is released after the value has been dropped, and the memory is freed by
+    whoever releases the last weak reference. this way, the last strong and
+    the last weak reference can be dropped concurrently without both of them
+    freeing the memory.
+
+    Scopes lowers atomicrmw and cmpxchg with sequentially consistent ordering,
+    which subsumes the acquire-release ordering required for the decrements.
+
+@@ memo
+inline gen-atomic-type (T)
+    let storage-type =
+        mutable pointer T
+    let WeakType =
+        typedef (.. "<AtomicWeak " (tostring T) ">") < AtomicWeak
+            \ :: storage-type
+    let ArcType =
+        typedef (.. "<Arc " (tostring T) ">") < Arc
+            \ :: storage-type
+
+    typedef+ WeakType
+        let Type = T
+        let RcType = ArcType
+
+        inline... __typecall
+        case (cls, value : ArcType)
+            let md = (_mdptr value)
+            atomicrmw add (getelementptr md 0 WEAKRC_INDEX) 1
+            bitcast (dupe (view value)) this-type
+        case (cls)
+            # null-weak that will never upgrade
+            inttoptr 0:usize this-type
+
+    typedef+ ArcType
+        let Type = T
+        let WeakType = WeakType
+
+        fn wrap (value)
+            let fullsize = (HEADERSIZE + (sizeof T))
+            let ptr = (malloc-array u8 fullsize)
+            use-rc ptr
+            let self = (inttoptr (add (ptrtoint ptr usize) HEADERSIZE) storage-type)
+            store value self
+            let mdptr = (_mdptr self)
+            store 1 (getelementptr mdptr 0 STRONGRC_INDEX)
+            # implicit weak reference held by all strong references
+            store 1 (getelementptr mdptr 0 WEAKRC_INDEX)
+            bitcast self this-type
+
+        inline __typecall (cls args...)
+            wrap (T args...)
+    ArcType
+
+fn atomic-strong-count (value)
+    viewing value
+    if (not (ptrtoint value usize))
+        return 0
+    let md = (_mdptr value)
+    atomicrmw bor (getelementptr md 0 STRONGRC_INDEX) 0
+
+fn atomic-weak-count (value)
+    viewing value
+    if (not (ptrtoint value usize))
+        return 1
+    let md = (_mdptr value)
+    let strong = (atomicrmw bor (getelementptr md 0 STRONGRC_INDEX) 0)
+    let weak = (atomicrmw bor (getelementptr md 0 WEAKRC_INDEX) 0)
+    # don't count the weak reference held by the strong references
+    if (strong > 0) (weak - 1)
+    else weak
+
+fn release-weak (self)
+    let md = (_mdptr self)
+    let rc = (atomicrmw sub (getelementptr md 0 WEAKRC_INDEX) 1)
+    assert (rc > 0) "corrupt refcount encountered"
+    if (rc == 1)
+        free-rc self
+
+typedef+ AtomicWeak
+    inline... __typecall
+    case (cls, T : type)
+        (gen-atomic-type T) . WeakType
+
+    let strong-count = atomic-strong-count
+    let weak-count = atomic-weak-count
+
+    fn _drop (self)
+        if (not (ptrtoint (view self) usize))
+            return;
+        release-weak self
+
+    inline __drop (self)
+        _drop (deref self)
+
+    fn... __copy (self : AtomicWeak,)
+        viewing self
+        if (ptrtoint self usize)
+            let md = (_mdptr self)
+            atomicrmw add (getelementptr md 0 WEAKRC_INDEX) 1
+        deref (dupe self)
+
+    inline try-increment (self)
+        """"Increments the strong count unless it is zero, and returns whether
+            it was incremented.
+        let refcount = (getelementptr (_mdptr self) 0 STRONGRC_INDEX)
+        # a failed exchange returns the current count, so the loop does not
+          need to load it separately
+        loop (expected = 1)
+            if (expected == 0)
+                break false
+            assert (expected > 0) "corrupt refcount encountered"
+            let rc success? = (cmpxchg refcount expected (add expected 1))
+            if success?
+                break true
+            rc
+
+    fn upgrade (self)
+        viewing self
+        if (not (ptrtoint self usize))
+            raise (UpgradeError)
+        if (not (try-increment self))
+            raise (UpgradeError)
+        let RcType = ((typeof self) . RcType)
+        deref (bitcast (dupe self) RcType)
+
+    fn force-upgrade (self)
+        viewing self
+        assert (ptrtoint self usize) "upgrading Weak failed"
+        assert (try-increment self) "upgrading Weak failed"
+        let RcType = ((typeof self) . RcType)
+        deref (bitcast (dupe self) RcType)
+
+    unlet _drop try-increment
+
+typedef+ Arc
+    inline... __typecall
+    case (cls, T : type)
+        gen-atomic-type T
+
+    inline new (T args...)
+        (gen-atomic-type T) args...
+
+    inline wrap (value)
+        ((gen-atomic-type (typeof value)) . wrap) value
+
+    let strong-count = atomic-strong-count
+    let weak-count = atomic-weak-count
+
+    fn... __copy (value : Arc,)
+        viewing value
+        let md = (_mdptr value)
+        let rc = (atomicrmw add (getelementptr md 0 STRONGRC_INDEX) 1)
+        assert (rc > 0) "corrupt refcount encountered"
+        deref (dupe value)
+
+    inline __repr (self)
+        .. "(Arc " (repr (Rc.view self)) ")"
+
+    fn _drop (self)
+        viewing self
+        returning void
+        let md = (_mdptr self)
+        let rc = (atomicrmw sub (getelementptr md 0 STRONGRC_INDEX) 1)
+        assert (rc > 0) "corrupt refcount encountered"
+        if (rc == 1)
+            let payload = (Rc.view self)
+            __drop payload
+            release-weak self
+
+    inline __drop (self)
+        _drop (deref self)
+
+    unlet _drop
+
 do
-    let Rc Weak UpgradeError
+    let Rc Weak Arc AtomicWeak UpgradeError
     locals;
@@ -10,6 +10,7 @@
     on the heap. Strings are guaranteed to be zero-terminated.
 
 using import struct
+using import Array
 
 # declare void @llvm.memcpy.p0i8.p0i8.i64(i8* <dest>, i8* <src>,
                                         i64 <len>, i1 <isvolatile>)
@@ -22,6 +23,23 @@ let llvm.memset.p0i8.i64 =
     extern 'llvm.memset.p0i8.i64
         function void (mutable rawstring) char i64 bool
 
+inline alloc-items (self count)
+    """"Allocates uninitialized storage for `count` elements of string `self`,
+        from its allocator if it has one.
+    let cls = (typeof self)
+    static-if (none? cls.AllocatorType)
+        malloc-array cls.ElementType count
+    else
+        'alloc-array self._allocator cls.ElementType count
+
+inline free-items (self items)
+    """"Releases storage returned by `alloc-items` for string `self`.
+    let cls = (typeof self)
+    static-if (none? cls.AllocatorType)
+        free items
+    else
+        'free-array self._allocator items
+
 inline string-generator (self)
     Generator
         inline () 0:usize
@@ -70,6 +88,129 @@ typedef FixedString < StringBase
         local new-string : (GrowingString element-type) [(capacity = ...)]
 typedef GrowingString < StringBase
 
+""""The supertype and constructor for strings which store up to a fixed
+    number of elements within the string value itself, and move their
+    elements to the heap once that number is exceeded.
+
+    To construct a new small string type:
+
+        :::scopes
+        SmallString capacity [element-type]
+
+    Instantiate a new string with mutable memory:
+
+        :::scopes
+        local new-string : (SmallString capacity)
+typedef SmallString < StringBase
+
+""""A non-owning view of a sequence of characters, made of a pointer and a
+    length. Views are cheap to pass around and to slice, as no characters
+    are copied, but they do not keep the characters they refer to alive and
+    are not zero-terminated.
+
+    Views are constructed from a `string`, from a string of characters, or
+    from a pointer and a length, and are accepted wherever strings can be
+    appended, assigned or compared:
+
+        :::scopes
+        local s = (String "hello world")
+        let word = (rslice (StringView s) 6)
+        'append s word
+struct StringView plain
+    _items : rawstring
+    _count : usize
+
+    let ElementType = char
+
+    inline... __typecall
+    case (cls : type,)
+        CStruct.__typecall cls
+            _items = (nullof rawstring)
+            _count = 0:usize
+    case (cls : type, value : this-type)
+        value
+    case (cls : type, value : string)
+        CStruct.__typecall cls
+            _items = (value as rawstring)
+            _count = (countof value)
+    case (cls : type, value : (typematch T < StringBase))
+        static-assert (((typeof value) . ElementType) == char)
+            "only strings of characters can be viewed"
+        CStruct.__typecall cls
+            _items = (bitcast (deref value._items) rawstring)
+            _count = (deref value._count)
+    case (cls : type, data : rawstring, count : usize)
+        CStruct.__typecall cls
+            _items = data
+            _count = count
+
+    """"Implements support for the `countof` operator.
+    inline __countof (self)
+        deref self._count
+
+    """"Implements support for the `@` operator. Returns the character at
+        `index`.
+    fn __@ (self index)
+        let index = (index as usize)
+        assert (index < self._count) "index out of bounds"
+        deref (self._items @ index)
+
+    """"Returns a view of the first `n` characters.
+    inline __lslice (self n)
+        CStruct.__typecall (typeof self)
+            _items = self._items
+            _count = (min (n as usize) self._count)
+
+    """"Returns a view of the characters following the first `n` characters.
+    inline __rslice (self n)
+        let n = (min (n as usize) self._count)
+        CStruct.__typecall (typeof self)
+            _items = (getelementptr self._items n)
+            _count = (self._count - n)
+
+    inline __as (cls T)
+        static-if (T == Generator)
+            inline (self)
+                Generator
+                    inline () 0:usize
+                    inline (i) (i < self._count)
+                    inline (i) (deref (self._items @ i))
+                    inline (i) (i + 1:usize)
+        elseif (T == string)
+            inline (self)
+                string self._items self._count
+
+    inline __chunks (self)
+        let items = (deref self._items)
+        _ char (deref self._count)
+            inline (i) (deref (items @ i))
+
+    fn __hash (self)
+        hash.from-bytes self._items self._count
+
+    fn __repr (self)
+        repr (string self._items self._count)
+
+    @@ memo
+    inline __== (cls T)
+        static-if ((T == cls) or (T == string)
+            or ((T < StringBase) and (T.ElementType == char)))
+            fn (self other)
+                let other = (cls other)
+                if (self._count != other._count)
+                    return false
+                for i in (range self._count)
+                    if ((self._items @ i) != (other._items @ i))
+                        return false
+                true
+
+    @@ memo
+    inline __!= (cls T)
+        let f = (__== cls T)
+        static-if (not none? f)
+            inline (self other)
+                not f self other
+
 fn zero-terminated-length (value)
     let ZE = (nullof (elementof (typeof value)))
     # count length
@@ -92,7 +233,7 @@ fn copy-from-memory (self other count)
             break;
         items @ i = other @ i
         i + 1
-    free olditems
+    free-items self olditems
 
 fn join-from-memory (self other count)
     local self = (copy self)
@@ -162,6 +303,9 @@ inline string-binary-op (f superf)
         elseif ((ET == char) and (T == string))
             inline (self other)
                 f self (other as rawstring) (countof other)
+        elseif ((ET == char) and (T == StringView))
+            inline (self other)
+                f self other._items other._count
         elseif (not none? superf)
             superf cls T
 
@@ -185,6 +329,8 @@ inline inverted-string-binary-op (f)
                 not f self other
 
 typedef+ StringBase
+    # strings without an allocator use the C heap
+    let AllocatorType = none
 
     """"Implements support for the `as` operator. Strings can be cast to
         `Generator`, or directly passed to `for`.
@@ -259,6 +405,15 @@ typedef+ StringBase
     inline __countof (self)
         deref self._count
 
+    """"Implements support for chunked iteration with `itertools.chunked`.
+        Returns the element type, the number of elements and an inline that
+        loads the element at an index.
+    inline __chunks (self)
+        let cls = (typeof self)
+        let items = (deref self._items)
+        _ cls.ElementType (deref self._count)
+            inline (i) (deref (items @ i))
+
     """"Implements support for the `@` operator. Returns a view reference to the
         element at `index` of string `self`.
     fn __@ (self index)
@@ -310,6 +465,17 @@ typedef+ StringBase
             (count * (sizeof cls.ElementType)) as i64
             false
         ;
+    case (self, value : StringView)
+        let cls = (typeof self)
+        static-assert (cls.ElementType == char)
+        let count = (deref value._count)
+        let ptr = (append-slots self count)
+        llvm.memcpy.p0i8.p0i8.i64
+            bitcast (& ptr) (mutable rawstring)
+            deref value._items
+            (count * (sizeof cls.ElementType)) as i64
+            false
+        ;
     case using append
 
     """"Construct a new element with arguments `args...` directly in a newly
@@ -411,12 +577,12 @@ typedef+ StringBase
                 false
 
     fn reserve (self count)
-        free ('internal-reserve self count)
+        free-items self ('internal-reserve self count)
 
     """"Implements support for freeing the string's memory when it goes out
         of scope.
     inline __drop (self)
-        free self._items
+        free-items self (deref self._items)
 
     """"Safely swap the contents of two indices.
     fn swap (self a b)
@@ -430,7 +596,7 @@ typedef+ StringBase
         let old-items = (deref self._items)
         let cls = (typeof self)
         let capacity = ('capacity self)
-        let new-items = (malloc-array cls.ElementType capacity)
+        let new-items = (alloc-items self capacity)
         loop (idx = 0)
             if (idx < count)
                 assign (copy (old-items @ idx)) (new-items @ idx)
@@ -517,32 +683,52 @@ typedef+ FixedString
 
 let DEFAULT_CAPACITY = (1:usize << 2:usize)
 
+fn nearest-capacity (capacity count)
+    loop (new-capacity = capacity)
+        if (new-capacity < count)
+            repeat (new-capacity * 27:usize // 10:usize)
+        break new-capacity
+
 typedef+ GrowingString
     let parent-type = this-type
 
     @@ memo
-    inline gen-growing-string-type (element-type)
+    inline gen-growing-string-type (element-type allocator-type)
         static-assert ((typeof element-type) == type)
         let parent-type = this-type
-        struct
-            .. "<GrowingString "
-                tostring element-type
-                ">"
-            \ < parent-type
-            _items : (mutable pointer element-type)
-            _count : usize
-            _capacity : usize
-
-            let
-                ElementType = element-type
-                PointerType = (pointer element-type)
-                ZeroElement = (nullof element-type)
-
-    fn nearest-capacity (capacity count)
-        loop (new-capacity = capacity)
-            if (new-capacity < count)
-                repeat (new-capacity * 27:usize // 10:usize)
-            break new-capacity
+        static-if (none? allocator-type)
+            struct
+                .. "<GrowingString "
+                    tostring element-type
+                    ">"
+                \ < parent-type
+                _items : (mutable pointer element-type)
+                _count : usize
+                _capacity : usize
+
+                let
+                    ElementType = element-type
+                    PointerType = (pointer element-type)
+                    ZeroElement = (nullof element-type)
+        else
+            static-assert ((typeof allocator-type) == type)
+            struct
+                .. "<GrowingString "
+                    tostring element-type
+                    " "
+                    tostring allocator-type
+                    ">"
+                \ < parent-type
+                _items : (mutable pointer element-type)
+                _count : usize
+                _capacity : usize
+                _allocator : allocator-type
+
+                let
+                    ElementType = element-type
+                    PointerType = (pointer element-type)
+                    ZeroElement = (nullof element-type)
+                    AllocatorType = allocator-type
 
     @@ memo
     inline from-arguments (cls)
@@ -603,13 +789,46 @@ typedef+ GrowingString
                 _count = 0:usize
                 _capacity = capacity
 
+    @@ memo
+    inline from-allocator (cls)
+        inline (opts...)
+            let allocator =
+                imply
+                    va-option allocator opts...
+                        static-error "allocator option required"
+                    cls.AllocatorType
+            let capacity = DEFAULT_CAPACITY
+            let ET = cls.ElementType
+            let items = ('alloc-array allocator ET capacity)
+            llvm.memset.p0i8.i64
+                bitcast (view items) (mutable rawstring)
+                0:char
+                (capacity * (sizeof ET)) as i64
+                false
+            local self =
+                Struct.__typecall cls
+                    _items = items
+                    _count = 0:usize
+                    _capacity = capacity
+                    _allocator = allocator
+            va-map
+                inline (k...)
+                    static-if ((keyof k...) == unnamed)
+                        'append self k...
+                opts...
+            deref self
+
+    """"If the string type has an allocator type, the allocator must be passed
+        as `allocator` option; other arguments are appended to the string.
     inline __typecall (cls opts...)
         static-if (cls == this-type)
             gen-growing-string-type opts...
-        else
+        elseif (none? cls.AllocatorType)
             (from-arguments cls) opts...
+        else
+            (from-allocator cls) opts...
 
-    unlet from-arguments
+    unlet from-arguments from-allocator
 
     """"Implements support for the `repr` operation.
     fn __repr (self)
@@ -643,7 +862,7 @@ typedef+ GrowingString
             let T = (typeof self)
             let count = (deref self._count)
             let old-items = (deref self._items)
-            let new-items = (malloc-array T.ElementType new-capacity)
+            let new-items = (alloc-items self new-capacity)
             llvm.memcpy.p0i8.p0i8.i64
                 bitcast (view new-items) (mutable rawstring)
                 bitcast old-items rawstring
@@ -661,9 +880,300 @@ typedef+ GrowingString
         else
             nullof (typeof self._items)
 
-    unlet gen-growing-string-type parent-type nearest-capacity
+    unlet gen-growing-string-type parent-type
+
+typedef+ SmallString
+    let parent-type = this-type
+
+    inline small-string-items (self key)
+        let cls = (typeof self)
+        let heap = (deref self._heap)
+        if (heap == null)
+            bitcast (& (self._store @ 0)) (mutable pointer cls.ElementType)
+        else heap
+
+    @@ memo
+    inline gen-small-string-type (element-type capacity)
+        static-assert ((typeof element-type) == type)
+        static-assert ((typeof capacity) == i32)
+        static-assert (capacity >= 0)
+        let parent-type = this-type
+        struct
+            .. "<SmallString "
+                tostring element-type
+                " x "
+                tostring capacity
+                ">"
+            \ < parent-type
+            # heap storage, or null while the elements are stored inline
+            _heap : (mutable pointer element-type)
+            _count : usize
+            _capacity : usize
+            _store : (array element-type (capacity + 1))
+
+            let
+                ElementType = element-type
+                PointerType = (pointer element-type)
+                ZeroElement = (nullof element-type)
+                InlineCapacity = (capacity + 1)
+                # pointer to the storage currently in use
+                _items = (Accessor small-string-items)
+
+    inline __typecall (cls opts...)
+        static-if (cls == this-type)
+            let capacity element-type = opts...
+            gen-small-string-type
+                static-if (none? element-type) char
+                else element-type
+                capacity as i32
+        else
+            local self =
+                Struct.__typecall cls
+                    _heap = (nullof (mutable pointer cls.ElementType))
+                    _count = 0:usize
+                    _capacity = (cls.InlineCapacity as usize)
+                    _store = (nullof (array cls.ElementType cls.InlineCapacity))
+            va-map
+                inline (arg)
+                    'append self arg
+                opts...
+            deref self
+
+    """"Implements support for the `repr` operation.
+    fn __repr (self)
+        let cls = (typeof self)
+        if (cls.ElementType == char)
+            string self._items self._count
+        else
+            ..
+                "[count="
+                repr self._count
+                " capacity="
+                repr self._capacity
+                " items="
+                repr self._items
+                "]"
+
+    """"Returns the current maximum capacity of string `self`, which includes
+        the trailing zero.
+    inline capacity (self)
+        deref self._capacity
+
+    """"Returns true if the elements of string `self` are stored inline.
+    inline inline? (self)
+        self._heap == null
+
+    """"Internally used by the type. Ensures that string `self` can hold at least
+        `count` elements, moving its elements to the heap when the inline
+        capacity is exceeded.
+    fn internal-reserve (self count)
+        let cls = (typeof self)
+        if (count >= self._capacity)
+            let new-capacity =
+                nearest-capacity (deref self._capacity) (count + 1)
+            let T = (typeof self)
+            let count = (deref self._count)
+            let old-heap = (deref self._heap)
+            let new-items = (malloc-array T.ElementType new-capacity)
+            llvm.memcpy.p0i8.p0i8.i64
+                bitcast (view new-items) (mutable rawstring)
+                bitcast self._items rawstring
+                (count * (sizeof T.ElementType)) as i64
+                false
+            # null remainder of memory
+            llvm.memset.p0i8.i64
+                bitcast (getelementptr (view new-items) count) (mutable rawstring)
+                0:char
+                ((new-capacity - count) * (sizeof T.ElementType)) as i64
+                false
+            assign new-items self._heap
+            self._capacity = new-capacity
+            # null while the elements were stored inline
+            old-heap
+        else
+            nullof (typeof self._heap)
+
+    """"Implements support for freeing the string's memory when it goes out
+        of scope.
+    inline __drop (self)
+        free (deref self._heap)
+
+    """"Implements support for the `copy` operation.
+    fn __copy (self)
+        let cls = (typeof self)
+        local result : cls
+        copy-from-memory result self._items (countof self)
+        deref result
+
+    unlet gen-small-string-type parent-type small-string-items
+
+# a segment of a StringBuilder refers either to characters outside of the
+  builder, or, if `items` is null, to `count` characters at `offset` of the
+  builder's own buffer, which may move while the builder grows.
+struct StringSegment plain
+    items : rawstring
+    offset : usize
+    count : usize
+
+struct IOVec plain
+    base : voidstar
+    len : usize
+
+# the minimum IOV_MAX required by POSIX
+let IOVMax = 1024:usize
+
+let writev =
+    extern 'writev
+        function i64 i32 (pointer IOVec) i32
+
+""""Concatenates strings without intermediate copies. Appended strings and
+    views are recorded as segments referring to their characters, which must
+    stay alive until the builder has been flushed or cleared; other values are
+    converted to strings and copied into a buffer owned by the builder. The
+    result is assembled once, either as a `String` with `to-string`, or by
+    writing all segments straight to a file descriptor with `flush`:
+
+        :::scopes
+        local sb : StringBuilder
+        'append sb "x = " x "\n"
+        'flush sb 1 # stdout
+struct StringBuilder
+    _segments : (GrowingArray StringSegment)
+    _buffer : (GrowingString char)
+    _count : usize
+
+    """"Returns the total number of characters appended to the builder.
+    inline __countof (self)
+        deref self._count
+
+    fn append-view (self items count)
+        'append self._segments (StringSegment items 0:usize count)
+        self._count += count
+        return;
+
+    fn append-copy-view (self items count)
+        let offset = (countof self._buffer)
+        'append self._buffer (StringView items count)
+        # extend the last segment if it ends where the new characters start
+        let n = (countof self._segments)
+        if (n > 0:usize)
+            let last = ('last self._segments)
+            if ((last.items == null) and ((last.offset + last.count) == offset))
+                last.count += count
+                self._count += count
+                return;
+        'append self._segments (StringSegment (nullof rawstring) offset count)
+        self._count += count
+        return;
+
+    inline append-one (self value)
+        let T = (typeof value)
+        static-if (T == string)
+            append-view self (value as rawstring) (countof value)
+        elseif (T == StringView)
+            append-view self value._items value._count
+        elseif ((T < StringBase) and (T.ElementType == char))
+            append-view self (bitcast (deref value._items) rawstring) (countof value)
+        elseif (T == char)
+            local c = value
+            append-copy-view self (bitcast (& c) rawstring) 1:usize
+        else
+            let s = (tostring value)
+            append-copy-view self (s as rawstring) (countof s)
+
+    """"Appends `values...` to the builder. Strings, string views and `String`
+        values are referenced rather than copied; other values are converted
+        with `tostring`.
+    inline append (self values...)
+        va-map
+            inline (value)
+                append-one self value
+            values...
+        ;
+
+    """"Appends a copy of the characters of `value`, for strings that do not
+        live as long as the builder.
+    inline append-copy (self value)
+        let value = (StringView value)
+        append-copy-view self value._items value._count
+
+    fn segment-items (self segment)
+        let segment = (self._segments @ segment)
+        if (segment.items == null)
+            bitcast (& (self._buffer @ segment.offset)) rawstring
+        else
+            deref segment.items
+
+    """"Concatenates all segments into a new `String`.
+    fn to-string (self)
+        local result = ((GrowingString char) (deref self._count))
+        for i in (range (countof self._segments))
+            let count = ((self._segments @ i) . count)
+            'append result (StringView (segment-items self i) count)
+        result
+
+    inline __as (cls T)
+        static-if (T == (GrowingString char)) to-string
+
+    """"Removes all segments from the builder.
+    fn clear (self)
+        'clear self._segments
+        'clear self._buffer
+        self._count = 0:usize
+        return;
+
+    """"Writes the contents of the builder to the file descriptor `fd` using
+        as few system calls as possible, then clears the builder. Returns
+        false if writing failed; the builder is cleared in either case.
+    fn flush (self fd)
+        let fd = (fd as i32)
+        let count = (countof self._segments)
+        let iov = (malloc-array IOVec (min count IOVMax))
+        let ok? =
+            loop (first = 0:usize)
+                if (first >= count)
+                    break true
+                let n = (min (count - first) IOVMax)
+                for k in (range n)
+                    let segment = (first + k)
+                    iov @ k =
+                        IOVec
+                            bitcast (segment-items self segment) voidstar
+                            (self._segments @ segment) . count
+                # write the batch, resuming after partial writes
+                let ok? =
+                    loop (k = 0:usize)
+                        if (k == n)
+                            break true
+                        let written =
+                            writev fd (& (iov @ k)) ((n - k) as i32)
+                        if (written < 0)
+                            break false
+                        # skip the segments that were written completely
+                        loop (k written = k (written as usize))
+                            if (k == n)
+                                break k
+                            let len = (deref ((iov @ k) . len))
+                            if (written < len)
+                                let v = (iov @ k)
+                                v.base =
+                                    bitcast
+                                        getelementptr (bitcast v.base rawstring) written
+                                        voidstar
+                                v.len = (len - written)
+                                break k
+                            _ (k + 1:usize) (written - len)
+                if (not ok?)
+                    break false
+                first + n
+        free iov
+        clear self
+        ok?
+
+    unlet append-view append-copy-view append-one segment-items
 
 do
     #let StringBase FixedString GrowingString
     let String = (GrowingString char)
+    let GrowingString SmallString StringView StringBuilder
     locals;
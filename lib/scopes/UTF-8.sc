@@ -9,6 +9,11 @@
     This module provides UTF-8 encoder and decoder collectors, as well as
     a UTF-8 aware `char` function.
 
+    For whole buffers, `validate`, `count-codepoints`, `decode` and `encode`
+    process UTF-8 in bulk. They skip over runs of ASCII characters 16 bytes
+    at a time and only fall back to handling single sequences where
+    non-ASCII characters occur.
+
 using import enum
 
 # declare i8   @llvm.ctlz.i8  (i8   <src>, i1 <is_zero_undef>)
@@ -20,6 +25,11 @@ let llvm.ctlz.u32 =
     extern 'llvm.ctlz.i32
         function u32 u32 bool
 
+# declare i16 @llvm.ctpop.i16 (i16 <src>)
+let llvm.ctpop.i16 =
+    extern 'llvm.ctpop.i16
+        function u16 u16
+
 inline ctlz (c)
     llvm.ctlz.i8 c false
 inline ctlz-u32 (c)
@@ -137,6 +147,210 @@ inline decoder (coll)
     static-if (none? coll) _decoder
     else (_decoder coll)
 
+#-------------------------------------------------------------------------------
+# bulk conversion
+#-------------------------------------------------------------------------------
+
+let BlockSize = 16:usize
+
+inline load-block (data i)
+    """"Loads the 16 bytes at offset `i` of `data` as a vector; LLVM merges the
+        element loads into a single unaligned load.
+    vectorof i8
+        va-map
+            inline (k) ((data @ (i + (k as usize))) as i8)
+            va-range 16
+
+inline non-ascii-mask (block)
+    # one bit for every byte with the high bit set
+    bitcast (block < (vector.smear 0:i8 16)) u16
+
+inline continuation-mask (block)
+    # continuation bytes are 0x80 .. 0xbf, or -128 .. -65 as i8
+    bitcast (block < (vector.smear -64:i8 16)) u16
+
+fn sequence-length (data i count)
+    """"Returns the length of the well-formed UTF-8 sequence at offset `i` of
+        the `count` bytes at `data`, or 0 if the sequence is ill-formed, as
+        specified by table 3-7 of the Unicode standard.
+    inline byte (k) ((data @ (i + k)) as u8)
+    inline continuation? (b) ((b & 0xc0:u8) == 0x80:u8)
+    let c = (byte 0:usize)
+    let remaining = (count - i)
+    if (c < 0x80:u8) 1:usize
+    elseif (c < 0xc2:u8) 0:usize
+    elseif (c < 0xe0:u8)
+        if ((remaining >= 2:usize) and (continuation? (byte 1:usize))) 2:usize
+        else 0:usize
+    elseif (c < 0xf0:u8)
+        if (remaining < 3:usize)
+            return 0:usize
+        # exclude overlong encodings and surrogates
+        let lo = (? (c == 0xe0:u8) 0xa0:u8 0x80:u8)
+        let hi = (? (c == 0xed:u8) 0x9f:u8 0xbf:u8)
+        let b1 = (byte 1:usize)
+        if ((b1 >= lo) and (b1 <= hi) and (continuation? (byte 2:usize))) 3:usize
+        else 0:usize
+    elseif (c < 0xf5:u8)
+        if (remaining < 4:usize)
+            return 0:usize
+        # exclude overlong encodings and codepoints above U+10FFFF
+        let lo = (? (c == 0xf0:u8) 0x90:u8 0x80:u8)
+        let hi = (? (c == 0xf4:u8) 0x8f:u8 0xbf:u8)
+        let b1 = (byte 1:usize)
+        if ((b1 >= lo) and (b1 <= hi) and (continuation? (byte 2:usize))
+            and (continuation? (byte 3:usize)))
+            4:usize
+        else 0:usize
+    else 0:usize
+
+inline skip-ascii (data i count)
+    """"Returns the offset of the first byte at or after `i` which is not an
+        ASCII character, or the offset of the last incomplete block.
+    loop (i = i)
+        if ((i + BlockSize) > count)
+            break i
+        let m = (non-ascii-mask (load-block data i))
+        if (m != 0:u16)
+            break (i + ((findlsb m) as usize))
+        repeat (i + BlockSize)
+
+fn validate (data count)
+    """"Returns the offset of the first byte of the `count` bytes at `data`
+        which is not part of a well-formed UTF-8 sequence, or `count` if the
+        input is well-formed.
+    let count = (count as usize)
+    loop (i = 0:usize)
+        let i = (skip-ascii data i count)
+        if (i >= count)
+            break count
+        let n = (sequence-length data i count)
+        if (n == 0:usize)
+            break i
+        i + n
+
+inline valid? (data count)
+    """"Returns true if the `count` bytes at `data` are well-formed UTF-8.
+    (validate data count) == (count as usize)
+
+fn count-codepoints (data count)
+    """"Returns the number of bytes which are not continuation bytes among the
+        `count` bytes at `data`; for well-formed input, this is the number of
+        codepoints `decode` produces.
+    let count = (count as usize)
+    let blocks = (count // BlockSize)
+    let total =
+        fold (total = 0:usize) for b in (range blocks)
+            let m = (continuation-mask (load-block data (b * BlockSize)))
+            total + BlockSize - ((llvm.ctpop.i16 m) as usize)
+    fold (total = total) for i in (range (blocks * BlockSize) count)
+        ? (((data @ i) as i8) < -64:i8) total (total + 1:usize)
+
+fn decode (data count dest)
+    """"Decodes the `count` bytes of UTF-8 at `data` to codepoints of type i32
+        stored at `dest`, which must have room for `count` codepoints, and
+        returns the number of codepoints written. As with `decoder`, bytes
+        which are not part of a well-formed sequence are stored as negative
+        numbers.
+    let count = (count as usize)
+    loop (i j = 0:usize 0:usize)
+        # widen runs of ASCII characters 16 bytes at a time
+        let i j =
+            loop (i j = i j)
+                if ((i + BlockSize) > count)
+                    break i j
+                let block = (load-block data i)
+                if ((non-ascii-mask block) != 0:u16)
+                    break i j
+                let wide = (zext block (vector i32 16))
+                va-map
+                    inline (k)
+                        dest @ (j + (k as usize)) = (extractelement wide k)
+                    va-range 16
+                repeat (i + BlockSize) (j + BlockSize)
+        if (i >= count)
+            break j
+        inline byte (k) ((data @ (i + k)) as u8 as i32)
+        inline bits (k) ((byte k) & 0x3f)
+        let n = (sequence-length data i count)
+        dest @ j =
+            switch n
+            case 1:usize
+                byte 0:usize
+            case 2:usize
+                | (((byte 0:usize) & 0x1f) << 6) (bits 1:usize)
+            case 3:usize
+                |
+                    ((byte 0:usize) & 0xf) << 12
+                    (bits 1:usize) << 6
+                    bits 2:usize
+            case 4:usize
+                |
+                    ((byte 0:usize) & 0x7) << 18
+                    (bits 1:usize) << 12
+                    (bits 2:usize) << 6
+                    bits 3:usize
+            default
+                - (byte 0:usize)
+        _ (i + (max n 1:usize)) (j + 1:usize)
+
+fn encode (src count dest)
+    """"Encodes `count` codepoints of type i32 at `src` as UTF-8 into `dest`,
+        which must have room for four bytes per codepoint, and returns the
+        number of bytes written. Negative numbers, as produced by `decode`
+        for invalid bytes, are written back as the original byte.
+    let count = (count as usize)
+    loop (i j = 0:usize 0:usize)
+        # narrow runs of ASCII characters 16 codepoints at a time
+        let i j =
+            loop (i j = i j)
+                if ((i + BlockSize) > count)
+                    break i j
+                let block =
+                    vectorof i32
+                        va-map
+                            inline (k) (src @ (i + (k as usize)))
+                            va-range 16
+                let high = (block & (vector.smear -128 16))
+                if ((bitcast (high != (vector.smear 0 16)) u16) != 0:u16)
+                    break i j
+                let narrow = (itrunc block (vector i8 16))
+                va-map
+                    inline (k)
+                        dest @ (j + (k as usize)) = ((extractelement narrow k) as char)
+                    va-range 16
+                repeat (i + BlockSize) (j + BlockSize)
+        if (i >= count)
+            break j
+        let cp = (deref (src @ i))
+        inline put (k value)
+            dest @ (j + k) = (value as char)
+        let n =
+            if (cp < 0)
+                put 0:usize (- cp)
+                1:usize
+            elseif (cp < 0x80)
+                put 0:usize cp
+                1:usize
+            elseif (cp < 0x800)
+                put 0:usize (0xc0 | (cp >> 6))
+                put 1:usize (0x80 | (cp & 0x3f))
+                2:usize
+            elseif (cp < 0x10000)
+                put 0:usize (0xe0 | (cp >> 12))
+                put 1:usize (0x80 | ((cp >> 6) & 0x3f))
+                put 2:usize (0x80 | (cp & 0x3f))
+                3:usize
+            else
+                put 0:usize (0xf0 | ((cp >> 18) & 0x7))
+                put 1:usize (0x80 | ((cp >> 12) & 0x3f))
+                put 2:usize (0x80 | ((cp >> 6) & 0x3f))
+                put 3:usize (0x80 | (cp & 0x3f))
+                4:usize
+        _ (i + 1:usize) (j + n)
+
+unlet load-block non-ascii-mask continuation-mask skip-ascii
+
 spice char32 (value)
     using import itertools
     let value =
@@ -165,4 +379,5 @@ inline prefix:c (value)
 
 do
     let encoder decoder char32 prefix:c
+        \ validate valid? count-codepoints decode encode
     locals;
@@ -0,0 +1,109 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""benchmark
+    =========
+
+    The benchmark module provides the plumbing for micro-benchmarks: a
+    monotonic nanosecond clock, a probe for the number of bytes currently
+    allocated from the C heap, a sink that keeps results from being optimized
+    away and a uniform report format listing nanoseconds per operation and
+    heap bytes per element.
+
+    See the following example:
+
+        :::scopes
+        using import benchmark
+        using import Array
+
+        local values : (Array i64)
+        bench "Array append" 1000:usize
+            inline ()
+                for i in (range 1000)
+                    'append values (i as i64)
+
+vvv bind lib
+include
+    """"#include <stdio.h>
+        #include <time.h>
+        #if defined(__GLIBC__)
+        #include <malloc.h>
+        #endif
+
+        unsigned long long scopes_benchmark_clock_ns () {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return (unsigned long long)ts.tv_sec * 1000000000ull
+                + (unsigned long long)ts.tv_nsec;
+        }
+
+        unsigned long long scopes_benchmark_heap_bytes () {
+        #if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+            return (unsigned long long)mallinfo2().uordblks;
+        #else
+            return 0;
+        #endif
+        }
+
+let printf = lib.extern.printf
+
+global sink : u64
+
+fn clock-ns ()
+    """"Returns the current value of the monotonic clock in nanoseconds.
+    lib.extern.scopes_benchmark_clock_ns;
+
+fn heap-bytes ()
+    """"Returns the number of bytes currently allocated from the C heap, or
+        zero if the C library does not expose allocator statistics.
+    lib.extern.scopes_benchmark_heap_bytes;
+
+inline consume (value)
+    """"Stores the integer `value` to a volatile location so that the
+        computation producing it can not be eliminated by the optimizer.
+    volatile-store (value as u64) (& sink)
+
+fn header (title)
+    """"Prints a section title followed by the column captions used by
+        `report`.
+    printf ("\n%s\n%-40s %10s %14s %14s\n" as rawstring) (title as rawstring)
+        "benchmark" as rawstring
+        "n" as rawstring
+        "ns/op" as rawstring
+        "bytes/elem" as rawstring
+    ;
+
+inline report (name count ns bytes)
+    """"Prints a result row for benchmark `name`, which performed `count`
+        operations in `ns` nanoseconds. If `bytes` is given, it is the amount
+        of heap memory retained by the `count` elements, and the bytes per
+        element column is filled in.
+    let count = (max (count as u64) 1:u64)
+    let per-op = ((ns as f64) / (count as f64))
+    static-if (none? bytes)
+        printf ("%-40s %10llu %14.2f %14s\n" as rawstring) (name as rawstring)
+            \ count per-op
+            "-" as rawstring
+    else
+        printf ("%-40s %10llu %14.2f %14.2f\n" as rawstring) (name as rawstring)
+            \ count per-op
+            (bytes as f64) / (count as f64)
+    ;
+
+inline bench (name count f)
+    """"Invokes `f` once and reports its run time divided over `count`
+        operations. The change in heap usage across the call is reported as
+        bytes per element, so containers that are populated by `f` list their
+        memory overhead while read-only passes list zero.
+    let h0 = (heap-bytes)
+    let t0 = (clock-ns)
+    f;
+    let t1 = (clock-ns)
+    let h1 = (heap-bytes)
+    report name count (t1 - t0) ((h1 as i64) - (h0 as i64))
+
+do
+    let clock-ns heap-bytes consume header report bench
+    locals;
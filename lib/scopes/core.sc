@@ -4767,6 +4767,9 @@ let parse-compile-flags =
                         \ " " (repr 'O1)
                         \ " " (repr 'O2)
                         \ " " (repr 'O3)
+                        \ " " (repr 'profile-generate)
+                        \ " " (repr 'profile-use)
+                        \ " " (repr 'profile-alloc)
             let argc = ('argcount args)
             loop (i flags = 0 0:u64)
                 if (i == argc)
@@ -4784,6 +4787,9 @@ let parse-compile-flags =
                     case 'O1 compile-flag-O1
                     case 'O2 compile-flag-O2
                     case 'O3 compile-flag-O3
+                    case 'profile-generate compile-flag-profile-generate
+                    case 'profile-use compile-flag-profile-use
+                    case 'profile-alloc compile-flag-profile-alloc
                     default (flag-error flag)
                 _ (i + 1) (flags | flag)
 
@@ -4797,9 +4803,29 @@ spice-quote
     inline compile-spirv (version target func flags...)
         sc_compile_spirv version target func (parse-compile-flags flags...)
 
+    # `targets` and `funcs` point to `count` entries each; the compiled
+      shaders are written in order to `results`.
+    inline compile-glsl-batch (version count targets funcs results flags...)
+        sc_compile_glsl_batch version count targets funcs
+            parse-compile-flags flags...
+            results
+
+    inline compile-spirv-batch (version count targets funcs results flags...)
+        sc_compile_spirv_batch version count targets funcs
+            parse-compile-flags flags...
+            results
+
     inline compile-object (target file-kind path table flags...)
         sc_compile_object target file-kind path table (parse-compile-flags flags...)
 
+    # `inputs` and `outputs` point to `count` paths each; every input must
+      have been compiled with compiler-file-kind-thin-bc. Only the symbols
+      named by the keys of the `exports` table remain visible to other
+      objects, usually the union of the tables passed to compile-object.
+    inline link-objects (count inputs outputs exports flags...)
+        sc_link_objects count inputs outputs exports
+            parse-compile-flags flags...
+
 inline convert-assert-args (args cond msg)
     if ((countof args) == 2) msg
     else
@@ -6212,6 +6238,33 @@ spice-quote
     inline static-compile-spirv (version target func flags...)
         _static-compile-spirv version target func (parse-compile-flags flags...)
 
+#-------------------------------------------------------------------------------
+# loop hints
+#-------------------------------------------------------------------------------
+
+spice loop-hint (key value)
+    """"Attaches an optimization hint to the innermost loop that encloses the
+        expression. The hints `'vectorize` and `'distribute` take a boolean;
+        `'vectorize-width`, `'interleave-count` and `'unroll-count` take a
+        positive integer constant.
+    let key = (key as Symbol)
+    let value =
+        if ((key == 'vectorize) or (key == 'distribute))
+            `[(value as bool)]
+        elseif ((key == 'vectorize-width) or (key == 'interleave-count)
+            or (key == 'unroll-count))
+            let n = (value as i32)
+            if (n <= 0)
+                hide-traceback;
+                error@ ('anchor value) "while attaching loop hint"
+                    "positive integer constant expected"
+            `n
+        else
+            hide-traceback;
+            error@ ('anchor args) "while attaching loop hint"
+                .. "unknown loop hint: " (repr key)
+    'tag `(annotate 'loop-hint key value) ('anchor args)
+
 #-------------------------------------------------------------------------------
 # function overloading
 #-------------------------------------------------------------------------------
@@ -6948,6 +7001,15 @@ let
     #eval = sc_eval
     load-library = sc_load_library
     load-object = sc_load_object
+    set-profile! = sc_set_profile
+    write-profile = sc_write_profile
+    profiler-start = sc_profiler_start
+    profiler-stop = sc_profiler_stop
+    profiler-write = sc_profiler_write
+    alloc-profile-print = sc_alloc_profile_print
+    alloc-profile-reset = sc_alloc_profile_reset
+    alloc-profile-totals = sc_alloc_profile_totals
+    set-alloc-profile-interval! = sc_alloc_profile_set_dump_interval
 
 spice static-library (path)
     path as:= string
@@ -8589,6 +8651,10 @@ fn print-help (exename)
             -v, --version           print runtime version and exit.
             -e, --env               run program from project environment.
             -s, --signal-abort      raise SIGABRT when calling `abort!`.
+            --target-cpu name       generate code for CPU `name` instead of the host.
+            --profile path          sample the program and write the profile to `path`
+                                    at exit, as pprof if it ends in .pb.gz and as
+                                    folded stacks otherwise.
             -c command              program passed in as string (terminates option list)
             -m module               run module on path (terminates option list)
             filename                program read from scopes file.
@@ -8650,6 +8716,20 @@ fn run-main ()
                     set-signal-abort! true
                 elseif ((== arg "--env") or (== arg "-e"))
                     project? = true
+                elseif (== arg "--target-cpu")
+                    # already applied at startup
+                    if (k == argc)
+                        print "Argument expected for the --target-cpu option"
+                            \ ". Try --help for help."
+                        exit 255
+                    repeat (k + 1)
+                elseif (== arg "--profile")
+                    # already applied at startup
+                    if (k == argc)
+                        print "Argument expected for the --profile option"
+                            \ ". Try --help for help."
+                        exit 255
+                    repeat (k + 1)
                 elseif (== arg "-c")
                     command? = true
                     if (k == argc)
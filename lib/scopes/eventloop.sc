@@ -0,0 +1,416 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""eventloop
+    =========
+
+    The eventloop module provides a single-threaded event loop for Linux,
+    built on epoll. File descriptors are watched for readiness with callbacks
+    of the form `(f fd events context)`, where `context` is a pointer passed
+    through unchanged; timers are backed by timer file descriptors and
+    dispatched the same way.
+
+    All watchers are edge-triggered: a callback is invoked once when a file
+    descriptor becomes ready, and must read or write until the operation
+    would block before it is notified again.
+
+        :::scopes
+        using import eventloop
+
+        fn on-tick (fd events loop)
+            'stop (@ loop)
+
+        local loop = (EventLoop)
+        'add-timeout loop 10 on-tick (& loop)
+        'run loop
+
+    Sockets are set up with `listen-tcp`, `accept-nonblocking` and
+    `connect-tcp`; `read-some` and `write-some` transfer as much as possible
+    without blocking. Datagrams are sent and received in batches with a
+    `MessageBatch`, which issues a single `recvmmsg` or `sendmmsg` call per
+    batch.
+
+using import struct
+using import Array
+using import String
+using import C.epoll
+using import C.socket
+
+static-assert (operating-system == 'linux)
+    "the eventloop module requires Linux"
+
+let CallbackFunction = (pointer (function void i32 u32 voidstar))
+
+struct Watcher plain
+    callback : CallbackFunction
+    context : voidstar
+    timer? : bool
+
+# number of events fetched with a single call to epoll_wait
+let MaxEvents = 256
+
+let
+    EventRead = (EPOLLIN as u32)
+    EventWrite = (EPOLLOUT as u32)
+    EventHangup = ((EPOLLHUP as u32) | (EPOLLRDHUP as u32))
+    EventError = (EPOLLERR as u32)
+    EdgeTriggered = (EPOLLET as u32)
+
+inline callback-args (f context)
+    """"Returns `f`, compiled for a `context` of the given type, and
+        `context` in the form stored by a watcher.
+    let context =
+        static-if (none? context) (nullof voidstar)
+        else context
+    _
+        bitcast (static-typify f i32 u32 (typeof context)) CallbackFunction
+        bitcast context voidstar
+
+inline ms->timespec (ms)
+    let ms = (ms as i64)
+    timespec
+        tv_sec = (ms // 1000:i64)
+        tv_nsec = ((ms % 1000:i64) * 1000000:i64)
+
+#-------------------------------------------------------------------------------
+# event loop
+#-------------------------------------------------------------------------------
+
+struct EventLoop
+    _epfd : i32
+    # watchers are indexed by file descriptor
+    _watchers : (Array Watcher)
+    _running : bool
+
+    inline __typecall (cls)
+        let epfd = (epoll_create1 (EPOLL_CLOEXEC as i32))
+        assert (epfd >= 0) "epoll_create1 failed"
+        Struct.__typecall cls
+            _epfd = epfd
+            _watchers = ((Array Watcher))
+            _running = false
+
+    fn register (self op fd events)
+        local event =
+            epoll_event
+                events = ((events as u32) | EdgeTriggered)
+                data = (epoll_data (fd = fd))
+        epoll_ctl self._epfd op fd (& event)
+
+    fn watch (self fd events callback context timer?)
+        if ((countof self._watchers) <= (fd as usize))
+            'resize self._watchers ((fd + 1) as usize)
+        self._watchers @ fd = (Watcher callback context timer?)
+        register self (EPOLL_CTL_ADD as i32) fd events
+
+    inline add (self fd events f context)
+        """"Calls `(f fd ready-events context)` whenever `fd` becomes ready for
+            any of `events`, a combination of `EventRead` and `EventWrite`.
+            Hangups and errors are always reported. Returns zero on success.
+        let callback context = (callback-args f context)
+        watch self fd events callback context false
+
+    fn modify (self fd events)
+        """"Changes the events that the watcher of `fd` waits for.
+        register self (EPOLL_CTL_MOD as i32) fd events
+
+    fn remove (self fd)
+        """"Stops watching `fd`. Events that are already pending for `fd` are
+            discarded, so that it is safe to close `fd` from its callback.
+        if ((fd as usize) < (countof self._watchers))
+            self._watchers @ fd = (Watcher)
+        epoll_ctl self._epfd (EPOLL_CTL_DEL as i32) fd null
+
+    fn start-timer (self delay interval callback context)
+        let fd =
+            timerfd_create CLOCK_MONOTONIC
+                (TFD_NONBLOCK as i32) | (TFD_CLOEXEC as i32)
+        local spec =
+            itimerspec
+                it_interval = (ms->timespec interval)
+                it_value = (ms->timespec delay)
+        # an expiration time of zero would disarm the timer
+        if (delay <= 0)
+            spec.it_value.tv_nsec = 1
+        timerfd_settime fd 0 (& spec) null
+        watch self fd EventRead callback context true
+        fd
+
+    inline add-timer (self interval f context)
+        """"Calls `(f fd events context)` every `interval` milliseconds and
+            returns the timer's file descriptor.
+        let callback context = (callback-args f context)
+        start-timer self interval interval callback context
+
+    inline add-timeout (self delay f context)
+        """"Calls `(f fd events context)` once after `delay` milliseconds and
+            returns the timer's file descriptor.
+        let callback context = (callback-args f context)
+        start-timer self delay 0 callback context
+
+    fn cancel-timer (self fd)
+        """"Stops and closes the timer `fd`.
+        remove self fd
+        close fd
+        ;
+
+    fn run-once (self timeout)
+        """"Waits up to `timeout` milliseconds, or indefinitely if `timeout` is
+            negative, for events and dispatches them. Returns the number of
+            events received.
+        local events : (array epoll_event MaxEvents)
+        let n = (epoll_wait self._epfd (& (events @ 0)) MaxEvents (timeout as i32))
+        for i in (range n)
+            let event = (events @ i)
+            let fd = event.data.fd
+            # the callback may add watchers, which moves the array
+            let watcher = (copy (self._watchers @ fd))
+            if watcher.timer?
+                # acknowledge the expirations so that the timer fires again
+                local expirations : u64
+                read fd (bitcast (& expirations) voidstar) (sizeof u64)
+            if (watcher.callback != null)
+                watcher.callback fd event.events watcher.context
+        max n 0
+
+    fn run (self)
+        """"Dispatches events until `stop` is called.
+        self._running = true
+        while self._running
+            run-once self -1
+        ;
+
+    fn stop (self)
+        """"Makes `run` return after the events of the current iteration have
+            been dispatched.
+        self._running = false
+        ;
+
+    inline __drop (self)
+        close self._epfd
+        __drop self._watchers
+
+#-------------------------------------------------------------------------------
+# sockets
+#-------------------------------------------------------------------------------
+
+let LoopbackAddress = 0x7f000001:u32
+
+fn would-block? ()
+    """"Returns true if the last failed operation would have blocked.
+    let e = (errno)
+    (e == EAGAIN) or (e == EWOULDBLOCK)
+
+fn set-nonblocking (fd)
+    """"Puts `fd` into non-blocking mode.
+    let flags = (fcntl fd F_GETFL 0)
+    fcntl fd F_SETFL (flags | O_NONBLOCK)
+
+fn set-option (fd level name)
+    local one = 1
+    setsockopt fd level name (bitcast (& one) voidstar) ((sizeof i32) as u32)
+
+fn loopback-address (port)
+    sockaddr_in
+        sin_family = AF_INET
+        sin_port = (htons (port as u16))
+        sin_addr =
+            typeinit
+                s_addr = (htonl LoopbackAddress)
+
+fn listen-tcp (port backlog)
+    """"Returns a non-blocking TCP socket listening on `port` of the loopback
+        interface, or -1 on failure. A `port` of zero picks a free port, which
+        can be queried with `local-port`.
+    let fd =
+        socket AF_INET
+            (SOCK_STREAM as i32) | (SOCK_NONBLOCK as i32) | (SOCK_CLOEXEC as i32)
+            0
+    if (fd < 0)
+        return -1
+    set-option fd SOL_SOCKET SO_REUSEADDR
+    local address = (loopback-address port)
+    if ((bind fd (bitcast (& address) (pointer sockaddr)) ((sizeof address) as u32)) < 0)
+        close fd
+        return -1
+    if ((listen fd backlog) < 0)
+        close fd
+        return -1
+    fd
+
+fn local-port (fd)
+    """"Returns the port a socket is bound to.
+    local address : sockaddr_in
+    local size = ((sizeof address) as u32)
+    getsockname fd (bitcast (& address) (mutable pointer sockaddr)) (& size)
+    # htons converts in both directions
+    htons address.sin_port
+
+fn connect-tcp (port)
+    """"Connects to `port` of the loopback interface and returns the connected
+        socket in non-blocking mode, or -1 on failure. Nagle's algorithm is
+        disabled on the socket.
+    let fd = (socket AF_INET ((SOCK_STREAM as i32) | (SOCK_CLOEXEC as i32)) 0)
+    if (fd < 0)
+        return -1
+    local address = (loopback-address port)
+    if ((connect fd (bitcast (& address) (pointer sockaddr)) ((sizeof address) as u32)) < 0)
+        close fd
+        return -1
+    set-option fd (IPPROTO_TCP as i32) TCP_NODELAY
+    set-nonblocking fd
+    fd
+
+fn accept-nonblocking (fd)
+    """"Accepts a pending connection on the listening socket `fd` and returns
+        it in non-blocking mode, with Nagle's algorithm disabled. Returns -1
+        if no connection is pending.
+    let conn =
+        accept4 fd null null ((SOCK_NONBLOCK as i32) | (SOCK_CLOEXEC as i32))
+    if (conn >= 0)
+        set-option conn (IPPROTO_TCP as i32) TCP_NODELAY
+    conn
+
+fn read-some (fd buf size)
+    """"Reads up to `size` bytes from `fd` into `buf`, retrying reads that
+        were interrupted. Returns the number of bytes read, zero at the end of
+        the stream, or -1 on failure; `would-block?` tells whether the
+        failure was because no data was available.
+    loop ()
+        let n = (read fd (bitcast buf voidstar) (size as usize))
+        if ((n < 0) and ((errno) == EINTR))
+            repeat;
+        break n
+
+fn write-some (fd buf size)
+    """"Writes up to `size` bytes from `buf` to `fd`, retrying writes that
+        were interrupted. Returns the number of bytes written or -1 on
+        failure.
+    loop ()
+        let n = (write fd (bitcast buf voidstar) (size as usize))
+        if ((n < 0) and ((errno) == EINTR))
+            repeat;
+        break n
+
+fn bind-udp (port)
+    """"Returns a non-blocking UDP socket bound to `port` of the loopback
+        interface, or -1 on failure.
+    let fd =
+        socket AF_INET
+            (SOCK_DGRAM as i32) | (SOCK_NONBLOCK as i32) | (SOCK_CLOEXEC as i32)
+            0
+    if (fd < 0)
+        return -1
+    local address = (loopback-address port)
+    if ((bind fd (bitcast (& address) (pointer sockaddr)) ((sizeof address) as u32)) < 0)
+        close fd
+        return -1
+    fd
+
+#-------------------------------------------------------------------------------
+# batched datagrams
+#-------------------------------------------------------------------------------
+
+""""A fixed number of datagram buffers of `size` bytes each, together with
+    the message headers and peer addresses required to receive or send all
+    of them with a single system call. Only IPv4 peers are supported.
+struct MessageBatch
+    _headers : (mutable pointer mmsghdr)
+    _vectors : (mutable pointer iovec)
+    _addresses : (mutable pointer sockaddr_in)
+    _buffers : (mutable pointer char)
+    _capacity : i32
+    _size : usize
+
+    inline __typecall (cls capacity size)
+        let capacity = (capacity as i32)
+        let size = (size as usize)
+        let self =
+            Struct.__typecall cls
+                _headers = (malloc-array mmsghdr capacity)
+                _vectors = (malloc-array iovec capacity)
+                _addresses = (malloc-array sockaddr_in capacity)
+                _buffers = (malloc-array char ((capacity as usize) * size))
+                _capacity = capacity
+                _size = size
+        for i in (range capacity)
+            let vector = (self._vectors @ i)
+            vector.iov_base =
+                bitcast (getelementptr self._buffers ((i as usize) * size)) voidstar
+            vector.iov_len = size
+            let header = (self._headers @ i)
+            header = (mmsghdr)
+            header.msg_hdr.msg_name = (bitcast (getelementptr self._addresses i) voidstar)
+            header.msg_hdr.msg_namelen = ((sizeof sockaddr_in) as u32)
+            header.msg_hdr.msg_iov = (getelementptr self._vectors i)
+            header.msg_hdr.msg_iovlen = 1:usize
+        self
+
+    inline capacity (self)
+        """"Returns the number of messages in the batch.
+        deref self._capacity
+
+    fn buffer (self i)
+        """"Returns a pointer to the buffer of message `i`.
+        getelementptr self._buffers ((i as usize) * self._size)
+
+    fn message (self i)
+        """"Returns the contents of message `i` as a `StringView`.
+        let vector = (self._vectors @ i)
+        StringView (bitcast (buffer self i) rawstring) (deref vector.iov_len)
+
+    fn set-peer (self i port)
+        """"Sets the destination of message `i` to `port` of the loopback
+            interface.
+        self._addresses @ i = (loopback-address port)
+        ;
+
+    fn set-length (self i count)
+        """"Sets the number of bytes of message `i` that are sent.
+        let vector = (self._vectors @ i)
+        vector.iov_len = (min (count as usize) self._size)
+        ;
+
+    fn receive (self fd)
+        """"Receives up to `capacity` datagrams from `fd` with one call to
+            `recvmmsg` and returns their number, or -1 on failure. The
+            length of every received message is updated, and its sender is
+            stored as the destination for a subsequent `send`.
+        for i in (range self._capacity)
+            let vector = (self._vectors @ i)
+            vector.iov_len = self._size
+            let header = (self._headers @ i)
+            header.msg_hdr.msg_namelen = ((sizeof sockaddr_in) as u32)
+            header.msg_len = 0:u32
+        let n =
+            recvmmsg fd self._headers (self._capacity as u32)
+                MSG_DONTWAIT as i32
+                null
+        for i in (range n)
+            let vector = (self._vectors @ i)
+            let header = (self._headers @ i)
+            vector.iov_len = (header.msg_len as usize)
+        n
+
+    fn send (self fd count)
+        """"Sends the first `count` messages to their peers with one call to
+            `sendmmsg` and returns the number of messages sent, or -1 on
+            failure.
+        sendmmsg fd self._headers ((min count self._capacity) as u32)
+            MSG_DONTWAIT as i32
+
+    inline __drop (self)
+        free self._headers
+        free self._vectors
+        free self._addresses
+        free self._buffers
+
+#-------------------------------------------------------------------------------
+
+do
+    let EventLoop EventRead EventWrite EventHangup EventError MessageBatch
+        \ would-block? set-nonblocking listen-tcp local-port connect-tcp
+        \ accept-nonblocking read-some write-some bind-udp
+    locals;
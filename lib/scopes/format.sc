@@ -32,7 +32,36 @@ using import String
                 name = "Joana"
                 age = 42
 
-spice format (str args...)
+    The format string is parsed at compile time, and every call site is
+    compiled to a writer that formats strings, integers and reals directly
+    into a single buffer. `format` returns the result as a `String`; earlier
+    versions returned the formatted pieces as separate `string` values, so
+    code that relied on a `string` result has to convert it. If every
+    substituted value is a constant string, the call still folds to a
+    constant `string` at compile time. `format-buffer` and `format-fd` write
+    the result to a caller-provided buffer or a file descriptor instead:
+
+        :::scopes
+        local buf : (array char 64)
+        let n = (format-buffer (& (buf @ 0)) 64 "{} + {} = {}" 1 2 3)
+        format-fd 1 "{}/{}\n" 3 4.5
+
+# declare void @llvm.memcpy.p0i8.p0i8.i64(i8* <dest>, i8* <src>,
+                                        i64 <len>, i1 <isvolatile>)
+let llvm.memcpy.p0i8.p0i8.i64 =
+    extern 'llvm.memcpy.p0i8.p0i8.i64
+        function void (mutable rawstring) rawstring i64 bool
+
+let write =
+    extern
+        static-if (operating-system == 'windows) '_write
+        else 'write
+        function i64 i32 voidstar usize
+
+fn parse-format (str args...)
+    """"Parses the format string `str` and returns the sequence of pieces to
+        be written as an argument list, where literal pieces are string
+        constants and substitutions are the matching arguments of `args...`.
     using import UTF-8
 
     anchor := ('anchor str)
@@ -97,10 +126,7 @@ spice format (str args...)
                     else
                         parse-error (start + k + 1)
                             "invalid character in index expression"
-            T := ('typeof body)
-            'append block
-                if ((T == String) | (T == string)) body
-                else `(tostring body)
+            'append block body
             _ (i + 1) nextarg
         else
             # read string chunk up to the next variable and append to result,
@@ -125,6 +151,214 @@ spice format (str args...)
             _ i nextarg
     sc_argument_list_new ((countof block) as i32) (& (block @ 0))
 
+#-------------------------------------------------------------------------------
+# writers
+#-------------------------------------------------------------------------------
+
+# reals are written in the format used by `tostring`, with 6 decimals for f32
+  and 11 decimals for f64 and trailing zeros removed; reals whose integral
+  part does not fit into 64 bits are passed on to `tostring`.
+let RealLimit = 9.2e18:f64
+# upper bound for reals written through `tostring`, which prints all digits
+  of the integral part
+let MaxRealLength = 330:usize
+
+# ASCII codes of the characters written by the number writers
+let ZeroChar = 48:char
+let MinusChar = 45:char
+let DotChar = 46:char
+
+inline string-piece? (T)
+    (T == string) or (T == StringView)
+        or ((T < StringBase) and (T.ElementType == char))
+
+inline direct-piece? (T)
+    (string-piece? T) or (T == bool) or (T < integer) or (T < real)
+
+inline prepare-piece (value)
+    """"Converts values without a direct writer to strings.
+    static-if (direct-piece? (typeof value)) value
+    else (tostring value)
+
+inline piece-length (value)
+    """"Returns an upper bound for the number of characters written for
+        `value`.
+    let T = (typeof value)
+    static-if (string-piece? T) ((countof value) as usize)
+    elseif (T == bool) 5:usize
+    # sign and digits of the largest 64-bit integers
+    elseif (T < integer) 21:usize
+    # sign, 19 integral digits, dot and 11 decimals
+    elseif (T < real)
+        ? ((abs (value as f64)) < RealLimit) 32:usize MaxRealLength
+
+fn write-bytes (dest src count)
+    llvm.memcpy.p0i8.p0i8.i64 dest src (count as i64) false
+    count
+
+fn write-digits (dest value)
+    """"Writes the decimal digits of `value` to `dest` and returns their count.
+    let n =
+        loop (n rest = 1:usize (value // 10:u64))
+            if (rest == 0:u64)
+                break n
+            _ (n + 1:usize) (rest // 10:u64)
+    loop (i rest = n value)
+        if (i == 0:usize)
+            break;
+        let i = (i - 1:usize)
+        dest @ i = (((rest % 10:u64) as char) + ZeroChar)
+        _ i (rest // 10:u64)
+    n
+
+inline write-integer (dest value)
+    let T = (typeof value)
+    if (value < (0 as T))
+        dest @ 0 = MinusChar
+        + 1:usize
+            write-digits (getelementptr dest 1) (0:u64 - ((value as i64) as u64))
+    else
+        write-digits dest (value as u64)
+
+fn write-real (dest value)
+    let T = (typeof value)
+    let decimals scale =
+        static-if (T == f32) (_ 6:usize 1000000:u64)
+        else (_ 11:usize 100000000000:u64)
+    let x = (value as f64)
+    let ax = (abs x)
+    if (not (ax < RealLimit))
+        # also catches nan
+        let s = (tostring value)
+        return (write-bytes dest (s as rawstring) (countof s))
+    let sign = (? (x < 0.0:f64) 1:usize 0:usize)
+    if (sign != 0:usize)
+        dest @ 0 = MinusChar
+    let ip = (ax as u64)
+    let frac = (((ax - (ip as f64)) * (scale as f64) + 0.5:f64) as u64)
+    # rounding may carry into the integral part
+    let ip frac =
+        if (frac >= scale) (_ (ip + 1:u64) (frac - scale))
+        else (_ ip frac)
+    let n = (sign + (write-digits (getelementptr dest sign) ip))
+    dest @ n = DotChar
+    # write decimals with leading zeros, then drop trailing zeros but one
+    let start = (n + 1:usize)
+    loop (i rest = decimals frac)
+        if (i == 0:usize)
+            break;
+        let i = (i - 1:usize)
+        dest @ (start + i) = (((rest % 10:u64) as char) + ZeroChar)
+        _ i (rest // 10:u64)
+    loop (k = decimals)
+        if ((k == 1:usize) or ((dest @ (start + k - 1:usize)) != ZeroChar))
+            break (start + k)
+        k - 1:usize
+
+inline write-piece (dest value)
+    """"Writes `value` to `dest` and returns the number of characters written.
+    let T = (typeof value)
+    static-if (T == string)
+        write-bytes dest (value as rawstring) (countof value)
+    elseif (T == StringView)
+        write-bytes dest value._items value._count
+    elseif (string-piece? T)
+        write-bytes dest (value as rawstring) (countof value)
+    elseif (T == bool)
+        if value (write-bytes dest ("true" as rawstring) 4:usize)
+        else (write-bytes dest ("false" as rawstring) 5:usize)
+    elseif (T < integer) (write-integer dest value)
+    elseif (T < real) (write-real dest value)
+
+inline pieces-length (pieces...)
+    # the lengths of literal pieces are constant and fold into one sum
+    + 0:usize
+        va-map piece-length pieces...
+
+inline write-pieces (dest pieces...)
+    """"Writes all pieces to `dest` and returns the number of characters
+        written.
+    va-lfold 0:usize
+        inline (key piece offset)
+            offset + (write-piece (getelementptr dest offset) piece)
+        pieces...
+
+inline format-string (pieces...)
+    let pieces... = (va-map prepare-piece pieces...)
+    let capacity = (pieces-length pieces...)
+    # the string is allocated zeroed, so it stays terminated
+    local result = (String capacity)
+    result._count = (write-pieces (deref result._items) pieces...)
+    result
+
+inline format-buffer-pieces (buf size pieces...)
+    let buf = (bitcast buf (mutable rawstring))
+    let size = (size as usize)
+    let pieces... = (va-map prepare-piece pieces...)
+    let capacity = (pieces-length pieces...)
+    let count =
+        if (capacity < size)
+            write-pieces buf pieces...
+        else
+            # the result may not fit, format into temporary memory first
+            let tmp = (malloc-array char capacity)
+            let count = (write-pieces tmp pieces...)
+            if (size > 0:usize)
+                write-bytes buf tmp (min count (size - 1:usize))
+            free tmp
+            count
+    if (size > 0:usize)
+        buf @ (min count (size - 1:usize)) = 0:char
+    count
+
+inline format-fd-pieces (fd pieces...)
+    let pieces... = (va-map prepare-piece pieces...)
+    let capacity = (pieces-length pieces...)
+    let buf = (malloc-array char capacity)
+    let count = (write-pieces buf pieces...)
+    let written =
+        loop (offset = 0:usize)
+            if (offset >= count)
+                break offset
+            let n = (write (fd as i32) (bitcast (getelementptr buf offset) voidstar) (count - offset))
+            if (n <= 0:i64)
+                break offset
+            offset + (n as usize)
+    free buf
+    written
+
+spice format (str args...)
+    let pieces = (parse-format str args...)
+    let count = ('argcount pieces)
+    # pieces that are all constant strings are joined at compile time
+    let constant? =
+        loop (i = 0)
+            if (i == count)
+                break true
+            let piece = ('getarg pieces i)
+            if (not (('constant? piece) and (('typeof piece) == string)))
+                break false
+            i + 1
+    if constant?
+        loop (i result = 0 "")
+            if (i == count)
+                break `result
+            _ (i + 1) (.. result (('getarg pieces i) as string))
+    else
+        `(format-string pieces)
+
+spice format-buffer (buf size str args...)
+    """"Formats into the `size` bytes at `buf`, truncating and terminating the
+        result like `snprintf`, and returns the full length of the result.
+    let pieces = (parse-format str args...)
+    `(format-buffer-pieces buf size pieces)
+
+spice format-fd (fd str args...)
+    """"Writes the formatted result to the file descriptor `fd` and returns the
+        number of bytes written.
+    let pieces = (parse-format str args...)
+    `(format-fd-pieces fd pieces)
+
 do
-    let format
+    let format format-buffer format-fd
     locals;
@@ -0,0 +1,523 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""io
+    ==
+
+    Buffered file I/O on top of file descriptors. A `BufferedReader` and a
+    `BufferedWriter` own a buffer of a size chosen by the caller and keep the
+    number of system calls low; a `FileView` maps a whole file into memory
+    for reading, so that its contents can be inspected as `StringView` slices
+    without being copied.
+
+    `lines` and `records` iterate the lines or delimited records of a file
+    view, a string or a reader as views into the underlying memory; no memory
+    is allocated per line, and the views remain valid until the next line is
+    fetched from a reader, or as long as the file view exists:
+
+        :::scopes
+        using import io
+        using import itertools
+
+        let view = (FileView "data.txt")
+        for line in (lines view)
+            print (line as string)
+
+        # the generators plug into itertools
+        let empty-lines =
+            ->> (lines view)
+                filter (inline (line) ((countof line) == 0))
+                reduce 0 (inline (n line) (n + 1))
+
+        let fd = (open-write "copy.txt")
+        local writer = (BufferedWriter fd)
+        for line in (lines view)
+            'write writer line
+            'write writer "\n"
+
+    `copy-file-range` and `send-file` move data between file descriptors
+    inside the kernel where the operating system supports it.
+
+using import struct
+using import String
+
+vvv bind lib
+include
+    """"#define _GNU_SOURCE
+        #include <stdlib.h>
+        #include <string.h>
+        #include <fcntl.h>
+        #include <unistd.h>
+        #include <errno.h>
+        #include <sys/types.h>
+        #include <sys/mman.h>
+        #include <sys/stat.h>
+        #if defined(__linux__)
+        #include <sys/sendfile.h>
+        #endif
+
+        int scopes_io_errno () { return errno; }
+
+        long long scopes_io_file_size (int fd) {
+            struct stat st;
+            if (fstat(fd, &st) != 0)
+                return -1;
+            return (long long)st.st_size;
+        }
+
+        long long scopes_io_copy_file_range (int in, int out, size_t count) {
+        #if defined(__linux__)
+            return (long long)copy_file_range(in, NULL, out, NULL, count, 0);
+        #else
+            errno = ENOSYS;
+            return -1;
+        #endif
+        }
+
+        long long scopes_io_sendfile (int out, int in, size_t count) {
+        #if defined(__linux__)
+            return (long long)sendfile(out, in, NULL, count);
+        #else
+            errno = ENOSYS;
+            return -1;
+        #endif
+        }
+
+using lib.define filter "^(O_(RDONLY|WRONLY|CREAT|TRUNC|CLOEXEC)|PROT_READ|MAP_PRIVATE|MADV_SEQUENTIAL|E(INTR|NOSYS|XDEV|INVAL|OPNOTSUPP))$"
+let
+    open = lib.extern.open
+    close = lib.extern.close
+    read = lib.extern.read
+    write = lib.extern.write
+    mmap = lib.extern.mmap
+    munmap = lib.extern.munmap
+    madvise = lib.extern.madvise
+    memchr = lib.extern.memchr
+    memmove = lib.extern.memmove
+    realloc = lib.extern.realloc
+    errno = lib.extern.scopes_io_errno
+    file-size = lib.extern.scopes_io_file_size
+
+# the default buffer size of readers and writers
+let DefaultBufferSize = 65536:usize
+
+fn open-read (path)
+    """"Opens the file at `path` for reading and returns its file descriptor,
+        or -1 on failure.
+    open (path as rawstring) (O_RDONLY | O_CLOEXEC)
+
+fn open-write (path)
+    """"Creates or truncates the file at `path` for writing and returns its
+        file descriptor, or -1 on failure.
+    # permissions rw-r--r--
+    open (path as rawstring) (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC) 0x1a4
+
+fn close-file (fd)
+    """"Closes the file descriptor `fd`.
+    close fd
+    ;
+
+fn write-all (fd data count)
+    """"Writes `count` bytes at `data` to `fd`, retrying partial and
+        interrupted writes, and returns the number of bytes written.
+    loop (offset = 0:usize)
+        if (offset >= count)
+            break offset
+        let n =
+            write fd (bitcast (getelementptr data offset) voidstar) (count - offset)
+        if (n < 0)
+            if ((errno) == EINTR)
+                repeat offset
+            break offset
+        offset + (n as usize)
+
+fn read-retry (fd data count)
+    loop ()
+        let n = (read fd (bitcast data voidstar) count)
+        if ((n < 0) and ((errno) == EINTR))
+            repeat;
+        break n
+
+fn find-byte (data count value)
+    """"Returns the offset of the first byte equal to `value` in the `count`
+        bytes at `data`, or `count` if there is none.
+    let p = (memchr (bitcast data voidstar) (value as i32) count)
+    if (p == null) count
+    else
+        ((ptrtoint p usize) - (ptrtoint data usize))
+
+inline make-view (data count)
+    StringView (bitcast (deref data) rawstring) (count as usize)
+
+#-------------------------------------------------------------------------------
+# memory mapped files
+#-------------------------------------------------------------------------------
+
+fn map-file (path)
+    """"Maps the file at `path` into memory and returns its address, its
+        size and whether it could be mapped.
+    let fd = (open-read path)
+    if (fd < 0)
+        return (nullof rawstring) 0:usize false
+    let size = (file-size fd)
+    if (size <= 0)
+        close fd
+        return (nullof rawstring) 0:usize (size == 0)
+    let size = (size as usize)
+    let p = (mmap null size PROT_READ MAP_PRIVATE fd 0:i64)
+    # the mapping stays valid after the descriptor is closed
+    close fd
+    # mmap signals failure with a pointer of value -1
+    if ((ptrtoint p i64) == -1:i64)
+        return (nullof rawstring) 0:usize false
+    madvise p size MADV_SEQUENTIAL
+    _ (bitcast p rawstring) size true
+
+""""A read-only view of the complete contents of a file, which is mapped
+    into memory instead of being read. Views of an empty file, or of a file
+    that could not be opened, have no contents; `valid?` tells them apart.
+struct FileView
+    _items : rawstring
+    _count : usize
+    _valid? : bool
+
+    inline __typecall (cls path)
+        let items count valid? = (map-file path)
+        Struct.__typecall cls
+            _items = items
+            _count = count
+            _valid? = valid?
+
+    inline valid? (self)
+        """"Returns true if the file could be mapped.
+        deref self._valid?
+
+    inline __countof (self)
+        deref self._count
+
+    inline __@ (self index)
+        self._items @ index
+
+    fn view (self)
+        """"Returns the contents of the file as a `StringView`.
+        make-view self._items self._count
+
+    fn slice (self start end)
+        """"Returns the bytes from `start` up to `end` as a `StringView`.
+        let end = (min (end as usize) self._count)
+        let start = (min (start as usize) end)
+        make-view (getelementptr self._items start) (end - start)
+
+    inline __as (cls T)
+        static-if (T == StringView) view
+        elseif (T == Generator)
+            inline (self) ((view self) as Generator)
+
+    inline __drop (self)
+        if (self._count > 0:usize)
+            munmap (bitcast (deref self._items) voidstar) self._count
+        ;
+
+#-------------------------------------------------------------------------------
+# buffered readers and writers
+#-------------------------------------------------------------------------------
+
+""""Reads from a file descriptor through a buffer of `capacity` bytes. The
+    buffered bytes can be inspected with `buffered` and released with
+    `consume`, or copied out with `read`; `read-record` returns records as
+    views into the buffer, growing it for records longer than the buffer.
+
+    The reader does not own the file descriptor.
+struct BufferedReader
+    _fd : i32
+    _buffer : (mutable rawstring)
+    _capacity : usize
+    _start : usize
+    _end : usize
+    _eof? : bool
+
+    inline __typecall (cls fd capacity)
+        let capacity =
+            static-if (none? capacity) DefaultBufferSize
+            else (max (capacity as usize) 1:usize)
+        Struct.__typecall cls
+            _fd = fd
+            _buffer = (malloc-array char capacity)
+            _capacity = capacity
+            _start = 0:usize
+            _end = 0:usize
+            _eof? = false
+
+    inline eof? (self)
+        """"Returns true if the end of the file was reached and all buffered
+            bytes have been consumed.
+        self._eof? and (self._start == self._end)
+
+    fn buffered (self)
+        """"Returns the bytes currently held in the buffer as a `StringView`.
+        make-view (getelementptr self._buffer self._start)
+            self._end - self._start
+
+    fn consume (self count)
+        """"Releases the first `count` buffered bytes.
+        self._start = (min (self._start + (count as usize)) self._end)
+        ;
+
+    fn fill (self)
+        """"Moves the buffered bytes to the front of the buffer and reads as
+            many bytes as fit behind them. Returns the number of bytes read,
+            which is zero at the end of the file or if the buffer is full.
+        if (self._start > 0:usize)
+            let count = (self._end - self._start)
+            memmove (bitcast self._buffer voidstar)
+                bitcast (getelementptr self._buffer self._start) voidstar
+                count
+            self._start = 0:usize
+            self._end = count
+        if (self._end == self._capacity)
+            return 0:usize
+        let n =
+            read-retry self._fd (getelementptr self._buffer self._end)
+                self._capacity - self._end
+        if (n <= 0)
+            self._eof? = true
+            return 0:usize
+        self._end += (n as usize)
+        n as usize
+
+    fn read (self dest count)
+        """"Copies up to `count` bytes to `dest` and returns the number of
+            bytes copied, which is zero at the end of the file. Requests at
+            least as large as the buffer bypass it when it is empty.
+        let dest = (bitcast dest (mutable rawstring))
+        let count = (count as usize)
+        if ((self._start == self._end) and (count >= self._capacity))
+            let n = (read-retry self._fd dest count)
+            if (n <= 0)
+                self._eof? = true
+                return 0:usize
+            return (n as usize)
+        if (self._start == self._end)
+            fill self
+        let n = (min count (self._end - self._start))
+        memmove (bitcast dest voidstar)
+            bitcast (getelementptr self._buffer self._start) voidstar
+            n
+        self._start += n
+        n
+
+    fn read-record (self delimiter)
+        """"Returns true and a `StringView` of the next record, without its
+            `delimiter`, or false at the end of the file. The final record
+            does not need to be terminated. The view is valid until the
+            reader is used again.
+        loop (scanned = 0:usize)
+            let start = (deref self._start)
+            let available = (self._end - start)
+            let data = (getelementptr self._buffer start)
+            let offset =
+                scanned + (find-byte (getelementptr data scanned) (available - scanned) delimiter)
+            if (offset < available)
+                self._start = (start + offset + 1:usize)
+                return true (make-view data offset)
+            if self._eof?
+                self._start = self._end
+                return (available > 0:usize) (make-view data available)
+            if ((start == 0:usize) and (self._end == self._capacity))
+                # the record does not fit, grow the buffer
+                let capacity = (self._capacity * 2:usize)
+                self._buffer =
+                    bitcast (realloc (bitcast self._buffer voidstar) capacity)
+                        mutable rawstring
+                self._capacity = capacity
+            fill self
+            # the bytes already scanned moved to the front of the buffer
+            available
+
+    inline __drop (self)
+        free self._buffer
+
+""""Writes to a file descriptor through a buffer of `capacity` bytes, which
+    is flushed when it runs full, when `flush` is called and when the writer
+    is dropped. Writes at least as large as the buffer bypass it.
+
+    The writer does not own the file descriptor.
+struct BufferedWriter
+    _fd : i32
+    _buffer : (mutable rawstring)
+    _capacity : usize
+    _count : usize
+    _failed? : bool
+
+    inline __typecall (cls fd capacity)
+        let capacity =
+            static-if (none? capacity) DefaultBufferSize
+            else (max (capacity as usize) 1:usize)
+        Struct.__typecall cls
+            _fd = fd
+            _buffer = (malloc-array char capacity)
+            _capacity = capacity
+            _count = 0:usize
+            _failed? = false
+
+    inline failed? (self)
+        """"Returns true if a write to the file descriptor failed.
+        deref self._failed?
+
+    inline buffered (self)
+        """"Returns the number of bytes waiting to be written.
+        deref self._count
+
+    fn flush (self)
+        """"Writes all buffered bytes to the file descriptor and returns true
+            on success.
+        let count = (deref self._count)
+        self._count = 0:usize
+        if ((write-all self._fd self._buffer count) != count)
+            self._failed? = true
+        not self._failed?
+
+    fn write-bytes (self data count)
+        """"Writes the `count` bytes at `data`.
+        if (count > (self._capacity - self._count))
+            flush self
+            if (count >= self._capacity)
+                if ((write-all self._fd data count) != count)
+                    self._failed? = true
+                return;
+        memmove (bitcast (getelementptr self._buffer self._count) voidstar)
+            bitcast data voidstar
+            count
+        self._count += count
+        ;
+
+    inline write (self value count)
+        """"Writes `count` bytes at the pointer `value`, or all characters of
+            `value` if it is a string or a `StringView`.
+        static-if (none? count)
+            let view = (StringView value)
+            write-bytes self view._items view._count
+        else
+            write-bytes self (bitcast value rawstring) (count as usize)
+
+    inline __drop (self)
+        flush self
+        free self._buffer
+
+#-------------------------------------------------------------------------------
+# record iterators
+#-------------------------------------------------------------------------------
+
+inline view-records (view delimiter)
+    let data count = view._items view._count
+    inline find-end (start)
+        start + (find-byte (getelementptr data start) (count - start) delimiter)
+    Generator
+        inline () (_ 0:usize (find-end 0:usize))
+        inline (start end) (start < count)
+        inline (start end) (make-view (getelementptr data start) (end - start))
+        inline (start end)
+            let start = (end + 1:usize)
+            if (start < count)
+                _ start (find-end start)
+            else
+                _ start count
+
+inline reader-records (reader delimiter)
+    Generator
+        inline () ('read-record reader delimiter)
+        inline (ok? view) ok?
+        inline (ok? view) view
+        inline (ok? view) ('read-record reader delimiter)
+
+inline records (source delimiter)
+    """"Returns a generator of the records of `source` separated by the byte
+        `delimiter`, as `StringView`s without the delimiter. `source` is a
+        `FileView`, a `BufferedReader` or a string.
+    let delimiter = (delimiter as char)
+    let T = (typeof source)
+    static-if (T == BufferedReader)
+        reader-records source delimiter
+    elseif (T == FileView)
+        view-records ('view source) delimiter
+    else
+        view-records (StringView source) delimiter
+
+let NewlineChar = 10:char
+
+inline lines (source)
+    """"Returns a generator of the lines of `source`, as `StringView`s without
+        the line feed. `source` is a `FileView`, a `BufferedReader` or a
+        string.
+    records source NewlineChar
+
+#-------------------------------------------------------------------------------
+# copying between file descriptors
+#-------------------------------------------------------------------------------
+
+inline unsupported? (e)
+    (e == ENOSYS) or (e == EXDEV) or (e == EINVAL) or (e == EOPNOTSUPP)
+
+fn copy-buffered (dest src count copied)
+    let buffer = (malloc-array char DefaultBufferSize)
+    let copied =
+        loop (copied = copied)
+            if (copied >= count)
+                break copied
+            let n = (read-retry src buffer (min (count - copied) DefaultBufferSize))
+            if (n <= 0)
+                break copied
+            let n = (n as usize)
+            let written = (write-all dest buffer n)
+            if (written != n)
+                break (copied + written)
+            copied + n
+    free buffer
+    copied
+
+inline kernel-copy (f dest src count)
+    loop (copied = 0:usize)
+        if (copied >= count)
+            break copied
+        let n = (f dest src (count - copied))
+        if (n > 0)
+            repeat (copied + (n as usize))
+        if (n == 0)
+            break copied
+        let e = (errno)
+        if (e == EINTR)
+            repeat copied
+        if (unsupported? e)
+            break (copy-buffered dest src count copied)
+        break copied
+
+fn copy-file-range (dest src count)
+    """"Copies up to `count` bytes from the current position of the file
+        descriptor `src` to `dest` and returns the number of bytes copied.
+        The copy is done inside the kernel with `copy_file_range` where it
+        is available, and falls back to reading and writing otherwise.
+    kernel-copy
+        inline (dest src count)
+            lib.extern.scopes_io_copy_file_range src dest count
+        \ dest src (count as usize)
+
+fn send-file (dest src count)
+    """"Sends up to `count` bytes from the current position of the file
+        descriptor `src` to `dest`, which may be a socket, and returns the
+        number of bytes sent. The copy is done inside the kernel with
+        `sendfile` where it is available, and falls back to reading and
+        writing otherwise.
+    kernel-copy
+        inline (dest src count)
+            lib.extern.scopes_io_sendfile dest src count
+        \ dest src (count as usize)
+
+#-------------------------------------------------------------------------------
+
+do
+    let FileView BufferedReader BufferedWriter lines records open-read
+        \ open-write close-file write-all copy-file-range send-file
+        \ DefaultBufferSize
+    locals;
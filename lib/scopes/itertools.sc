@@ -673,11 +673,154 @@ inline retain1 (mapl child coll)
 inline retain (mapl ...)
     retain1 mapl (compose ...)
 
-unlet cascade1 retain1
+#---------------------------------------------------------------------------
+# chunked iteration
+#---------------------------------------------------------------------------
+
+# a chunked generator yields the elements of a source in batches, each batch
+  being a `(vector T N)` together with the number of valid lanes, which is N
+  for every batch but the last. batches are assembled from N consecutive
+  element loads that LLVM merges into a single vector load, and the batch
+  operations below work on whole vectors, so that numeric pipelines
+  vectorize independently of what the loop vectorizer makes of the
+  per-element pipeline.
+
+  containers take part by implementing `__chunks`, which returns the element
+  type, the number of elements and an inline mapping an index to the element
+  at that index.
+
+inline chunk-source (source end)
+    let T = (typeof source)
+    static-if (T < integer)
+        static-if (none? end)
+            _ T (source as usize) (inline (i) (i as T))
+        else
+            _ T ((end - source) as usize) (inline (i) (source + (i as T)))
+    else
+        '__chunks source
+
+inline chunked (N source end)
+    """"Returns a generator over `source` that yields batches of `N` elements
+        as a `(vector T N)`, together with the number of valid lanes in the
+        batch. Lanes past the end of the last batch repeat its first element,
+        so that functions applied to a whole batch only see valid values;
+        consumers mask them out by the lane count. `source` is
+        either an `Array`, a `String` or another container implementing
+        `__chunks`, or an integer range, which is `0 .. source` if `end` is
+        omitted, or `source .. end` otherwise.
+
+        The batches can be passed to `chunk-map`, `chunk-filter`,
+        `chunk-reduce` and `unchunk`:
+
+            :::scopes
+            let sum =
+                ->> (chunked 8 values)
+                    chunk-map (inline (v) (v * v))
+                    chunk-reduce (vector.smear 0 8) +
+    static-assert (constant? N) "chunk width must be constant"
+    let ET count at = (chunk-source source end)
+    let width = (N as usize)
+    let lanes... = (va-range N)
+    Generator
+        inline () 0:usize
+        inline (i) (i < count)
+        inline (i)
+            let n = (min (count - i) width)
+            let batch =
+                if (n == width)
+                    vectorof ET
+                        va-map
+                            inline (k) (at (i + (k as usize)))
+                            lanes...
+                else
+                    vectorof ET
+                        va-map
+                            inline (k)
+                                let k = (k as usize)
+                                # padding repeats the first lane, which
+                                  is always valid
+                                at (i + (? (k < n) k 0:usize))
+                            lanes...
+            _ batch n
+        inline (i) (i + width)
+
+inline lane-mask (batch n)
+    """"Returns a boolean vector which is true for the first `n` lanes of
+        `batch`.
+    let N = (countof (typeof batch))
+    (vectorof usize (va-range N)) < (vector.smear n N)
+
+inline chunk-map (f coll)
+    """"Applies `f` to every batch as a whole; `f` receives a vector and
+        returns a vector of the same width.
+    inline _chunk-map (coll)
+        let init valid? at collect = ((coll as Collector))
+        Collector init valid? at
+            inline "chunk-map-push" (src args...)
+                let batch n = (src)
+                let batch = (f batch)
+                collect (inline () (_ batch n)) args...
+    static-if (none? coll) _chunk-map
+    else (_chunk-map coll)
+
+inline collect-lanes (batch mask valid? collect it...)
+    """"Forwards the lanes of `batch` for which `mask` is true one by one.
+    let N = (countof (typeof batch))
+    va-lfold (inline () it...)
+        inline (key k it)
+            inline ()
+                let it... = (it)
+                if ((extractelement mask k) & (valid? it...))
+                    collect (inline () (extractelement batch k)) it...
+                else it...
+        va-range N
+
+inline unchunk (coll)
+    """"Forwards the valid lanes of every batch as individual elements, so that
+        chunked pipelines can end in any collector.
+    inline _unchunk (coll)
+        let init valid? at collect = ((coll as Collector))
+        Collector init valid? at
+            inline "unchunk-push" (src it...)
+                let batch n = (src)
+                call
+                    collect-lanes batch (lane-mask batch n) valid? collect it...
+    static-if (none? coll) _unchunk
+    else (_unchunk coll)
+
+inline chunk-filter (f coll)
+    """"Evaluates `f` on every batch, which returns a boolean vector, and
+        forwards the elements of the lanes for which it is true individually.
+    inline _chunk-filter (coll)
+        let init valid? at collect = ((coll as Collector))
+        Collector init valid? at
+            inline "chunk-filter-push" (src it...)
+                let batch n = (src)
+                let mask = ((f batch) & (lane-mask batch n))
+                call
+                    collect-lanes batch mask valid? collect it...
+    static-if (none? coll) _chunk-filter
+    else (_chunk-filter coll)
+
+inline chunk-reduce (init f)
+    """"Reduces batches lane-wise into the vector `init`, whose lanes must hold
+        the identity of `f`, then reduces the lanes of the result with `f`.
+        `f` must be associative and commutative, and accept both vectors and
+        scalars.
+    Collector
+        inline () init
+        inline (acc) true
+        inline (acc) (vector-reduce f acc)
+        inline (src acc)
+            let batch n = (src)
+            f acc (? (lane-mask batch n) batch init)
+
+unlet cascade1 retain1 chunk-source lane-mask collect-lanes
 
 do
     let span dim bitdim imap ipair join zip span join collect each compose cat
         \ ->> flatten map reduce drain limit gate filter take cascade mux
         \ demux retain permutate-range iterbits closest va-ordered-insert
+        \ chunked chunk-map chunk-filter chunk-reduce unchunk
 
     locals;
@@ -0,0 +1,737 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""parallel
+    ========
+
+    The parallel module distributes work over a pool of threads. A
+    `ThreadPool` runs one worker thread per processor; every worker has its
+    own queue of tasks, and workers that run out of tasks steal from the
+    queues of busy workers.
+
+    Work is passed as a function or as a capture (see the `Capture` module),
+    so that runtime values can be shared with the workers:
+
+        :::scopes
+        using import parallel
+        using import Capture
+        using import Array
+
+        local pool = (ThreadPool)
+        local squares : (Array i64)
+        'resize squares 1000
+        capture square (i) {&squares}
+            squares @ i = ((i * i) as i64)
+        parallel-for pool (countof squares) square
+        let total =
+            parallel-reduce pool squares 0:i64
+                inline (sum x) (sum + x)
+
+    A thread waiting for parallel work to complete runs queued tasks itself
+    instead of blocking, so that parallel operations can be nested.
+
+using import struct
+using import Array
+using import processor
+
+# threads, mutexes and condition variables are declared directly so that
+  importing this module does not require parsing C headers. mutexes and
+  condition variables live in opaque storage which is large enough for the
+  C libraries on all supported platforms.
+let MutexStorage = (array u64 8)
+let CondStorage = (array u64 8)
+
+let pthread_create =
+    extern 'pthread_create
+        function i32 (mutable pointer voidstar) voidstar
+            \ (pointer (function voidstar voidstar)) voidstar
+let pthread_join =
+    extern 'pthread_join
+        function i32 voidstar (mutable pointer voidstar)
+let pthread_self =
+    extern 'pthread_self
+        function voidstar
+let pthread_mutex_init =
+    extern 'pthread_mutex_init
+        function i32 (mutable pointer MutexStorage) voidstar
+let pthread_mutex_destroy =
+    extern 'pthread_mutex_destroy
+        function i32 (mutable pointer MutexStorage)
+let pthread_mutex_lock =
+    extern 'pthread_mutex_lock
+        function i32 (mutable pointer MutexStorage)
+let pthread_mutex_unlock =
+    extern 'pthread_mutex_unlock
+        function i32 (mutable pointer MutexStorage)
+let pthread_cond_init =
+    extern 'pthread_cond_init
+        function i32 (mutable pointer CondStorage) voidstar
+let pthread_cond_destroy =
+    extern 'pthread_cond_destroy
+        function i32 (mutable pointer CondStorage)
+let pthread_cond_wait =
+    extern 'pthread_cond_wait
+        function i32 (mutable pointer CondStorage) (mutable pointer MutexStorage)
+let pthread_cond_signal =
+    extern 'pthread_cond_signal
+        function i32 (mutable pointer CondStorage)
+let pthread_cond_broadcast =
+    extern 'pthread_cond_broadcast
+        function i32 (mutable pointer CondStorage)
+let sched_yield =
+    extern 'sched_yield
+        function i32
+# all state shared between threads is accessed through atomic instructions,
+  which Scopes lowers with sequentially consistent ordering.
+inline atomic-load (ptr)
+    atomicrmw bor ptr (nullof (elementof (typeof ptr)))
+
+inline atomic-store (ptr value)
+    atomicrmw xchg ptr value
+    ;
+
+#-------------------------------------------------------------------------------
+# tasks and work stealing deques
+#-------------------------------------------------------------------------------
+
+let TaskFunction = (pointer (function void voidstar))
+
+""""A unit of work: `function` is invoked with `context` on a worker thread.
+    Tasks are owned by whoever submitted them and must stay valid until they
+    have run.
+struct Task plain
+    function : TaskFunction
+    context : voidstar
+
+let TaskPointer = (mutable pointer Task)
+
+# number of slots in a deque; must be a power of two
+let DequeCapacity = 4096:i64
+let DequeMask = (DequeCapacity - 1:i64)
+
+# a Chase-Lev deque of task pointers. the owning worker pushes and pops at
+  the bottom, other threads steal from the top. the deque does not grow; a
+  task that does not fit is run right away by its submitter.
+struct WorkDeque plain
+    top : i64
+    bottom : i64
+    slots : (mutable pointer i64)
+
+    fn init (self)
+        self.top = 0:i64
+        self.bottom = 0:i64
+        self.slots = (malloc-array i64 DequeCapacity)
+        return;
+
+    fn release (self)
+        free self.slots
+        return;
+
+    fn push (self task)
+        """"Pushes `task` at the bottom of the deque and returns false if the
+            deque is full. Only the owner of the deque may push.
+        let b = (atomic-load (& self.bottom))
+        let t = (atomic-load (& self.top))
+        if ((b - t) >= DequeCapacity)
+            return false
+        atomic-store (& (self.slots @ (b & DequeMask))) (ptrtoint task i64)
+        atomic-store (& self.bottom) (b + 1:i64)
+        true
+
+    fn pop (self)
+        """"Removes the most recently pushed task from the bottom of the deque,
+            or returns null if the deque is empty. Only the owner of the deque
+            may pop.
+        let b = ((atomic-load (& self.bottom)) - 1:i64)
+        atomic-store (& self.bottom) b
+        let t = (atomic-load (& self.top))
+        if (t > b)
+            atomic-store (& self.bottom) (b + 1:i64)
+            return (nullof TaskPointer)
+        let task = (atomic-load (& (self.slots @ (b & DequeMask))))
+        if (t == b)
+            # the last task is also visible to thieves; race them for it
+            let old won? = (cmpxchg (& self.top) t (t + 1:i64))
+            atomic-store (& self.bottom) (b + 1:i64)
+            if (not won?)
+                return (nullof TaskPointer)
+        inttoptr task TaskPointer
+
+    fn steal (self)
+        """"Removes the oldest task from the top of the deque, or returns null
+            if the deque is empty or another thread took the task first.
+        let t = (atomic-load (& self.top))
+        let b = (atomic-load (& self.bottom))
+        if (t >= b)
+            return (nullof TaskPointer)
+        let task = (atomic-load (& (self.slots @ (t & DequeMask))))
+        let old won? = (cmpxchg (& self.top) t (t + 1:i64))
+        if won? (inttoptr task TaskPointer)
+        else (nullof TaskPointer)
+
+#-------------------------------------------------------------------------------
+# pool
+#-------------------------------------------------------------------------------
+
+struct PoolState plain
+    count : i32
+    threads : (mutable pointer voidstar)
+    # pthread_self of every worker, registered by the worker itself
+    owners : (mutable pointer i64)
+    deques : (mutable pointer WorkDeque)
+    # tasks submitted from threads outside of the pool; pushes are serialized
+      by injector-lock, workers steal from it.
+    injector : WorkDeque
+    injector-lock : i32
+    next-index : i32
+    # tasks queued and not yet taken by a thread
+    pending : i64
+    # tasks submitted and not yet finished
+    active : i64
+    sleepers : i32
+    shutdown : i32
+    mutex : MutexStorage
+    cond : CondStorage
+
+let PoolPointer = (mutable pointer PoolState)
+
+fn current-worker (pool)
+    """"Returns the index of the worker running on the calling thread, or -1 if
+        the calling thread does not belong to the pool.
+    let pool = (@ pool)
+    let self = (ptrtoint (pthread_self) i64)
+    for i in (range (deref pool.count))
+        if ((atomic-load (& (pool.owners @ i))) == self)
+            return i
+    -1
+
+fn take-task (pool index)
+    """"Finds a queued task, looking at the deque of worker `index` first, then
+        at the tasks submitted from outside the pool and finally at the
+        deques of the other workers.
+    let pool = (@ pool)
+    if (index >= 0)
+        let task = ('pop (pool.deques @ index))
+        if (task != null)
+            return task
+    let task = ('steal pool.injector)
+    if (task != null)
+        return task
+    let count = (deref pool.count)
+    # start with the next worker so that thieves spread out
+    for k in (range count)
+        let victim = ((index + 1 + k) % count)
+        if (victim != index)
+            let task = ('steal (pool.deques @ victim))
+            if (task != null)
+                return task
+    nullof TaskPointer
+
+fn next-task (pool index)
+    let task = (take-task pool index)
+    if (task != null)
+        atomicrmw sub (& pool.pending) 1:i64
+    task
+
+fn run-task (pool task)
+    # the task may be released by its own function, so read it first
+    let f = (deref task.function)
+    let context = (deref task.context)
+    f context
+    atomicrmw sub (& pool.active) 1:i64
+    return;
+
+fn submit (pool task)
+    """"Queues `task` on the pool and wakes up a sleeping worker.
+    atomicrmw add (& pool.active) 1:i64
+    atomicrmw add (& pool.pending) 1:i64
+    let index = (current-worker pool)
+    let pushed? =
+        if (index >= 0)
+            'push (pool.deques @ index) task
+        else
+            loop ()
+                let old won? = (cmpxchg (& pool.injector-lock) 0 1)
+                if won?
+                    break;
+                sched_yield;
+            let pushed? = ('push pool.injector task)
+            atomic-store (& pool.injector-lock) 0
+            pushed?
+    if (not pushed?)
+        atomicrmw sub (& pool.pending) 1:i64
+        run-task pool task
+        return;
+    if ((atomic-load (& pool.sleepers)) > 0)
+        pthread_mutex_lock (& pool.mutex)
+        pthread_cond_signal (& pool.cond)
+        pthread_mutex_unlock (& pool.mutex)
+    return;
+
+fn help-until-zero (pool counter)
+    """"Runs queued tasks on the calling thread until the value at `counter`
+        drops to zero.
+    let index = (current-worker pool)
+    loop ()
+        if ((atomic-load counter) <= 0:i64)
+            break;
+        let task = (next-task pool index)
+        if (task != null)
+            run-task pool task
+        else
+            sched_yield;
+
+fn worker-main (arg)
+    let pool = (bitcast arg PoolPointer)
+    let index = (atomicrmw add (& pool.next-index) 1)
+    atomic-store (& (pool.owners @ index)) (ptrtoint (pthread_self) i64)
+    loop ()
+        let task = (next-task pool index)
+        if (task != null)
+            run-task pool task
+            repeat;
+        if ((atomic-load (& pool.shutdown)) != 0)
+            break;
+        # no work left; sleep until a task is submitted. the sleeper count is
+          raised before checking for work so that a concurrent submit either
+          sees the sleeper or its task is seen here.
+        pthread_mutex_lock (& pool.mutex)
+        atomicrmw add (& pool.sleepers) 1
+        if (((atomic-load (& pool.pending)) <= 0:i64)
+            and ((atomic-load (& pool.shutdown)) == 0))
+            pthread_cond_wait (& pool.cond) (& pool.mutex)
+        atomicrmw sub (& pool.sleepers) 1
+        pthread_mutex_unlock (& pool.mutex)
+    null as voidstar
+
+fn start-pool (count)
+    let count = (max (count as i32) 1)
+    let pool = (malloc PoolState)
+    store (PoolState) pool
+    pool.count = count
+    pool.threads = (malloc-array voidstar count)
+    pool.owners = (malloc-array i64 count)
+    pool.deques = (malloc-array WorkDeque count)
+    for i in (range count)
+        pool.owners @ i = 0:i64
+        'init (pool.deques @ i)
+    'init pool.injector
+    pthread_mutex_init (& pool.mutex) null
+    pthread_cond_init (& pool.cond) null
+    let main = (static-typify worker-main voidstar)
+    for i in (range count)
+        let err =
+            pthread_create (& (pool.threads @ i)) null main (bitcast pool voidstar)
+        assert (err == 0) "failed to start worker thread"
+    pool
+
+fn stop-pool (pool)
+    atomic-store (& pool.shutdown) 1
+    pthread_mutex_lock (& pool.mutex)
+    pthread_cond_broadcast (& pool.cond)
+    pthread_mutex_unlock (& pool.mutex)
+    let count = (deref pool.count)
+    for i in (range count)
+        pthread_join (pool.threads @ i) null
+    for i in (range count)
+        'release (pool.deques @ i)
+    'release pool.injector
+    pthread_cond_destroy (& pool.cond)
+    pthread_mutex_destroy (& pool.mutex)
+    free pool.threads
+    free pool.owners
+    free pool.deques
+    free pool
+    return;
+
+""""A pool of worker threads that run submitted tasks. The pool joins its
+    workers when it is dropped, after all queued tasks have run.
+struct ThreadPool
+    _pool : PoolPointer
+
+    inline __typecall (cls count)
+        """"Starts a pool of `count` worker threads, or one thread per online
+            processor if `count` is omitted.
+        Struct.__typecall cls
+            _pool =
+                start-pool
+                    static-if (none? count) (hardware-concurrency)
+                    else count
+
+    inline worker-count (self)
+        """"Returns the number of worker threads.
+        deref self._pool.count
+
+    fn join (self)
+        """"Runs queued tasks on the calling thread until all tasks submitted
+            to the pool have finished.
+        help-until-zero self._pool (& self._pool.active)
+
+    inline __drop (self)
+        stop-pool self._pool
+
+#-------------------------------------------------------------------------------
+# bodies
+#-------------------------------------------------------------------------------
+
+inline body-caller (body)
+    """"Splits `body` into a context value that is handed to the worker
+        threads and an inline that invokes `body` from a reference to that
+        context. Functions are called directly; captures and other runtime
+        callables are moved into the context.
+    static-if (constant? body)
+        _ (tupleof) (inline (ctx args...) (body args...))
+    else
+        _ (tupleof body) (inline (ctx args...) ((ctx @ 0) args...))
+
+# ranges are split in half recursively; the lower half is processed by the
+  current thread while the upper half is queued for other workers to steal.
+let KernelFunction = (pointer (function void voidstar usize usize))
+
+struct RangeJob plain
+
+struct RangeBatch plain
+    pool : PoolPointer
+    kernel : KernelFunction
+    context : voidstar
+    job-function : TaskFunction
+    jobs : (mutable pointer RangeJob)
+    next-job : i64
+    remaining : i64
+    grain : usize
+
+struct RangeJob plain
+    task : Task
+    batch : (mutable pointer RangeBatch)
+    lo : usize
+    hi : usize
+
+fn run-range-job (arg)
+    let job = (@ (bitcast arg (mutable pointer RangeJob)))
+    let batch = (@ job.batch)
+    let lo = (deref job.lo)
+    let hi =
+        loop (hi = (deref job.hi))
+            if ((hi - lo) <= batch.grain)
+                break hi
+            let mid = (lo + ((hi - lo) // 2:usize))
+            let k = (atomicrmw add (& batch.next-job) 1:i64)
+            let child = (& (batch.jobs @ k))
+            store
+                RangeJob
+                    task = (Task batch.job-function (bitcast child voidstar))
+                    batch = (& batch)
+                    lo = mid
+                    hi = hi
+                child
+            atomicrmw add (& batch.remaining) 1:i64
+            submit batch.pool (bitcast child TaskPointer)
+            mid
+    batch.kernel batch.context lo hi
+    atomicrmw sub (& batch.remaining) 1:i64
+    return;
+
+fn run-range (pool count grain kernel context)
+    """"Invokes `kernel` with `context` on disjoint subranges covering
+        `0 .. count`, of at most `grain` indices each, and returns when all
+        of them have been processed. A `grain` of zero picks a grain that
+        yields about eight subranges per worker.
+    if (count == 0:usize)
+        return;
+    let workers = ((deref pool.count) as usize)
+    let grain =
+        if (grain == 0:usize) (max (count // (workers * 8:usize)) 1:usize)
+        else grain
+    if (count <= grain)
+        kernel context 0:usize count
+        return;
+    # every split leaves both halves larger than grain / 2
+    let jobcount = ((count // grain) * 2:usize + 2:usize)
+    local batch =
+        RangeBatch
+            pool = pool
+            kernel = kernel
+            context = context
+            job-function = (static-typify run-range-job voidstar)
+            jobs = (malloc-array RangeJob jobcount)
+            next-job = 1:i64
+            remaining = 1:i64
+            grain = grain
+    let root = (& (batch.jobs @ 0))
+    store
+        RangeJob
+            task = (Task batch.job-function (bitcast root voidstar))
+            batch = (& batch)
+            lo = 0:usize
+            hi = count
+        root
+    run-range-job (bitcast root voidstar)
+    help-until-zero pool (& batch.remaining)
+    free batch.jobs
+    return;
+
+inline run-indexed (pool count grain ctx f)
+    """"Calls `(f ctxref i)` for every index `i` in `0 .. count` in parallel,
+        where `ctxref` is a reference to a copy of `ctx` shared by all
+        threads.
+    local ctx = ctx
+    let CtxPointer = (typeof (& ctx))
+    let kernel =
+        static-typify
+            fn (env lo hi)
+                let ctx = (@ (bitcast env CtxPointer))
+                for i in (range lo hi)
+                    f ctx i
+                ;
+            voidstar usize usize
+    run-range pool (count as usize) (grain as usize) kernel
+        bitcast (& ctx) voidstar
+
+inline source-count (source)
+    static-if ((typeof source) < integer) (source as usize)
+    else ((countof source) as usize)
+
+inline source-items (source)
+    """"Returns the runtime part of `source` needed to access its elements.
+    static-if ((typeof source) < integer) (tupleof)
+    else (tupleof (deref source._items))
+
+inline source-at (source)
+    """"Returns an inline that maps the items returned by `source-items` and
+        an index to an element of `source`.
+    static-if ((typeof source) < integer) (inline (items i) i)
+    else (inline (items i) ((items @ 0) @ i))
+
+#-------------------------------------------------------------------------------
+# parallel algorithms
+#-------------------------------------------------------------------------------
+
+inline parallel-for (pool source body opts...)
+    """"Calls `body` in parallel for every index below `source` if `source` is
+        an integer, or for a reference to every element if `source` is an
+        `Array`. `body` must be safe to call from several threads at once.
+        The range is split into pieces of `grain` elements, which is picked
+        automatically unless given as keyed option.
+    let grain = (va-option grain opts... 0:usize)
+    let ctx call = (body-caller body)
+    let at = (source-at source)
+    run-indexed pool._pool (source-count source) grain
+        tupleof (source-items source) ctx
+        inline (ctx i)
+            call (ctx @ 1) (at (ctx @ 0) i)
+
+inline parallel-reduce (pool source init f combine)
+    """"Folds the indices below `source` if `source` is an integer, or the
+        elements of `source` if it is an `Array`, into `init` by calling
+        `(f accumulator element)`. The range is split into one chunk per
+        worker thread and a few more; every chunk is folded in parallel,
+        starting from `init`, which must therefore be the identity of the
+        reduction. The partial results of the chunks are then combined on the
+        calling thread with `(combine accumulator partial)`, which defaults
+        to `f`. The accumulator must be of plain type, since `init` is
+        copied into every chunk.
+    let combine =
+        static-if (none? combine) f
+        else combine
+    let T = (typeof init)
+    static-assert (plain? T) "parallel-reduce requires a plain accumulator type"
+    let count = (source-count source)
+    let chunks = (min count (((deref pool._pool.count) as usize) * 4:usize))
+    let partials = (malloc-array T chunks)
+    let ctx call = (body-caller f)
+    let at = (source-at source)
+    run-indexed pool._pool chunks 1:usize
+        tupleof (source-items source) ctx partials init count chunks
+        inline (ctx k)
+            let items ctx partials init count chunks = (unpack ctx)
+            let lo = ((k * count) // chunks)
+            let hi = (((k + 1:usize) * count) // chunks)
+            let acc =
+                fold (acc = (deref init)) for i in (range lo hi)
+                    call ctx acc (at items i)
+            store acc (getelementptr partials k)
+    let result =
+        fold (acc = init) for k in (range chunks)
+            combine acc (partials @ k)
+    free partials
+    result
+
+inline parallel-map (pool source f opts...)
+    """"Applies `f` to every index below `source` if `source` is an integer,
+        to every element of `source` if it is an `Array`, and to every value
+        produced by `source` otherwise, and returns the results as an `Array`
+        in the order of the input. Generators, such as those provided by
+        `itertools`, are first collected into an array on the calling thread.
+        The result can be passed on to generators and collectors.
+    static-if ((((typeof source) < integer) or ((typeof source) < Array)))
+        let grain = (va-option grain opts... 0:usize)
+        let count = (source-count source)
+        let ctx call = (body-caller f)
+        let at = (source-at source)
+        local ctx = ctx
+        let ElementType =
+            static-if ((typeof source) < integer) usize
+            else ((typeof source) . ElementType)
+        # compile the body once to find its return type
+        let probe =
+            static-typify
+                fn (ctx x)
+                    call (@ ctx) x
+                typeof (& ctx)
+                ElementType
+        let ResultType = (returnof (typeof probe))
+        local results : (Array ResultType)
+        'resize results count
+        run-indexed pool._pool count grain
+            tupleof (source-items source) (& ctx) (deref results._items)
+            inline (ctx i)
+                let items ctxptr dest = (unpack ctx)
+                dest @ i = (call (@ ctxptr) (at items i))
+        results
+    else
+        let start valid? at next = ((source as Generator))
+        let it... = (start)
+        local inputs : (Array (typeof (at it...)))
+        for x in source
+            'append inputs x
+        this-function pool inputs f opts...
+
+#-------------------------------------------------------------------------------
+# futures
+#-------------------------------------------------------------------------------
+
+let FuturePending = 0:i64
+let FutureRunning = 1:i64
+let FutureDone = 2:i64
+let FutureCancelled = 3:i64
+
+@@ memo
+inline future-header-type (T)
+    struct (.. "<FutureHeader " (tostring T) ">") plain
+        task : Task
+        pool : PoolPointer
+        # one reference held by the future, one by the queued task
+        refs : i64
+        status : i64
+        result : T
+
+inline release-future (header)
+    if ((atomicrmw sub (& header.refs) 1:i64) == 1:i64)
+        if ((atomic-load (& header.status)) == FutureDone)
+            __drop header.result
+        free (& header)
+
+typedef Future < Struct
+    @@ memo
+    inline gen-type (T)
+        let HeaderType = (future-header-type T)
+        struct (.. "<Future " (tostring T) ">") < this-type
+            let ResultType = T
+            let HeaderType = HeaderType
+
+            _header : (mutable pointer HeaderType)
+
+    inline __typecall (cls T)
+        static-if (cls == this-type)
+            gen-type T
+        else
+            static-error "use ThreadPool.spawn to create futures"
+
+    fn done? (self)
+        """"Returns true if the task has finished or was cancelled.
+        (atomic-load (& self._header.status)) >= FutureDone
+
+    fn cancel (self)
+        """"Prevents the task from running if it has not started yet, and
+            returns whether it was cancelled.
+        let old won? =
+            cmpxchg (& self._header.status) FuturePending FutureCancelled
+        won?
+
+    fn wait-done (self)
+        let header = (@ self._header)
+        let pool = (deref header.pool)
+        let index = (current-worker pool)
+        loop ()
+            let status = (atomic-load (& header.status))
+            if (status >= FutureDone)
+                break status
+            let task = (next-task pool index)
+            if (task != null)
+                run-task pool task
+            else
+                sched_yield;
+
+    inline wait (self)
+        """"Runs queued tasks on the calling thread until the task has finished,
+            and returns a reference to its result, which stays valid as long
+            as the future. Waiting for a cancelled task is an error.
+        let status = (wait-done self)
+        assert (status == FutureDone) "waiting for cancelled future"
+        (@ self._header) . result
+
+    inline __drop (self)
+        release-future (@ self._header)
+
+    unlet gen-type wait-done
+
+typedef+ ThreadPool
+    inline spawn (self f)
+        """"Queues `f` to be called without arguments on a worker thread and
+            returns a `Future` for its result.
+        let ctx call = (body-caller f)
+        local ctx = ctx
+        let probe =
+            static-typify
+                fn (ctx)
+                    call (@ ctx)
+                typeof (& ctx)
+        let R = (returnof (typeof probe))
+        let T =
+            static-if (R == void) (tuple)
+            else R
+        let FutureType = (Future T)
+        let HeaderType = FutureType.HeaderType
+        let CtxType = (typeof ctx)
+        struct FutureState plain
+            header : HeaderType
+            context : CtxType
+        let task-function =
+            static-typify
+                fn (arg)
+                    let state = (@ (bitcast arg (mutable pointer FutureState)))
+                    let header = state.header
+                    let old won? =
+                        cmpxchg (& header.status) FuturePending FutureRunning
+                    if won?
+                        static-if (R == void)
+                            call state.context
+                        else
+                            assign (call state.context) header.result
+                        atomic-store (& header.status) FutureDone
+                    # the task owns the context, whether it ran or not
+                    __drop state.context
+                    release-future header
+                voidstar
+        let state = (malloc FutureState)
+        let header = state.header
+        store
+            HeaderType
+                task = (Task task-function (bitcast state voidstar))
+                pool = self._pool
+                refs = 2:i64
+                status = FuturePending
+            & header
+        assign ctx state.context
+        submit self._pool (bitcast state TaskPointer)
+        Struct.__typecall FutureType
+            _header = (bitcast state (mutable pointer HeaderType))
+
+unlet atomic-load atomic-store
+
+do
+    let ThreadPool Future parallel-for parallel-reduce parallel-map
+        \ hardware-concurrency
+    locals;
@@ -0,0 +1,27 @@
+#
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+
+""""processor
+    =========
+
+    Queries the processors available to the running program.
+
+# declared directly so that importing this module does not require parsing
+  C headers.
+let sysconf =
+    extern 'sysconf
+        function i64 i32
+
+fn hardware-concurrency ()
+    """"Returns the number of online processors.
+    static-if (operating-system == 'linux)
+        max (sysconf 84) 1:i64 # _SC_NPROCESSORS_ONLN
+    elseif (operating-system == 'macos)
+        max (sysconf 58) 1:i64 # _SC_NPROCESSORS_ONLN
+    else 1:i64
+
+do
+    let hardware-concurrency
+    locals;
@@ -9,7 +9,327 @@
     The testing module simplifies writing and running tests in an ad-hoc
     fashion.
 
+    `test-modules` runs all modules in the current process by default. If the
+    environment variable `SCOPES_TEST_JOBS` is set, every module is instead
+    run in a separate `scopes` process, with up to `SCOPES_TEST_JOBS`
+    processes running at the same time (`0` picks the number of online
+    processors). In this mode, the runner reports the wall, compile and run
+    time of each module and lists the slowest modules. If
+    `SCOPES_TEST_REPORT` names a file, the results are also written to it, as
+    JUnit XML if the name ends in `.xml`, and as JSON otherwise.
+
+from (import processor) let hardware-concurrency
+
+# the parallel runner starts one scopes process per module; the C functions
+  it needs are declared directly so that importing this module does not
+  require parsing C headers.
+let fork = (extern 'fork (function i32))
+let execv = (extern 'execv (function i32 rawstring (pointer rawstring)))
+let waitpid = (extern 'waitpid (function i32 i32 (mutable pointer i32) i32))
+let creat = (extern 'creat (function i32 rawstring u32))
+let dup2 = (extern 'dup2 (function i32 i32 i32))
+let _exit = (extern '_exit (function void i32))
+let getpid = (extern 'getpid (function i32))
+let getenv = (extern 'getenv (function rawstring rawstring))
+let setenv = (extern 'setenv (function i32 rawstring rawstring i32))
+let unsetenv = (extern 'unsetenv (function i32 rawstring))
+let unlink = (extern 'unlink (function i32 rawstring))
+let atoi = (extern 'atoi (function i32 rawstring))
+let strtod = (extern 'strtod (function f64 rawstring (mutable pointer rawstring)))
+let clock_gettime =
+    extern 'clock_gettime (function i32 i32 (mutable pointer (array i64 2)))
+let fopen = (extern 'fopen (function voidstar rawstring rawstring))
+let fread = (extern 'fread (function usize (mutable rawstring) usize usize voidstar))
+let fwrite = (extern 'fwrite (function usize rawstring usize usize voidstar))
+let fclose = (extern 'fclose (function i32 voidstar))
+let errno-location =
+    static-if (operating-system == 'macos)
+        extern '__error (function (mutable pointer i32))
+    else
+        extern '__errno_location (function (mutable pointer i32))
+let EINTR = 4
+
+# number of slowest modules listed by the parallel runner
+let SlowestModuleCount = 10
+
+fn getenv-string (name)
+    let value = (getenv (name as rawstring))
+    if ((ptrtoint value usize) == 0:usize) ""
+    else (string value)
+
+fn clock-ms ()
+    local ts = (arrayof i64 0 0)
+    static-if (operating-system == 'macos)
+        clock_gettime 6 (& ts) # CLOCK_MONOTONIC
+    else
+        clock_gettime 1 (& ts) # CLOCK_MONOTONIC
+    ((ts @ 0) as f64) * 1000.0:f64 + ((ts @ 1) as f64) / 1000000.0:f64
+
+fn read-file (path)
+    let f = (fopen (path as rawstring) ("rb" as rawstring))
+    if ((ptrtoint f usize) == 0:usize)
+        return ""
+    local content = ""
+    local buf : (array i8 4096)
+    loop ()
+        let n = (fread (& (buf @ 0)) 1:usize 4096:usize f)
+        if (n == 0:usize)
+            break;
+        content = (.. content (sc_string_new (& (buf @ 0)) n))
+    fclose f
+    deref content
+
+fn write-file (path content)
+    let f = (fopen (path as rawstring) ("wb" as rawstring))
+    if ((ptrtoint f usize) == 0:usize)
+        print "could not write test report to" path
+        return;
+    fwrite (content as rawstring) 1:usize (countof content) f
+    fclose f
+    return;
+
+fn read-timers (path)
+    """"Returns the compile and run time in milliseconds that a worker process
+        has written to `path` on exit, or -1 if the file does not exist.
+    let content = (read-file path)
+    if (empty? content)
+        return -1.0:f64 -1.0:f64
+    local rest = (nullof rawstring)
+    let compile-ms = (strtod (content as rawstring) (& rest))
+    let run-ms = (strtod rest (& rest))
+    _ compile-ms run-ms
+
+fn spawn-module (script logpath)
+    """"Starts a scopes process running `script` with stdout and stderr
+        redirected to `logpath`, and returns its process id.
+    local argv =
+        arrayof rawstring (compiler-path as rawstring) (script as rawstring)
+            nullof rawstring
+    let logpath = (logpath as rawstring)
+    let pid = (fork)
+    if (pid == 0)
+        let fd = (creat logpath 420:u32) # 0644
+        dup2 fd 1
+        dup2 fd 2
+        execv (argv @ 0) (& (argv @ 0))
+        _exit 127
+    pid
+
+fn exit-code (status)
+    # like a shell, report termination by signal N as exit code 128 + N
+    if ((status & 0x7f) == 0) ((status >> 8) & 0xff)
+    else (128 + (status & 0x7f))
+
+fn format-ms (ms)
+    if (ms < 0.0:f64) "-"
+    else (tostring ms)
+
+fn json-report (names codes wall compile run total failed jobs elapsed)
+    inline optional-ms (ms)
+        if (ms < 0.0:f64) "null"
+        else (tostring ms)
+    let header =
+        .. "{\n"
+            \ "  \"total\": " (tostring total) ",\n"
+            \ "  \"failed\": " (tostring failed) ",\n"
+            \ "  \"jobs\": " (tostring jobs) ",\n"
+            \ "  \"wall_ms\": " (tostring elapsed) ",\n"
+            \ "  \"modules\": ["
+    let body =
+        fold (out = header) for i in (range total)
+            .. out
+                ? (i == 0) "\n" ",\n"
+                "    {\"name\": \"" (names @ i) "\""
+                ", \"status\": "
+                ? ((codes @ i) == 0) "\"passed\"" "\"failed\""
+                ", \"exit_code\": " (tostring (codes @ i))
+                ", \"wall_ms\": " (tostring (wall @ i))
+                ", \"compile_ms\": " (optional-ms (compile @ i))
+                ", \"run_ms\": " (optional-ms (run @ i)) "}"
+    .. body
+        ? (total == 0) "" "\n"
+        "  ]\n}\n"
+
+fn junit-report (names codes wall total failed elapsed)
+    inline seconds (ms)
+        tostring (ms / 1000.0:f64)
+    let header =
+        .. "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            \ "<testsuite name=\"scopes\" tests=\"" (tostring total)
+            \ "\" failures=\"" (tostring failed)
+            \ "\" time=\"" (seconds elapsed) "\">\n"
+    let body =
+        fold (out = header) for i in (range total)
+            let code = (codes @ i)
+            let tail =
+                if (code == 0) "/>\n"
+                else
+                    .. ">\n    <failure message=\"exit code "
+                        \ (tostring code) "\"/>\n  </testcase>\n"
+            .. out
+                "  <testcase classname=\"testing\" name=\"" (names @ i)
+                "\" time=\"" (seconds (wall @ i)) "\"" tail
+    .. body "</testsuite>\n"
+
+fn __test-modules-parallel (module-dir modules jobs)
+    let total =
+        i32 (countof modules)
+    let jobs =
+        if (jobs > 0) jobs
+        else ((hardware-concurrency) as i32)
+    let tmpdir =
+        do
+            let dir = (getenv-string "TMPDIR")
+            ? (empty? dir) "/tmp" dir
+    let prefix = (.. tmpdir "/scopes-test-" (tostring (getpid)) "-")
+    # workers write their timers to <prefix><pid>.timers on exit
+    setenv ("SCOPES_TIMER_REPORT" as rawstring) (prefix as rawstring) 1
+
+    let names = (malloc-array string total)
+    let scripts = (malloc-array string total)
+    let pids = (malloc-array i32 total)
+    let codes = (malloc-array i32 total)
+    let start = (malloc-array f64 total)
+    let wall = (malloc-array f64 total)
+    let compile = (malloc-array f64 total)
+    let run = (malloc-array f64 total)
+    loop (i modules = 0 modules)
+        if (empty? modules)
+            break;
+        let module modules = (decons modules)
+        let module = (module as Symbol)
+        names @ i = (module as string)
+        scripts @ i =
+            try
+                find-module-path module-dir module __env
+            except (err) ""
+        pids @ i = -1
+        codes @ i = -1
+        compile @ i = -1.0:f64
+        run @ i = -1.0:f64
+        _ (i + 1) modules
+
+    print "* running" total "modules in" jobs "processes"
+    let t0 = (clock-ms)
+    let failed =
+        loop (next running failed = 0 0 0)
+            # fill all free slots before waiting for the next module to end
+            if ((running < jobs) and (next < total))
+                let script = (scripts @ next)
+                start @ next = (clock-ms)
+                let pid =
+                    if (empty? script) -1
+                    else (spawn-module script (.. prefix (tostring next) ".log"))
+                if (pid > 0)
+                    pids @ next = pid
+                    repeat (next + 1) (running + 1) failed
+                print "* running" (names @ next)
+                print "***********************************************"
+                if (empty? script)
+                    print "failed to find module" (names @ next)
+                else
+                    print "failed to start process"
+                codes @ next = 255
+                wall @ next = 0.0:f64
+                repeat (next + 1) running (failed + 1)
+            if (running == 0)
+                break failed
+            local status = 0
+            let pid = (waitpid -1 (& status) 0)
+            if (pid < 0)
+                # unstarted slots hold -1 as well, so errors must not reach
+                  the lookup below
+                if ((@ (errno-location)) == EINTR)
+                    repeat next running failed
+                print "* lost track of" running "running processes"
+                break (failed + running)
+            let t = (clock-ms)
+            let i =
+                loop (i = 0)
+                    if ((i == total) or ((pids @ i) == pid))
+                        break i
+                    i + 1
+            if (i == total)
+                # not one of ours
+                repeat next running failed
+            let code = (exit-code status)
+            codes @ i = code
+            wall @ i = (t - (start @ i))
+            let timerpath = (.. prefix (tostring pid) ".timers")
+            let compile-ms run-ms = (read-timers timerpath)
+            compile @ i = compile-ms
+            run @ i = run-ms
+            unlink (timerpath as rawstring)
+            # print the output of each module in one piece
+            let logpath = (.. prefix (tostring i) ".log")
+            print "* running" (names @ i)
+            print "***********************************************"
+            io-write! (read-file logpath)
+            unlink (logpath as rawstring)
+            if (code != 0)
+                print "* process exited with code" code
+            _ next (running - 1) (failed + (? (code != 0) 1 0))
+    let elapsed = ((clock-ms) - t0)
+    unsetenv ("SCOPES_TIMER_REPORT" as rawstring)
+
+    if (failed > 0)
+        print;
+        print "List of failed modules"
+        print "======================"
+        for i in (range total)
+            if ((codes @ i) != 0)
+                print "*" (names @ i)
+
+    print;
+    print "Slowest modules"
+    print "==============="
+    # partial selection sort of module indices by descending wall time
+    let order = (malloc-array i32 total)
+    for i in (range total)
+        order @ i = i
+    for k in (range (min SlowestModuleCount total))
+        let slowest =
+            fold (slowest = k) for i in (range (k + 1) total)
+                if ((wall @ (order @ i)) > (wall @ (order @ slowest))) i
+                else slowest
+        let i = (deref (order @ slowest))
+        order @ slowest = (order @ k)
+        order @ k = i
+        print "*" (names @ i) (format-ms (wall @ i)) "ms wall,"
+            \ (format-ms (compile @ i)) "ms compile,"
+            \ (format-ms (run @ i)) "ms run"
+    free order
+
+    let report-path = (getenv-string "SCOPES_TEST_REPORT")
+    if (not (empty? report-path))
+        let n = (countof report-path)
+        let xml? = ((n >= 4:usize) and ((rslice report-path (n - 4:usize)) == ".xml"))
+        write-file report-path
+            if xml?
+                junit-report names codes wall total failed elapsed
+            else
+                json-report names codes wall compile run total failed jobs elapsed
+
+    print;
+    print total "tests executed," (total - failed) "succeeded," failed "failed."
+    print "total wall time" elapsed "ms"
+    print "done."
+    free names
+    free scripts
+    free pids
+    free codes
+    free start
+    free wall
+    free compile
+    free run
+    return;
+
 fn __test-modules (module-dir modules)
+    static-if (operating-system != 'windows)
+        let jobs = (getenv-string "SCOPES_TEST_JOBS")
+        if (not (empty? jobs))
+            return
+                __test-modules-parallel module-dir modules (atoi (jobs as rawstring))
     let total =
         i32 (countof modules)
 
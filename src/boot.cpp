@@ -6,6 +6,7 @@
 
 #include "boot.hpp"
 #include "timer.hpp"
+#include "profiler.hpp"
 #include "gc.hpp"
 #include "error.hpp"
 #include "lexerparser.hpp"
@@ -44,13 +45,40 @@
 
 namespace scopes {
 
+// samples per second of the profiler that --profile starts
+#define SCOPES_PROFILE_FREQUENCY 1000
+
 static Timer *main_compile_time = nullptr;
+static const char *profile_output_path = nullptr;
 void on_startup() {
     main_compile_time = new Timer(TIMER_Main);
 }
 
 void on_shutdown() {
     delete main_compile_time;
+    main_compile_time = nullptr;
+    if (profile_output_path) {
+        stop_profiler();
+        auto result = write_profiler_samples(String::from_cstr(profile_output_path));
+        if (!result.ok()) {
+            print_error(result.assert_error());
+        }
+        profile_output_path = nullptr;
+    }
+    if (getenv("SCOPES_PROFILE_ALLOC")) {
+        StyledStream ss(SCOPES_CERR);
+        print_alloc_profile(ss, 0);
+    }
+#ifndef SCOPES_WIN32
+    // used by the parallel test runner to collect compile and run times
+    // of its worker processes
+    const char *timer_report = getenv("SCOPES_TIMER_REPORT");
+    if (timer_report) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s%d.timers", timer_report, (int)getpid());
+        Timer::write_summary(path);
+    }
+#endif
 #if SCOPES_PRINT_TIMERS
     //print_profiler_info();
     Timer::print_timers();
@@ -221,6 +249,19 @@ void init(void *c_main, int argc, char *argv[]) {
 
     on_startup();
 
+    // the target CPU has to be known before the JIT is initialized, so the
+    // option is picked from the option list here; core skips it.
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if ((arg[0] != '-') || !strcmp(arg, "-c") || !strcmp(arg, "-m"))
+            break;
+        if (!strcmp(arg, "--target-cpu") && ((i + 1) < argc)) {
+            set_target_cpu(argv[++i]);
+        } else if (!strcmp(arg, "--profile") && ((i + 1) < argc)) {
+            profile_output_path = argv[++i];
+        }
+    }
+
     Symbol::_init_symbols();
     init_llvm();
 
@@ -247,6 +288,14 @@ void init(void *c_main, int argc, char *argv[]) {
 
     init_types();
     init_globals(argc, argv);
+
+    if (profile_output_path) {
+        auto result = start_profiler(SCOPES_PROFILE_FREQUENCY);
+        if (!result.ok()) {
+            print_error(result.assert_error());
+            profile_output_path = nullptr;
+        }
+    }
 }
 
 SCOPES_RESULT(int) try_main() {
@@ -37,6 +37,8 @@
 #include "clang/Lex/Preprocessor.h"
 #include "clang/Lex/LiteralSupport.h"
 
+#include <unordered_set>
+
 namespace scopes {
 
 //------------------------------------------------------------------------------
@@ -78,8 +80,11 @@ public:
     Result<void> ok;
     std::unordered_map<clang::RecordDecl *, const Type *> record_defined;
     std::unordered_map<clang::EnumDecl *, const Type *> enum_defined;
+    // names of the static inline functions that are exported; only set
+    // when the bitcode of the include is linked
+    std::unordered_set<std::string> *inline_functions;
 
-    CVisitor() : dest(nullptr), Context(NULL) {
+    CVisitor() : dest(nullptr), Context(NULL), inline_functions(nullptr) {
     }
 
 #define SCOPES_COMBINE_RESULT(DEST, EXPR) { \
@@ -752,7 +757,9 @@ public:
             return true;
 
         if(f->getStorageClass() == clang::SC_Static) {
-            return true;
+            if (!inline_functions || !f->isInlineSpecified())
+                return true;
+            inline_functions->insert(FuncName);
         }
 
         auto functype_result = TranslateFuncType(fntyp);
@@ -786,8 +793,10 @@ class EmitLLVMOnlyAction : public clang::EmitLLVMOnlyAction {
 public:
     CNamespaces *dest;
     Result<void> result;
+    bool link_bitcode;
+    std::unordered_set<std::string> inline_functions;
 
-    EmitLLVMOnlyAction(CNamespaces *dest_);
+    EmitLLVMOnlyAction(CNamespaces *dest_, bool link_bitcode_);
 
     std::unique_ptr<clang::ASTConsumer> CreateASTConsumer(clang::CompilerInstance &CI,
         clang::StringRef InFile) override;
@@ -804,6 +813,9 @@ public:
 
     virtual void Initialize(clang::ASTContext &Context) {
         visitor.SetContext(&Context, act.dest);
+        if (act.link_bitcode) {
+            visitor.inline_functions = &act.inline_functions;
+        }
     }
 
     virtual bool HandleTopLevelDecl(clang::DeclGroupRef D) {
@@ -822,9 +834,10 @@ public:
     }
 };
 
-EmitLLVMOnlyAction::EmitLLVMOnlyAction(CNamespaces *dest_) :
+EmitLLVMOnlyAction::EmitLLVMOnlyAction(CNamespaces *dest_, bool link_bitcode_) :
     clang::EmitLLVMOnlyAction((llvm::LLVMContext *)LLVMGetGlobalContext()),
-    dest(dest_)
+    dest(dest_),
+    link_bitcode(link_bitcode_)
 {
 }
 
@@ -1017,14 +1030,23 @@ SCOPES_RESULT(const Scope *) import_c_module (
 
     auto argcount = args.size();
     std::string object_file;
+    bool link_bitcode = false;
     for (size_t i = 0; i < argcount; ++i) {
         if ((args[i] == "-c") && ((i + 1) < argcount)) {
             object_file = args[i + 1];
             i += 2;
             continue;
         }
+        if (args[i] == "--link-bitcode") {
+            link_bitcode = true;
+            continue;
+        }
         aargs.push_back(args[i].c_str());
     }
+    if (link_bitcode) {
+        // also generate static inline functions that the C code never calls
+        aargs.push_back("-femit-all-decls");
+    }
 
     CompilerInstance compiler;
     compiler.setInvocation(createInvocationFromCommandLine(aargs));
@@ -1061,7 +1083,7 @@ SCOPES_RESULT(const Scope *) import_c_module (
     }
 
     // Create and execute the frontend to generate an LLVM bitcode module.
-    std::unique_ptr<EmitLLVMOnlyAction> Act(new EmitLLVMOnlyAction(&ns));
+    std::unique_ptr<EmitLLVMOnlyAction> Act(new EmitLLVMOnlyAction(&ns, link_bitcode));
     if (compiler.ExecuteAction(*Act)) {
         SCOPES_CHECK_RESULT(Act->result);
 
@@ -1097,6 +1119,19 @@ SCOPES_RESULT(const Scope *) import_c_module (
         M = (LLVMModuleRef)Act->takeModule().release();
         assert(M);
         llvm_c_modules.push_back(M);
+        if (link_bitcode) {
+            // static inline functions from headers become callable and can
+            // be merged when several modules define them. they are found by
+            // their declaration, since clang only adds inlinehint when it
+            // optimizes.
+            for (auto &&f : *llvm::unwrap(M)) {
+                if (!f.isDeclaration() && f.hasLocalLinkage()
+                    && Act->inline_functions.count(f.getName().str())) {
+                    f.setLinkage(llvm::GlobalValue::LinkOnceODRLinkage);
+                }
+            }
+            add_c_bitcode(M);
+        }
         if (!object_file.empty()) {
             auto target_machine = get_object_target_machine();
             assert(target_machine);
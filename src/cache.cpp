@@ -22,6 +22,7 @@
 //#include <libgen.h>
 
 #include <algorithm>
+#include <vector>
 #include <memory.h>
 #include <stdio.h>
 #include <string.h>
@@ -184,7 +185,16 @@ const char *get_cache_dir() {
     return cache_dir;
 }
 
+static uint64_t cache_target_hash = 0;
+
+void set_cache_target(const char *cpu, const char *features) {
+    cache_target_hash = hash2(
+        hash_bytes(cpu, strlen(cpu)),
+        hash_bytes(features, strlen(features)));
+}
+
 const String *get_cache_key(uint64_t hash, const char *content, size_t size) {
+    hash = hash2(hash, cache_target_hash);
     // split into four parts, hash each part -> 256 bits
     uint64_t h[4];
     memset(h, 0, sizeof(h));
@@ -252,6 +262,27 @@ const char *get_cache_file(const String *key) {
     return nullptr;
 }
 
+const String *load_cache(const char *filepath) {
+    auto f = gzopen(filepath, "rb");
+    if (!f) {
+        return nullptr;
+    }
+    std::vector<char> data;
+    char buf[8192];
+    while (true) {
+        int r = gzread(f, buf, sizeof(buf));
+        if (r < 0) {
+            gzclose(f);
+            return nullptr;
+        }
+        if (r == 0)
+            break;
+        data.insert(data.end(), buf, buf + r);
+    }
+    gzclose(f);
+    return String::from(data.data(), data.size());
+}
+
 void set_cache(const String *key,
     const char *key_content, size_t key_size,
     const char *content, size_t size) {
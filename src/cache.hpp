@@ -15,10 +15,15 @@ namespace scopes {
 struct String;
 
 const String *get_cache_key(uint64_t hash, const char *content, size_t size);
+// the CPU and features that code is generated for are part of every key
+void set_cache_target(const char *cpu, const char *features);
 int get_cache_misses();
 const char *get_cache_dir();
 const char *get_cache_file(const String *key);
 const char *get_cache_key_file(const String *key);
+// returns the decompressed contents of a file returned by get_cache_file,
+// or null if it could not be read
+const String *load_cache(const char *filepath);
 void set_cache(const String *key,
     const char *key_content, size_t key_size,
     const char *content, size_t size);
@@ -21,6 +21,9 @@ namespace scopes {
     T(CF_O3, (CF_O1 | CF_O2), "compile-flag-O3") \
     T(CF_Cache, (1 << 7), "compile-flag-cache") \
     T(CF_Module, (1 << 8), "compile-flag-module") \
+    T(CF_ProfileGenerate, (1 << 9), "compile-flag-profile-generate") \
+    T(CF_ProfileUse, (1 << 10), "compile-flag-profile-use") \
+    T(CF_ProfileAlloc, (1 << 11), "compile-flag-profile-alloc") \
 
 enum {
 #define T(NAME, VALUE, SNAME) \
@@ -30,7 +33,7 @@ SCOPES_COMPILER_FLAGS()
 };
 
 // which flags are going to be effecting cache invalidation
-#define SCOPES_CACHE_COMPILER_FLAGS (CF_O3 | CF_NoDebugInfo)
+#define SCOPES_CACHE_COMPILER_FLAGS (CF_O3 | CF_NoDebugInfo | CF_ProfileUse)
 
 } // namespace scopes
 
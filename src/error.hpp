@@ -494,6 +494,9 @@ formatters:
     T(RTTypeBitcountMismatch, \
         "runtime: provided word count (%1) does not match word count of type %0 (%2)", \
         PType, int, int) \
+    T(RTProfilerFailed, \
+        "runtime: sampling profiler failed: %0", \
+        Rawstring) \
 
 // main
 #define SCOPES_MAIN_ERROR_KIND() \
@@ -11,12 +11,14 @@
 #include "cache.hpp"
 #include "compiler_flags.hpp"
 #include "timer.hpp"
+#include "hash.hpp"
 
 #ifdef SCOPES_WIN32
 #include "dlfcn.h"
 #include <math.h>
 #else
 #include <dlfcn.h>
+#include <unistd.h>
 #endif
 
 #include <llvm-c/Core.h>
@@ -33,13 +35,36 @@
 
 #include "llvm/ExecutionEngine/JITEventListener.h"
 #include "llvm/Object/SymbolSize.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Instrumentation.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/ProfileData/InstrProf.h"
+#include "llvm/ProfileData/InstrProfReader.h"
+#include "llvm/ProfileData/InstrProfWriter.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
 
 #include <limits.h>
 
 #include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <vector>
+#include <memory>
+#include <algorithm>
+#include <map>
+#include <unordered_set>
+#include <limits>
 
 #include <zlib.h>
 
@@ -149,6 +174,57 @@ public:
 static DisassemblyListener *disassembly_listener = nullptr;
 #endif
 
+#ifndef SCOPES_WIN32
+// writes the address, size and name of every JIT-compiled function to
+// /tmp/perf-<pid>.map, where perf looks up symbols for anonymous memory
+class PerfMapListener : public llvm::JITEventListener {
+public:
+    FILE *file = nullptr;
+
+    PerfMapListener() {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/perf-%i.map", (int)getpid());
+        file = fopen(path, "w");
+    }
+
+    virtual void notifyObjectLoaded(
+        ObjectKey K,
+        const llvm::object::ObjectFile &Obj,
+        const llvm::RuntimeDyld::LoadedObjectInfo &L) {
+        if (!file)
+            return;
+        // the debug object carries the addresses the sections were loaded at
+        auto debug_obj = L.getObjectForDebug(Obj);
+        auto obj = debug_obj.getBinary();
+        if (!obj)
+            return;
+        for (auto &&S : llvm::object::computeSymbolSizes(*obj)) {
+            llvm::object::SymbolRef sym = S.first;
+            auto type = sym.getType();
+            if (!type) {
+                llvm::consumeError(type.takeError());
+                continue;
+            }
+            if (type.get() != llvm::object::SymbolRef::ST_Function)
+                continue;
+            auto name = sym.getName();
+            if (!name) {
+                llvm::consumeError(name.takeError());
+                continue;
+            }
+            auto addr = sym.getAddress();
+            if (!addr) {
+                llvm::consumeError(addr.takeError());
+                continue;
+            }
+            fprintf(file, "%" PRIx64 " %" PRIx64 " %s\n",
+                addr.get(), S.second, name.get().str().c_str());
+        }
+        fflush(file);
+    }
+};
+#endif
+
 void enable_disassembly(bool enable) {
 #if SCOPES_LLVM_SUPPORT_DISASSEMBLY
     assert(disassembly_listener);
@@ -175,6 +251,12 @@ void print_disassembly(std::string symbol, void *pfunc) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+static bool loop_remarks = false;
+
+bool loop_remarks_enabled() {
+    return loop_remarks;
+}
+
 void build_and_run_opt_passes(LLVMModuleRef module, int opt_level) {
     LLVMPassManagerBuilderRef passBuilder;
 
@@ -292,6 +374,72 @@ void *local_aware_dlsym(Symbol name) {
     return retrieve_symbol(name.name()->data);
 }
 
+static const char *target_cpu = nullptr;
+static const char *target_features = nullptr;
+// true if the CPU or features were chosen by the user rather than detected
+static bool target_cpu_explicit = false;
+
+void set_target_cpu(const char *cpu) {
+    assert(!orc);
+    target_cpu = cpu;
+    target_features = nullptr;
+}
+
+static void init_target_cpu() {
+    if (target_features) return;
+    if (!target_cpu) {
+        target_cpu = getenv("SCOPES_TARGET_CPU");
+    }
+    target_cpu_explicit = target_cpu && *target_cpu;
+    if (!target_cpu || !*target_cpu || !strcmp(target_cpu, "host")) {
+        char *name = LLVMGetHostCPUName();
+        target_cpu = strdup(name);
+        LLVMDisposeMessage(name);
+        char *features = LLVMGetHostCPUFeatures();
+        target_features = strdup(features);
+        LLVMDisposeMessage(features);
+    } else {
+        // an explicitly named CPU implies its own feature set
+        target_features = "";
+    }
+    const char *features = getenv("SCOPES_TARGET_FEATURES");
+    if (features) {
+        target_features = features;
+        target_cpu_explicit = true;
+    }
+    set_cache_target(target_cpu, target_features);
+}
+
+const char *get_target_cpu() {
+    init_target_cpu();
+    return target_cpu;
+}
+
+const char *get_target_features() {
+    init_target_cpu();
+    return target_features;
+}
+
+void get_target_cpu_for_triple(const char *triple,
+    const char *&cpu, const char *&features) {
+    cpu = nullptr;
+    features = nullptr;
+    auto host = LLVMGetDefaultTargetTriple();
+    auto hosttt = LLVMNormalizeTargetTriple(host);
+    auto tt = LLVMNormalizeTargetTriple(triple);
+    // objects are built for the baseline CPU unless a CPU was selected
+    // explicitly, so that they also run on older machines. objects for
+    // other targets always are.
+    init_target_cpu();
+    if (target_cpu_explicit && !strcmp(hosttt, tt)) {
+        cpu = get_target_cpu();
+        features = get_target_features();
+    }
+    LLVMDisposeMessage(tt);
+    LLVMDisposeMessage(hosttt);
+    LLVMDisposeMessage(host);
+}
+
 LLVMTargetMachineRef get_jit_target_machine() {
     return jit_target_machine;
 }
@@ -338,6 +486,23 @@ static LLVMOrcObjectLayerRef llvm_create_object_layer(
     object_layer = LLVMOrcCreateRTDyldObjectLinkingLayerWithSectionMemoryManager(ES);
     LLVMOrcRTDyldObjectLinkingLayerRegisterJITEventListener(object_layer, LLVMCreateGDBRegistrationListener());
 
+    // SCOPES_PERF makes JIT-compiled functions visible to perf, with a perf
+    // map for perf report and jitdump records, which include line tables
+    // when debug info is generated, for perf inject --jit
+    if (getenv("SCOPES_PERF")) {
+#ifndef SCOPES_WIN32
+        llvm::JITEventListener *pm = new PerfMapListener();
+        LLVMOrcRTDyldObjectLinkingLayerRegisterJITEventListener(object_layer,
+            llvm::wrap(pm));
+#endif
+        // null unless LLVM was built with LLVM_USE_PERF
+        auto jitdump = LLVMCreatePerfJITEventListener();
+        if (jitdump) {
+            LLVMOrcRTDyldObjectLinkingLayerRegisterJITEventListener(
+                object_layer, jitdump);
+        }
+    }
+
 #if SCOPES_LLVM_SUPPORT_DISASSEMBLY
     if (!disassembly_listener) {
         disassembly_listener = new DisassemblyListener();
@@ -389,8 +554,8 @@ SCOPES_RESULT(void) init_execution() {
         LLVMCodeGenLevelDefault, LLVMRelocStatic, LLVMCodeModelDefault);
     assert(object_target_machine);
 
-    const char *CPU = nullptr;
-    const char *Features = nullptr;
+    const char *CPU = get_target_cpu();
+    const char *Features = get_target_features();
     jit_target_machine = LLVMCreateTargetMachine(target, triple, CPU, Features,
         optlevel, reloc, codemodel);
     assert(jit_target_machine);
@@ -434,6 +599,407 @@ SCOPES_RESULT(void) init_execution() {
 
 static std::vector<const PointerMap *> pointer_maps;
 
+//------------------------------------------------------------------------------
+// CROSS MODULE INLINING
+//------------------------------------------------------------------------------
+
+// small functions of added modules are kept as bitcode and imported into
+// later modules as available_externally definitions, so that the optimizer
+// can inline them across stages. SCOPES_INLINE_THRESHOLD sets the largest
+// function size in instructions that is kept; 0 disables importing.
+
+#define SCOPES_DEFAULT_INLINE_THRESHOLD 50
+// distinguishes the cached bitcode from the object of the same module
+#define SCOPES_INLINE_CACHE_TAG 0x656e696c6e69ull
+
+struct InlineSummary {
+    std::unique_ptr<llvm::Module> module;
+    // summaries of C bitcode can also be linked into object files
+    bool portable;
+};
+
+static int inline_threshold = -1;
+static std::vector<InlineSummary> inline_modules;
+// function name -> index of the summary that holds its definition
+static std::unordered_map<std::string, size_t> inline_donors;
+
+static int get_inline_threshold() {
+    if (inline_threshold < 0) {
+        const char *value = getenv("SCOPES_INLINE_THRESHOLD");
+        inline_threshold = value?std::max(atoi(value), 0):SCOPES_DEFAULT_INLINE_THRESHOLD;
+    }
+    return inline_threshold;
+}
+
+// a copy of a value that refers to state private to its module would
+// have state of its own
+static bool refers_to_local_state(const llvm::Value *value) {
+    if (auto gv = llvm::dyn_cast<llvm::GlobalValue>(value)) {
+        if (!gv->hasLocalLinkage())
+            return false;
+        auto var = llvm::dyn_cast<llvm::GlobalVariable>(gv);
+        return !(var && var->isConstant());
+    }
+    if (auto c = llvm::dyn_cast<llvm::Constant>(value)) {
+        for (auto &&op : c->operands()) {
+            if (refers_to_local_state(op))
+                return true;
+        }
+    }
+    return false;
+}
+
+static bool is_inline_candidate(const llvm::Function &f, int threshold) {
+    if (f.isDeclaration() || f.hasLocalLinkage()
+        || f.hasAvailableExternallyLinkage()
+        || f.hasFnAttribute(llvm::Attribute::NoInline))
+        return false;
+    int count = 0;
+    for (auto &&bb : f) {
+        for (auto &&inst : bb) {
+            if (++count > threshold)
+                return false;
+            for (auto &&op : inst.operands()) {
+                if (refers_to_local_state(op))
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+typedef std::unordered_set<const llvm::GlobalValue *> GlobalValueSet;
+
+// adds the local constants that `value` refers to, and with `functions` set
+// also the function definitions, to `keep`; new functions are queued in
+// `todo`
+static void collect_definitions(const llvm::Value *value, bool functions,
+    GlobalValueSet &keep, std::vector<const llvm::Function *> &todo) {
+    if (auto gv = llvm::dyn_cast<llvm::GlobalValue>(value)) {
+        if (gv->isDeclaration() || keep.count(gv))
+            return;
+        if (auto f = llvm::dyn_cast<llvm::Function>(gv)) {
+            if (functions) {
+                keep.insert(f);
+                todo.push_back(f);
+            }
+        } else if (auto var = llvm::dyn_cast<llvm::GlobalVariable>(gv)) {
+            if (var->hasLocalLinkage()) {
+                keep.insert(var);
+                collect_definitions(var->getInitializer(), functions, keep, todo);
+            }
+        }
+    } else if (auto c = llvm::dyn_cast<llvm::Constant>(value)) {
+        for (auto &&op : c->operands()) {
+            collect_definitions(op, functions, keep, todo);
+        }
+    }
+}
+
+// clones the functions in `todo` together with what they refer to; all
+// other globals of the module are declared
+static std::unique_ptr<llvm::Module> extract_definitions(
+    const llvm::Module &module, bool functions, GlobalValueSet &keep,
+    std::vector<const llvm::Function *> &todo) {
+    while (!todo.empty()) {
+        auto f = todo.back();
+        todo.pop_back();
+        for (auto &&bb : *f) {
+            for (auto &&inst : bb) {
+                for (auto &&op : inst.operands()) {
+                    collect_definitions(op, functions, keep, todo);
+                }
+            }
+        }
+    }
+    llvm::ValueToValueMapTy vmap;
+    return llvm::CloneModule(module, vmap,
+        [&keep](const llvm::GlobalValue *gv) { return keep.count(gv) != 0; });
+}
+
+// returns a module that only holds the bodies of the small functions of
+// `module`, as available_externally definitions; everything else is
+// declared and resolves to the symbols the JIT already has. returns null if
+// the module has no candidates.
+static std::unique_ptr<llvm::Module> make_inline_summary(LLVMModuleRef module,
+    int threshold) {
+    if (!threshold)
+        return nullptr;
+    auto &&source = *llvm::unwrap(module);
+    GlobalValueSet keep;
+    std::vector<const llvm::Function *> todo;
+    for (auto &&f : source) {
+        if (!f.isDeclaration() && is_inline_candidate(f, threshold)) {
+            keep.insert(&f);
+            todo.push_back(&f);
+        }
+    }
+    if (todo.empty())
+        return nullptr;
+    auto summary = extract_definitions(source, false, keep, todo);
+    for (auto &&f : *summary) {
+        if (!f.isDeclaration()) {
+            f.setLinkage(llvm::GlobalValue::AvailableExternallyLinkage);
+        }
+    }
+    return summary;
+}
+
+static void add_inline_summary(std::unique_ptr<llvm::Module> summary,
+    bool portable = false) {
+    size_t index = inline_modules.size();
+    for (auto &&f : *summary) {
+        if (f.hasAvailableExternallyLinkage()) {
+            inline_donors[f.getName().str()] = index;
+        }
+    }
+    inline_modules.push_back({ std::move(summary), portable });
+}
+
+void add_c_bitcode(LLVMModuleRef module) {
+    // clang marks everything it compiles without optimization as noinline
+    // and optnone, which has to be undone before candidates are chosen
+    for (auto &&f : *llvm::unwrap(module)) {
+        if (f.hasFnAttribute(llvm::Attribute::OptimizeNone)) {
+            f.removeFnAttr(llvm::Attribute::OptimizeNone);
+            f.removeFnAttr(llvm::Attribute::NoInline);
+        }
+    }
+    // C functions are linked regardless of their size
+    auto summary = make_inline_summary(module, std::numeric_limits<int>::max());
+    if (!summary)
+        return;
+    add_inline_summary(std::move(summary), true);
+}
+
+static const String *get_inline_cache_key(const String *key) {
+    return get_cache_key(SCOPES_INLINE_CACHE_TAG, key->data, key->count);
+}
+
+static void store_inline_summary(const String *key, const llvm::Module &summary) {
+    llvm::SmallVector<char, 0> buffer;
+    llvm::raw_svector_ostream os(buffer);
+    llvm::WriteBitcodeToFile(summary, os);
+    set_cache(get_inline_cache_key(key), nullptr, 0, buffer.data(), buffer.size());
+}
+
+static void load_inline_summary(const String *key) {
+    auto filepath = get_cache_file(get_inline_cache_key(key));
+    if (!filepath)
+        return;
+    auto data = load_cache(filepath);
+    if (!data)
+        return;
+    auto result = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(llvm::StringRef(data->data, data->count), filepath),
+        *llvm::unwrap(LLVMGetGlobalContext()));
+    if (!result) {
+        llvm::consumeError(result.takeError());
+        return;
+    }
+    add_inline_summary(std::move(*result));
+}
+
+SCOPES_RESULT(void) import_inline_candidates(LLVMModuleRef module, bool object) {
+    SCOPES_RESULT_TYPE(void);
+    if (inline_donors.empty())
+        return {};
+    auto &&dest = *llvm::unwrap(module);
+    // the called functions of every donor, and the definitions they need
+    std::map<size_t, std::vector<const llvm::Function *>> donors;
+    for (auto &&f : dest) {
+        if (!f.isDeclaration())
+            continue;
+        auto it = inline_donors.find(f.getName().str());
+        if (it == inline_donors.end())
+            continue;
+        auto &&summary = inline_modules[it->second];
+        if (object && !summary.portable)
+            continue;
+        auto def = summary.module->getFunction(f.getName());
+        if (def && !def->isDeclaration()) {
+            donors[it->second].push_back(def);
+        }
+    }
+    for (auto &&entry : donors) {
+        GlobalValueSet keep(entry.second.begin(), entry.second.end());
+        auto part = extract_definitions(*inline_modules[entry.first].module,
+            true, keep, entry.second);
+        if (llvm::Linker::linkModules(dest, std::move(part),
+            llvm::Linker::LinkOnlyNeeded)) {
+            SCOPES_ERROR(CGenBackendFailed,
+                "failed to link functions for cross module inlining");
+        }
+    }
+    if (object) {
+        // an object has no JIT to fall back to for calls that were not
+        // inlined, so it keeps its own copy
+        for (auto &&f : dest) {
+            if (f.hasAvailableExternallyLinkage()) {
+                f.setLinkage(llvm::GlobalValue::LinkOnceODRLinkage);
+            }
+        }
+    }
+    return {};
+}
+
+//------------------------------------------------------------------------------
+// PROFILE GUIDED OPTIMIZATION
+//------------------------------------------------------------------------------
+
+// CF_ProfileGenerate inserts edge counters into functions before they are
+// optimized. in the JIT, the counters are plain globals that write_profile
+// collects into an indexed profile; objects use LLVM's own lowering and have
+// to be linked against the compiler-rt profile runtime. CF_ProfileUse applies
+// the profile selected with set_profile. symbol names depend on the order in
+// which functions are compiled, so while the profile passes run, functions
+// carry the names that the generator attached as SCOPES_PROFILE_NAME_MD;
+// they are derived from the function name, its argument types and its
+// anchor. functions that share all three also share a profile.
+
+struct ProfileCounters {
+    std::string name;
+    uint64_t hash;
+    std::string symbol;
+    uint32_t count;
+    const uint64_t *counters;
+};
+
+static std::vector<ProfileCounters> profile_counters;
+static std::string profile_path;
+static uint64_t profile_hash = 0;
+
+SCOPES_RESULT(void) set_profile(const String *path) {
+    SCOPES_RESULT_TYPE(void);
+    auto reader = llvm::IndexedInstrProfReader::create(path->data);
+    if (!reader) {
+        SCOPES_ERROR(CGenBackendFailed,
+            strdup(llvm::toString(reader.takeError()).c_str()));
+    }
+    auto buffer = llvm::MemoryBuffer::getFile(path->data);
+    if (!buffer) {
+        SCOPES_ERROR(CGenBackendFailed,
+            strdup(buffer.getError().message().c_str()));
+    }
+    profile_path = path->data;
+    profile_hash = hash_bytes((*buffer)->getBufferStart(),
+        (*buffer)->getBufferSize());
+    return {};
+}
+
+void build_and_run_profile_passes(LLVMModuleRef module, uint64_t flags,
+    bool object) {
+    llvm::legacy::PassManager passes;
+    if (flags & CF_ProfileGenerate) {
+        passes.add(llvm::createPGOInstrumentationGenLegacyPass());
+        if (object) {
+            passes.add(llvm::createInstrProfilingLegacyPass());
+        }
+    } else if ((flags & CF_ProfileUse) && !profile_path.empty()) {
+        passes.add(llvm::createPGOInstrumentationUseLegacyPass(profile_path));
+    } else {
+        return;
+    }
+    auto &&M = *llvm::unwrap(module);
+    std::vector< std::pair<llvm::Function *, std::string> > renamed;
+    for (auto &&f : M) {
+        auto md = f.getMetadata(SCOPES_PROFILE_NAME_MD);
+        if (!md)
+            continue;
+        auto key = llvm::cast<llvm::MDString>(md->getOperand(0))->getString();
+        renamed.push_back({ &f, f.getName().str() });
+        f.setName(key);
+    }
+    passes.run(M);
+    for (auto &&entry : renamed) {
+        entry.first->setName(entry.second);
+    }
+}
+
+// replaces the counter intrinsics with increments of a global that the JIT
+// can look up later
+static void lower_profile_counters(LLVMModuleRef module) {
+    auto &&M = *llvm::unwrap(module);
+    std::unordered_map<llvm::GlobalVariable *, llvm::GlobalVariable *> arrays;
+    std::vector<llvm::Instruction *> lowered;
+    auto i64T = llvm::Type::getInt64Ty(M.getContext());
+    for (auto &&f : M) {
+        for (auto &&bb : f) {
+            for (auto &&inst : bb) {
+                if (llvm::isa<llvm::InstrProfValueProfileInst>(&inst)) {
+                    // value profiles are not collected
+                    lowered.push_back(&inst);
+                    continue;
+                }
+                auto inc = llvm::dyn_cast<llvm::InstrProfIncrementInst>(&inst);
+                if (!inc)
+                    continue;
+                auto namevar = inc->getName();
+                auto it = arrays.find(namevar);
+                if (it == arrays.end()) {
+                    auto count = (uint32_t)inc->getNumCounters()->getZExtValue();
+                    auto arrayT = llvm::ArrayType::get(i64T, count);
+                    std::string symbol = "__scopes_prof_"
+                        + std::to_string(profile_counters.size());
+                    auto array = new llvm::GlobalVariable(M, arrayT, false,
+                        llvm::GlobalValue::ExternalLinkage,
+                        llvm::ConstantAggregateZero::get(arrayT), symbol);
+                    profile_counters.push_back({
+                        llvm::getPGOFuncNameVarInitializer(namevar).str(),
+                        inc->getHash()->getZExtValue(), symbol, count, nullptr });
+                    it = arrays.insert({namevar, array}).first;
+                }
+                llvm::IRBuilder<> builder(inc);
+                auto ptr = builder.CreateConstInBoundsGEP2_32(
+                    it->second->getValueType(), it->second, 0,
+                    (unsigned)inc->getIndex()->getZExtValue());
+                builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, ptr,
+                    inc->getStep(), llvm::MaybeAlign(8),
+                    llvm::AtomicOrdering::Monotonic);
+                lowered.push_back(inc);
+            }
+        }
+    }
+    for (auto inst : lowered) {
+        inst->eraseFromParent();
+    }
+    for (auto &&entry : arrays) {
+        if (entry.first->use_empty()) {
+            entry.first->eraseFromParent();
+        }
+    }
+}
+
+SCOPES_RESULT(void) write_profile(const String *path) {
+    SCOPES_RESULT_TYPE(void);
+    llvm::InstrProfWriter writer;
+    if (auto err = writer.setIsIRLevelProfile(true, false)) {
+        llvm::consumeError(std::move(err));
+    }
+    for (auto &&entry : profile_counters) {
+        if (!entry.counters) {
+            entry.counters = (const uint64_t *)SCOPES_GET_RESULT(
+                get_address(entry.symbol.c_str()));
+        }
+        std::vector<uint64_t> counts(entry.counters,
+            entry.counters + entry.count);
+        writer.addRecord(llvm::NamedInstrProfRecord(entry.name, entry.hash,
+            std::move(counts)), 1, [](llvm::Error err) {
+            llvm::consumeError(std::move(err));
+        });
+    }
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path->data, ec, llvm::sys::fs::OF_None);
+    if (ec) {
+        SCOPES_ERROR(CGenBackendFailed, strdup(ec.message().c_str()));
+    }
+    if (auto err = writer.write(os)) {
+        SCOPES_ERROR(CGenBackendFailed,
+            strdup(llvm::toString(std::move(err)).c_str()));
+    }
+    return {};
+}
+
 static LLVMMemoryBufferRef module_to_membuffer(LLVMModuleRef module) {
     LLVMMemoryBufferRef irbuf = nullptr;
 #if SCOPES_CACHE_KEY_BITCODE
@@ -451,11 +1017,20 @@ SCOPES_RESULT(void) add_module(LLVMModuleRef module, const PointerMap &map,
     uint64_t compiler_flags) {
     SCOPES_RESULT_TYPE(void);
 #if SCOPES_ALLOW_CACHE
-    bool cache = ((compiler_flags & CF_Cache) == CF_Cache);
+    // the counters of instrumented modules have to be registered every time,
+    // and allocation sites are anchors of the running process
+    bool cache = ((compiler_flags & CF_Cache) == CF_Cache)
+        && !(compiler_flags & (CF_ProfileGenerate | CF_ProfileAlloc));
 #else
     const bool cache = false;
 #endif
 
+    // imported before the cache key is made, so that cached objects never
+    // contain stale copies of other modules' functions
+    if (compiler_flags & CF_O3) {
+        SCOPES_CHECK_RESULT(import_inline_candidates(module, false));
+    }
+
     LLVMMemoryBufferRef irbuf = nullptr;
     LLVMMemoryBufferRef membuf = nullptr;
     if (cache) {
@@ -466,7 +1041,11 @@ SCOPES_RESULT(void) add_module(LLVMModuleRef module, const PointerMap &map,
     const char *filepath = nullptr;
     if (cache) {
         assert(irbuf);
-        key = get_cache_key(compiler_flags & SCOPES_CACHE_COMPILER_FLAGS,
+        uint64_t h = compiler_flags & SCOPES_CACHE_COMPILER_FLAGS;
+        if (compiler_flags & CF_ProfileUse) {
+            h = hash2(h, profile_hash);
+        }
+        key = get_cache_key(h,
             LLVMGetBufferStart(irbuf), LLVMGetBufferSize(irbuf));
         filepath = get_cache_file(key);
 
@@ -564,12 +1143,14 @@ SCOPES_RESULT(void) add_module(LLVMModuleRef module, const PointerMap &map,
 
         err = LLVMOrcLLJITAddObjectFile(orc, jit_dylib, membuf);
         //err = LLVMOrcAddObjectFile(orc, &newhandle, membuf, orc_symbol_resolver, ptrmap);
+        load_inline_summary(key);
         goto done;
     } else {
         goto skip_cache;
     }
 skip_cache:
     {
+        build_and_run_profile_passes(module, compiler_flags, false);
         if (compiler_flags & CF_O3) {
             Timer optimize_timer(TIMER_Optimize);
             int level = 0;
@@ -581,6 +1162,18 @@ skip_cache:
                 level = 3;
             build_and_run_opt_passes(module, level);
         }
+        // taken before emission, which prepares the module for codegen
+        auto summary = make_inline_summary(module, get_inline_threshold());
+        if (summary) {
+            if (cache) {
+                store_inline_summary(key, *summary);
+            }
+            add_inline_summary(std::move(summary));
+        }
+
+        if (compiler_flags & CF_ProfileGenerate) {
+            lower_profile_counters(module);
+        }
 
         auto target_machine = get_jit_target_machine();
         assert(target_machine);
@@ -659,6 +1252,19 @@ void init_llvm() {
     LLVMInitializeWebAssemblyAsmParser();
     LLVMInitializeWebAssemblyDisassembler();
 
+    // report which loops were vectorized, and why others were not; the
+    // remarks carry source locations when debug info is generated
+    if (getenv("SCOPES_LOOP_REMARKS")) {
+        const char *args[] = {
+            "scopes",
+            "-pass-remarks=loop-vectorize",
+            "-pass-remarks-missed=loop-vectorize",
+            "-pass-remarks-analysis=loop-vectorize",
+        };
+        LLVMParseCommandLineOptions(4, args, nullptr);
+        loop_remarks = true;
+    }
+
 #ifdef SCOPES_WIN32
     // from mingwex.a
     LLVMAddSymbol("ldexpl", (void *)&ldexpl);
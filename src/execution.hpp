@@ -36,8 +36,36 @@ SCOPES_RESULT(uint64_t) get_address(const char *name);
 void *local_aware_dlsym(Symbol name);
 LLVMTargetMachineRef get_jit_target_machine();
 LLVMTargetMachineRef get_object_target_machine();
+// selects the CPU that JIT and host objects are generated for; must be
+// called before init_execution. "host" or null detects the host CPU.
+// objects only use the selection if it was made explicitly.
+void set_target_cpu(const char *cpu);
+const char *get_target_cpu();
+const char *get_target_features();
+void get_target_cpu_for_triple(const char *triple,
+    const char *&cpu, const char *&features);
 SCOPES_RESULT(void) add_object(const char *path);
 void build_and_run_opt_passes(LLVMModuleRef module, int opt_level);
+// metadata kind of the name that a function's profile is keyed by
+#define SCOPES_PROFILE_NAME_MD "scopes.profile_name"
+// instruments the module for CF_ProfileGenerate or applies the selected
+// profile for CF_ProfileUse; runs before build_and_run_opt_passes
+void build_and_run_profile_passes(LLVMModuleRef module, uint64_t flags,
+    bool object);
+// selects the indexed profile that CF_ProfileUse applies
+SCOPES_RESULT(void) set_profile(const String *path);
+// writes the counters of all modules compiled with CF_ProfileGenerate to an
+// indexed profile
+SCOPES_RESULT(void) write_profile(const String *path);
+// keeps the bitcode of an imported C module, so that its functions can be
+// linked into the modules that call them and inlined there
+void add_c_bitcode(LLVMModuleRef module);
+// links definitions of functions that the module calls from earlier modules
+// and C bitcode into it, before it is optimized. objects only link C bitcode,
+// as linkonce_odr.
+SCOPES_RESULT(void) import_inline_candidates(LLVMModuleRef module, bool object);
+// true if SCOPES_LOOP_REMARKS asked for the remarks of the loop vectorizer
+bool loop_remarks_enabled();
 void print_disassembly(std::string symbol, void *pfunc);
 void enable_disassembly(bool enable);
 
@@ -19,6 +19,7 @@
 #include "compiler_flags.hpp"
 #include "prover.hpp"
 #include "hash.hpp"
+#include "profiler.hpp"
 #include "qualifiers.hpp"
 #include "qualifier.inc"
 #include "verify_tools.inc"
@@ -45,6 +46,18 @@
 //#include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/Analysis/ModuleSummaryAnalysis.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/LTO/LTO.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
 //#include "llvm/Support/Timer.h"
 //#include "llvm/Support/raw_os_ostream.h"
 
@@ -164,6 +177,8 @@ struct LLVMIRGenerator {
         libc_acosh_f64,
         libc_atanh_f32,
         libc_atanh_f64,
+        scopes_alloc_malloc,
+        scopes_alloc_free,
 
         NumIntrinsics,
     };
@@ -273,8 +288,11 @@ struct LLVMIRGenerator {
     //static LLVMAttributeRef attr_byval;
     static LLVMAttributeRef attr_sret;
     static LLVMAttributeRef attr_nonnull;
+    static LLVMAttributeRef attr_noalias;
     static unsigned attr_kind_sret;
     static unsigned attr_kind_byval;
+    static unsigned attr_kind_align;
+    static unsigned md_kind_loop;
     LLVMValueRef intrinsics[NumIntrinsics];
 
     // polymorphic intrinsics
@@ -313,9 +331,17 @@ struct LLVMIRGenerator {
     bool use_debug_info = true;
     bool generate_object = false;
     bool serialize_pointers = false;
+    // route Malloc and Free through the allocation profiler
+    bool profile_alloc = false;
+    // attach the stable names that profiles are keyed by
+    bool profile_names = false;
     FunctionRef active_function;
     FunctionRef entry_function;
+    // Alloca and Malloc results of the active function
+    std::vector<LLVMValueRef> local_allocations;
     std::vector<LLVMValueRef> generated_symbols;
+    // anchors of the functions in generated_symbols
+    std::vector<const Anchor *> generated_anchors;
 
     PointerMap pointer_map;
 
@@ -381,6 +407,9 @@ struct LLVMIRGenerator {
         LoopLabelRef loop;
         LLVMBasicBlockRef bb_loop;
         LLVMValueRefs repeat_values;
+        // backedges and the hints that are attached to them
+        LLVMValueRefs repeats;
+        std::vector< std::pair<Symbol, uint64_t> > hints;
 
         LoopInfo() :
             bb_loop(nullptr)
@@ -483,7 +512,11 @@ struct LLVMIRGenerator {
         switch(LLVMGetDiagInfoSeverity(info)) {
         case LLVMDSError: severity = "Error"; break;
         case LLVMDSWarning: severity = "Warning"; break;
-        case LLVMDSRemark: return;// severity = "Remark"; break;
+        case LLVMDSRemark: {
+            if (!loop_remarks_enabled())
+                return;
+            severity = "Remark";
+        } break;
         case LLVMDSNote: return;//severity = "Note"; break;
         default: break;
         }
@@ -601,6 +634,9 @@ struct LLVMIRGenerator {
             LLVM_INTRINSIC_IMPL(libc_atanh_f32, f32T, "atanhf", f32T)
             LLVM_INTRINSIC_IMPL(libc_atanh_f64, f64T, "atanh", f64T)
 
+            LLVM_INTRINSIC_IMPL(scopes_alloc_malloc, rawstringT, "sc_alloc_profile_malloc", i64T, rawstringT)
+            LLVM_INTRINSIC_IMPL(scopes_alloc_free, voidT, "sc_alloc_profile_free", rawstringT)
+
             LLVM_INTRINSIC_IMPL_BEGIN(custom_fsign_f32, f32T, "custom.fsign.f32", f32T)
                 // (0 < val) - (val < 0)
                 LLVMValueRef val = LLVMGetParam(result, 0);
@@ -674,8 +710,11 @@ struct LLVMIRGenerator {
         //attr_byval = get_attribute(get_attribute_kind("byval"));
         attr_sret = get_attribute(get_attribute_kind("sret"));
         attr_nonnull = get_attribute(get_attribute_kind("nonnull"));
+        attr_noalias = get_attribute(get_attribute_kind("noalias"));
         attr_kind_sret = get_attribute_kind("sret");
         attr_kind_byval = get_attribute_kind("byval");
+        attr_kind_align = get_attribute_kind("align");
+        md_kind_loop = LLVMGetMDKindID("llvm.loop", 9);
 
         LLVMContextSetDiagnosticHandler(LLVMGetGlobalContext(),
             diag_handler,
@@ -807,6 +846,88 @@ struct LLVMIRGenerator {
         return LLVMBuildStore(builder, Val, Ptr);
     }
 
+    // every allocation of a function gets an alias scope of its own, and
+    // loads and stores whose address is derived from one of them are placed
+    // in its scope and declared not to alias the others. this holds whether
+    // or not an allocation escapes, because accesses through pointers that
+    // can not be traced back to an allocation stay untagged and may alias
+    // anything. the number of scopes per function is bounded, since every
+    // access lists all the scopes it does not alias.
+    void add_alias_scopes(LLVMValueRef func) {
+        const size_t MaxScopes = 64;
+        if (local_allocations.size() < 2)
+            return;
+        if (local_allocations.size() > MaxScopes) {
+            local_allocations.resize(MaxScopes);
+        }
+        auto F = llvm::unwrap<llvm::Function>(func);
+        auto &ctx = F->getContext();
+        llvm::MDBuilder mdb(ctx);
+        auto domain = mdb.createAnonymousAliasScopeDomain(F->getName());
+        std::unordered_map<const llvm::Value *, size_t> indices;
+        std::vector<llvm::Metadata *> scopes;
+        for (auto val : local_allocations) {
+            auto base = llvm::getUnderlyingObject(llvm::unwrap(val));
+            if (indices.count(base))
+                continue;
+            indices.insert({base, scopes.size()});
+            scopes.push_back(mdb.createAnonymousAliasScope(domain));
+        }
+        if (scopes.size() < 2)
+            return;
+        std::vector<llvm::MDNode *> scope_lists;
+        std::vector<llvm::MDNode *> noalias_lists;
+        for (size_t i = 0; i < scopes.size(); ++i) {
+            scope_lists.push_back(llvm::MDNode::get(ctx, { scopes[i] }));
+            std::vector<llvm::Metadata *> others;
+            for (size_t k = 0; k < scopes.size(); ++k) {
+                if (k != i)
+                    others.push_back(scopes[k]);
+            }
+            noalias_lists.push_back(llvm::MDNode::get(ctx, others));
+        }
+        for (auto &&bb : *F) {
+            for (auto &&inst : bb) {
+                const llvm::Value *ptr = nullptr;
+                if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+                    ptr = load->getPointerOperand();
+                } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+                    ptr = store->getPointerOperand();
+                } else {
+                    continue;
+                }
+                auto it = indices.find(llvm::getUnderlyingObject(ptr));
+                if (it == indices.end())
+                    continue;
+                inst.setMetadata(llvm::LLVMContext::MD_alias_scope,
+                    scope_lists[it->second]);
+                inst.setMetadata(llvm::LLVMContext::MD_noalias,
+                    noalias_lists[it->second]);
+            }
+        }
+    }
+
+    // references are never null. they are not marked dereferenceable, since
+    // LLVM assumes that for the whole function, and a callee can release the
+    // memory behind a reference, e.g. by growing the array an element
+    // reference points into. unique values are not marked noalias, since
+    // uniqueness only says that the handle is owned; clones of an Rc share
+    // the memory they point to.
+    SCOPES_RESULT(void) add_pointer_attributes(LLVMValueRef func, unsigned index,
+        const Type *T) {
+        SCOPES_RESULT_TYPE(void);
+        auto ST = strip_qualifiers(T);
+        if (try_qualifier<ReferQualifier>(T)) {
+            LLVMAddAttributeAtIndex(func, index, attr_nonnull);
+            if (!is_opaque(ST) && SCOPES_GET_RESULT(size_of(ST))) {
+                LLVMAddAttributeAtIndex(func, index,
+                    get_attribute(attr_kind_align,
+                        SCOPES_GET_RESULT(align_of(ST))));
+            }
+        }
+        return {};
+    }
+
     SCOPES_RESULT(LLVMValueRef) abi_import_argument(const Type *param_type, LLVMValueRef func, size_t &k) {
         SCOPES_RESULT_TYPE(LLVMValueRef);
         ABIClass classes[MAX_ABI_CLASSES];
@@ -1380,6 +1501,7 @@ struct LLVMIRGenerator {
         auto bb = LLVMAppendBasicBlock(func, "");
 
         try_info.clear();
+        local_allocations.clear();
 
         if (!node->raises.empty()) {
             try_info.bb_except = LLVMAppendBasicBlock(func, "except");
@@ -1400,6 +1522,7 @@ struct LLVMIRGenerator {
         if (use_sret) {
             LLVMAddAttributeAtIndex(func, 1,
                 get_type_attribute(attr_kind_sret, SCOPES_GET_RESULT(_type_to_llvm_type(rtype))));
+            LLVMAddAttributeAtIndex(func, 1, attr_noalias);
             offset++;
             //Parameter *param = params[0];
             //bind(param, LLVMGetParam(func, 0));
@@ -1412,7 +1535,12 @@ struct LLVMIRGenerator {
         size_t k = offset;
         for (size_t i = 0; i < paramcount; ++i) {
             ParameterRef param = params[i];
+            size_t argindex = k;
             LLVMValueRef val = SCOPES_GET_RESULT(abi_import_argument(param->get_type(), func, k));
+            if ((k == argindex + 1) && (val == LLVMGetParam(func, argindex))) {
+                SCOPES_CHECK_RESULT(add_pointer_attributes(func, argindex + 1,
+                    param->get_type()));
+            }
 #if SCOPES_LLVM_EXTENDED_DEBUG_INFO
             if (use_debug_info) {
                 auto subprogram = LLVMGetSubprogram(func);
@@ -1435,6 +1563,7 @@ struct LLVMIRGenerator {
             bind(ValueIndex(param), val);
         }
         SCOPES_CHECK_RESULT(translate_block(node->body));
+        add_alias_scopes(func);
 #if SCOPES_LLVM_EXTENDED_DEBUG_INFO
         if (use_debug_info) {
             current_debug_block = nullptr;
@@ -1443,6 +1572,48 @@ struct LLVMIRGenerator {
         return {};
     }
 
+    static void stream_function_signature(StyledString &ss,
+        const FunctionRef &node, const FunctionType *ilfunctype) {
+        auto funcname = node->name;
+        if (funcname == SYM_Unnamed) {
+            ss.out << "unnamed";
+        } else {
+            ss.out << funcname.name()->data;
+        }
+
+        ss.out << "<";
+        int index = 0;
+        for (auto T : ilfunctype->argument_types) {
+            if (index > 0)
+                ss.out << ",";
+            stream_type_name(ss.out, T);
+            index++;
+        }
+        ss.out << ">";
+    }
+
+    // the symbol names of functions depend on the order in which they are
+    // compiled, so profiles use the function name, its argument types and
+    // a hash of its anchor instead
+    void set_profile_name(LLVMValueRef func, const FunctionRef &node,
+        const FunctionType *ilfunctype) {
+        auto anchor = node.anchor();
+        auto path = anchor->path.name();
+        uint64_t h = hash2(hash_bytes(path->data, path->count),
+            hash2(anchor->lineno, anchor->column));
+        StyledString ss = StyledString::plain();
+        stream_function_signature(ss, node, ilfunctype);
+        ss.out << "@" << std::hex << h << std::dec;
+        auto key = ss.cppstr();
+        auto context = LLVMGetGlobalContext();
+        LLVMMetadataRef str = LLVMMDStringInContext2(context,
+            key.c_str(), key.size());
+        LLVMGlobalSetMetadata(func,
+            LLVMGetMDKindID(SCOPES_PROFILE_NAME_MD,
+                sizeof(SCOPES_PROFILE_NAME_MD) - 1),
+            LLVMMDNodeInContext2(context, &str, 1));
+    }
+
     SCOPES_RESULT(LLVMValueRef) Function_to_value(const FunctionRef &node) {
         SCOPES_RESULT_TYPE(LLVMValueRef);
 
@@ -1462,23 +1633,8 @@ struct LLVMIRGenerator {
         } else {
             auto it = func_cache.find(node.unref());
             if (it == func_cache.end()) {
-                auto funcname = node->name;
                 StyledString ss = StyledString::plain();
-                if (funcname == SYM_Unnamed) {
-                    ss.out << "unnamed";
-                } else {
-                    ss.out << funcname.name()->data;
-                }
-
-                ss.out << "<";
-                int index = 0;
-                for (auto T : ilfunctype->argument_types) {
-                    if (index > 0)
-                        ss.out << ",";
-                    stream_type_name(ss.out, T);
-                    index++;
-                }
-                ss.out << ">";
+                stream_function_signature(ss, node, ilfunctype);
                 ss.out << get_func_pointer_id(node.unref());
                 name = ss.cppstr();
 
@@ -1498,10 +1654,23 @@ struct LLVMIRGenerator {
 
         assert(func);
         generated_symbols.push_back(func);
+        generated_anchors.push_back(node.anchor());
+
+        if (profiler_frame_pointers()) {
+            // the sampling profiler walks the stack along frame pointers
+            static const char kind[] = "frame-pointer";
+            static const char value[] = "all";
+            LLVMAddAttributeAtIndex(func, LLVMAttributeFunctionIndex,
+                LLVMCreateStringAttribute(LLVMGetGlobalContext(),
+                    kind, sizeof(kind) - 1, value, sizeof(value) - 1));
+        }
 
         if (use_debug_info) {
             LLVMSetSubprogram(func, function_to_subprogram(node));
         }
+        if (profile_names && !is_export) {
+            set_profile_name(func, node, ilfunctype);
+        }
         if (is_export) {
             LLVMSetLinkage(func, LLVMExternalLinkage);
             //LLVMSetDLLStorageClass(func, LLVMDLLExportStorageClass);
@@ -1616,7 +1785,7 @@ struct LLVMIRGenerator {
     SCOPES_RESULT(void) translate_Repeat(const RepeatRef &node) {
         SCOPES_RESULT_TYPE(void);
         SCOPES_CHECK_RESULT(build_merge_phi(loop_info.repeat_values, node->values));
-        LLVMBuildBr(builder, loop_info.bb_loop);
+        loop_info.repeats.push_back(LLVMBuildBr(builder, loop_info.bb_loop));
         return {};
     }
 
@@ -1684,6 +1853,8 @@ struct LLVMIRGenerator {
         LLVMValueRef func = LLVMGetBasicBlockParent(bb);
         loop_info.bb_loop = LLVMAppendBasicBlock(func, "loop");
         loop_info.repeat_values.clear();
+        loop_info.repeats.clear();
+        loop_info.hints.clear();
         position_builder_at_end(loop_info.bb_loop);
         SCOPES_CHECK_RESULT(build_phi(loop_info.repeat_values, node->args));
         position_builder_at_end(bb);
@@ -1691,10 +1862,56 @@ struct LLVMIRGenerator {
         LLVMBuildBr(builder, loop_info.bb_loop);
         position_builder_at_end(loop_info.bb_loop);
         SCOPES_CHECK_RESULT(translate_block(node->body));
+        if (!loop_info.hints.empty()) {
+            auto loopid = build_loop_id(loop_info.hints);
+            for (auto br : loop_info.repeats) {
+                LLVMSetMetadata(br, md_kind_loop, loopid);
+            }
+        }
         loop_info = old_loop_info;
         return {};
     }
 
+    // translates loop hints to a llvm.loop node, whose first operand
+    // refers to itself
+    LLVMValueRef build_loop_id(const std::vector< std::pair<Symbol, uint64_t> > &hints) {
+        auto ctx = LLVMGetGlobalContext();
+        auto i1M = [&](uint64_t value) {
+            return LLVMValueAsMetadata(LLVMConstInt(i1T, value?1:0, false));
+        };
+        auto i32M = [&](uint64_t value) {
+            return LLVMValueAsMetadata(LLVMConstInt(i32T, value, false));
+        };
+        std::vector<LLVMMetadataRef> ops;
+        auto self = LLVMTemporaryMDNode(ctx, nullptr, 0);
+        ops.push_back(self);
+        for (auto &&hint : hints) {
+            const char *name = nullptr;
+            LLVMMetadataRef value = nullptr;
+            if (!hint.first.is_known())
+                continue;
+            switch(hint.first.known_value()) {
+            case SYM_Vectorize:
+                name = "llvm.loop.vectorize.enable"; value = i1M(hint.second); break;
+            case SYM_VectorizeWidth:
+                name = "llvm.loop.vectorize.width"; value = i32M(hint.second); break;
+            case SYM_InterleaveCount:
+                name = "llvm.loop.interleave.count"; value = i32M(hint.second); break;
+            case SYM_UnrollCount:
+                name = "llvm.loop.unroll.count"; value = i32M(hint.second); break;
+            case SYM_Distribute:
+                name = "llvm.loop.distribute.enable"; value = i1M(hint.second); break;
+            default: continue;
+            }
+            LLVMMetadataRef node[] = {
+                LLVMMDStringInContext2(ctx, name, strlen(name)), value };
+            ops.push_back(LLVMMDNodeInContext2(ctx, node, 2));
+        }
+        auto loopid = LLVMMDNodeInContext2(ctx, &ops[0], ops.size());
+        LLVMMetadataReplaceAllUsesWith(self, loopid);
+        return LLVMMetadataAsValue(ctx, loopid);
+    }
+
     LLVMValueRef values_to_struct(LLVMTypeRef T, const LLVMValueRefs &values) {
         int count = (int)values.size();
         if (count == 1) {
@@ -1913,6 +2130,7 @@ struct LLVMIRGenerator {
         } else {
             val = safe_alloca(ty);
         }
+        local_allocations.push_back(val);
 #if SCOPES_LLVM_EXTENDED_DEBUG_INFO
         if (use_debug_info) {
             LLVMBasicBlockRef bb = LLVMGetInsertBlock(builder);
@@ -1936,20 +2154,42 @@ struct LLVMIRGenerator {
         SCOPES_RESULT_TYPE(void);
         auto ty = SCOPES_GET_RESULT(type_to_llvm_type(node->type));
         LLVMValueRef val;
-        if (node->is_array()) {
+        if (profile_alloc) {
+            LLVMValueRef size = LLVMSizeOf(ty);
+            if (node->is_array()) {
+                auto count = SCOPES_GET_RESULT(ref_to_value(node->count));
+                size = LLVMBuildMul(builder, size,
+                    LLVMBuildIntCast2(builder, count, i64T, false, ""), "");
+            }
+            // the anchor of the instruction identifies the allocation site
+            LLVMValueRef site = LLVMConstIntToPtr(
+                LLVMConstInt(i64T, (uint64_t)node.anchor(), false), rawstringT);
+            LLVMValueRef values[] = { size, site };
+            val = LLVMBuildCall(builder,
+                get_intrinsic(scopes_alloc_malloc), values, 2, "");
+            val = LLVMBuildBitCast(builder, val, LLVMPointerType(ty, 0), "");
+        } else if (node->is_array()) {
             auto count = SCOPES_GET_RESULT(ref_to_value(node->count));
             val = LLVMBuildArrayMalloc(builder, ty, count, "");
         } else {
             val = LLVMBuildMalloc(builder, ty, "");
         }
+        local_allocations.push_back(val);
         map_phi({ val }, node);
         return {};
     }
 
     SCOPES_RESULT(void) translate_Free(const FreeRef &node) {
         SCOPES_RESULT_TYPE(void);
-        LLVMBuildFree(builder,
-            SCOPES_GET_RESULT(ref_to_value(node->value)));
+        auto val = SCOPES_GET_RESULT(ref_to_value(node->value));
+        if (profile_alloc) {
+            LLVMValueRef values[] = {
+                LLVMBuildBitCast(builder, val, rawstringT, "") };
+            LLVMBuildCall(builder,
+                get_intrinsic(scopes_alloc_free), values, 1, "");
+        } else {
+            LLVMBuildFree(builder, val);
+        }
         return {};
     }
 
@@ -2027,6 +2267,17 @@ struct LLVMIRGenerator {
     }
 
     SCOPES_RESULT(void) translate_Annotate(const AnnotateRef &node) {
+        SCOPES_RESULT_TYPE(void);
+        // (annotate 'loop-hint key value) applies to the innermost loop
+        auto &&values = node->values;
+        if (loop_info.loop
+            && (values.size() == 3)
+            && (strip_qualifiers(values[0]->get_type()) == TYPE_Symbol)
+            && (SCOPES_GET_RESULT(extract_symbol_constant(values[0])) == SYM_LoopHint)) {
+            auto key = SCOPES_GET_RESULT(extract_symbol_constant(values[1]));
+            auto value = SCOPES_GET_RESULT(extract_integer_constant(values[2]));
+            loop_info.hints.push_back({ key, value });
+        }
         return {};
     }
 
@@ -3255,14 +3506,38 @@ LLVMValueRef LLVMIRGenerator::trueV = nullptr;
 //LLVMAttributeRef LLVMIRGenerator::attr_byval = nullptr;
 LLVMAttributeRef LLVMIRGenerator::attr_sret = nullptr;
 LLVMAttributeRef LLVMIRGenerator::attr_nonnull = nullptr;
+LLVMAttributeRef LLVMIRGenerator::attr_noalias = nullptr;
 unsigned LLVMIRGenerator::attr_kind_sret = 0;
 unsigned LLVMIRGenerator::attr_kind_byval = 0;
+unsigned LLVMIRGenerator::attr_kind_align = 0;
+unsigned LLVMIRGenerator::md_kind_loop = 0;
 
 //------------------------------------------------------------------------------
 // IL COMPILER
 //------------------------------------------------------------------------------
 
 
+// writes bitcode along with the module summary that the thin LTO backend uses
+// to import functions across modules
+static const char *write_thin_bitcode(LLVMModuleRef module, const char *path) {
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_None);
+    if (ec) {
+        return strdup(ec.message().c_str());
+    }
+    auto &&M = *llvm::unwrap(module);
+    llvm::ProfileSummaryInfo psi(M);
+    auto index = llvm::buildModuleSummaryIndex(M, nullptr, &psi);
+    llvm::WriteBitcodeToFile(M, os, false, &index);
+    os.close();
+    if (os.has_error()) {
+        auto msg = os.error().message();
+        os.clear_error();
+        return strdup(msg.c_str());
+    }
+    return nullptr;
+}
+
 SCOPES_RESULT(void) compile_object(const String *triple,
     CompilerFileKind kind, const String *path, const Scope *scope, uint64_t flags) {
     SCOPES_RESULT_TYPE(void);
@@ -3273,6 +3548,9 @@ SCOPES_RESULT(void) compile_object(const String *triple,
     if (flags & CF_NoDebugInfo) {
         ctx.use_debug_info = false;
     }
+    if (flags & (CF_ProfileGenerate | CF_ProfileUse)) {
+        ctx.profile_names = true;
+    }
 
     LLVMModuleRef module;
     {
@@ -3280,7 +3558,10 @@ SCOPES_RESULT(void) compile_object(const String *triple,
         module = SCOPES_GET_RESULT(ctx.generate(path, scope));
     }
 
+    build_and_run_profile_passes(module, flags, true);
     if (flags & CF_O3) {
+        // link C bitcode before optimizing, so that its functions can be inlined
+        SCOPES_CHECK_RESULT(import_inline_candidates(module, true));
         Timer optimize_timer(TIMER_Optimize);
         int level = 0;
         if ((flags & CF_O3) == CF_O1)
@@ -3305,8 +3586,11 @@ SCOPES_RESULT(void) compile_object(const String *triple,
     if (LLVMGetTargetFromTriple(triplestr, &target, &error_message)) {
         SCOPES_ERROR(CGenBackendFailed, error_message);
     }
+    const char *cpu = nullptr;
+    const char *features = nullptr;
+    get_target_cpu_for_triple(triplestr, cpu, features);
     // code model must be JIT default for reasons beyond my comprehension
-    auto tm = LLVMCreateTargetMachine(target, triplestr, nullptr, nullptr,
+    auto tm = LLVMCreateTargetMachine(target, triplestr, cpu, features,
         LLVMCodeGenLevelDefault, LLVMRelocPIC, LLVMCodeModelJITDefault);
     assert(tm);
 
@@ -3327,6 +3611,15 @@ SCOPES_RESULT(void) compile_object(const String *triple,
     case CFK_LLVM: {
         failed = LLVMPrintModuleToFile(module, path_cstr, &error_message);
     } break;
+    case CFK_ThinBC: {
+        // the backend targets whatever the bitcode itself names
+        LLVMSetTarget(module, triplestr);
+        auto layout = LLVMCreateTargetDataLayout(tm);
+        LLVMSetModuleDataLayout(module, layout);
+        LLVMDisposeTargetData(layout);
+        error_message = (char *)write_thin_bitcode(module, path_cstr);
+        failed = (error_message != nullptr);
+    } break;
     default: {
         free(path_cstr);
         SCOPES_ERROR(CGenBackendFailed, "unknown file kind");
@@ -3339,6 +3632,137 @@ SCOPES_RESULT(void) compile_object(const String *triple,
     return {};
 }
 
+static const char *lto_error(const String *path, const std::string &msg) {
+    return strdup((std::string(path->data) + ": " + msg).c_str());
+}
+
+SCOPES_RESULT(void) link_objects(const std::vector<const String *> &inputs,
+    const std::vector<const String *> &outputs, const Scope *exports,
+    uint64_t flags) {
+    SCOPES_RESULT_TYPE(void);
+    Timer sum_compile_time(TIMER_Compile);
+    assert(inputs.size() == outputs.size());
+    if (inputs.empty())
+        return {};
+
+    std::vector< std::unique_ptr<llvm::MemoryBuffer> > buffers;
+    std::vector< std::unique_ptr<llvm::lto::InputFile> > files;
+    for (auto path : inputs) {
+        auto buffer = llvm::MemoryBuffer::getFile(path->data);
+        if (!buffer) {
+            SCOPES_ERROR(CGenBackendFailed,
+                lto_error(path, buffer.getError().message()));
+        }
+        auto ref = (*buffer)->getMemBufferRef();
+        auto info = llvm::getBitcodeLTOInfo(ref);
+        if (!info) {
+            SCOPES_ERROR(CGenBackendFailed,
+                lto_error(path, llvm::toString(info.takeError())));
+        }
+        if (!info->IsThinLTO) {
+            SCOPES_ERROR(CGenBackendFailed,
+                lto_error(path, "bitcode has no module summary"));
+        }
+        auto file = llvm::lto::InputFile::create(ref);
+        if (!file) {
+            SCOPES_ERROR(CGenBackendFailed,
+                lto_error(path, llvm::toString(file.takeError())));
+        }
+        files.push_back(std::move(*file));
+        buffers.push_back(std::move(*buffer));
+    }
+    // the backend can not report errors from its output streams, so the
+    // outputs are checked in advance
+    for (auto path : outputs) {
+        std::error_code ec;
+        llvm::raw_fd_ostream os(path->data, ec, llvm::sys::fs::OF_None);
+        if (ec) {
+            SCOPES_ERROR(CGenBackendFailed, lto_error(path, ec.message()));
+        }
+    }
+
+    llvm::lto::Config conf;
+    auto triple = files.front()->getTargetTriple();
+    const char *cpu = nullptr;
+    const char *features = nullptr;
+    get_target_cpu_for_triple(triple.c_str(), cpu, features);
+    if (cpu) {
+        conf.CPU = cpu;
+    }
+    if (features) {
+        llvm::SmallVector<llvm::StringRef, 16> attrs;
+        llvm::StringRef(features).split(attrs, ",", -1, false);
+        for (auto attr : attrs) {
+            conf.MAttrs.push_back(attr.str());
+        }
+    }
+    conf.RelocModel = llvm::Reloc::PIC_;
+    switch(flags & CF_O3) {
+    case CF_O1: conf.OptLevel = 1; break;
+    case CF_O3: conf.OptLevel = 3; break;
+    default: conf.OptLevel = 2; break;
+    }
+    conf.DiagHandler = [](const llvm::DiagnosticInfo &info) {
+        llvm::DiagnosticPrinterRawOStream printer(llvm::errs());
+        info.print(printer);
+        llvm::errs() << "\n";
+    };
+
+    llvm::lto::LTO lto(std::move(conf),
+        llvm::lto::createInProcessThinBackend(
+            llvm::heavyweight_hardware_concurrency()));
+    llvm::StringSet<> exported;
+    const Scope *t = exports;
+    while (t) {
+        auto it = sc_scope_next(t, -1);
+        while (it._2 != -1) {
+            auto key = it._0.cast<Const>();
+            if (key->get_type() == TYPE_Symbol) {
+                Symbol name = Symbol::wrap(key.cast<ConstInt>()->value());
+                exported.insert(name.name()->data);
+            }
+            it = sc_scope_next(t, it._2);
+        }
+        t = t->parent();
+    }
+
+    llvm::StringSet<> defined;
+    for (size_t k = 0; k < files.size(); ++k) {
+        auto symbols = files[k]->symbols();
+        std::vector<llvm::lto::SymbolResolution> resolutions(symbols.size());
+        size_t i = 0;
+        for (auto &&sym : symbols) {
+            auto &&res = resolutions[i++];
+            // the first definition wins, as it would with a regular linker
+            if (!sym.isUndefined()) {
+                res.Prevailing = defined.insert(sym.getName()).second;
+            }
+            // other definitions are only kept as far as the inputs need
+            // them, with hidden visibility
+            res.VisibleToRegularObj = exported.count(sym.getName()) != 0;
+        }
+        if (auto err = lto.add(std::move(files[k]), resolutions)) {
+            SCOPES_ERROR(CGenBackendFailed,
+                lto_error(inputs[k], llvm::toString(std::move(err))));
+        }
+    }
+
+    // task 0 is the regular LTO partition, which stays empty; thin LTO tasks
+    // follow in the order in which the inputs were added
+    auto add_stream = [&](unsigned task) {
+        assert((task > 0) && (task <= outputs.size()));
+        std::error_code ec;
+        auto os = std::make_unique<llvm::raw_fd_ostream>(
+            outputs[task - 1]->data, ec, llvm::sys::fs::OF_None);
+        return std::make_unique<llvm::lto::NativeObjectStream>(std::move(os));
+    };
+    if (auto err = lto.run(add_stream)) {
+        SCOPES_ERROR(CGenBackendFailed,
+            strdup(llvm::toString(std::move(err)).c_str()));
+    }
+    return {};
+}
+
 SCOPES_RESULT(ConstPointerRef) compile(const FunctionRef &fn, uint64_t flags) {
     SCOPES_RESULT_TYPE(ConstPointerRef);
     Timer sum_compile_time(TIMER_Compile);
@@ -3350,6 +3774,9 @@ SCOPES_RESULT(ConstPointerRef) compile(const FunctionRef &fn, uint64_t flags) {
         //flags |= CF_O0;
         flags |= CF_Cache;
     }
+    if (alloc_profile_everything()) {
+        flags |= CF_ProfileAlloc;
+    }
 
     /*
     const Type *functype = pointer_type(
@@ -3367,6 +3794,12 @@ SCOPES_RESULT(ConstPointerRef) compile(const FunctionRef &fn, uint64_t flags) {
     if (flags & CF_NoDebugInfo) {
         ctx.use_debug_info = false;
     }
+    if (flags & CF_ProfileAlloc) {
+        ctx.profile_alloc = true;
+    }
+    if (flags & (CF_ProfileGenerate | CF_ProfileUse)) {
+        ctx.profile_names = true;
+    }
 
     LLVMIRGenerator::ModuleValuePair result;
     {
@@ -3401,6 +3834,7 @@ SCOPES_RESULT(ConstPointerRef) compile(const FunctionRef &fn, uint64_t flags) {
 
 #if 1
     std::vector< std::string > bindsyms;
+    std::vector< const Anchor * > bindanchors = ctx.generated_anchors;
     for (auto sym : ctx.generated_symbols) {
         size_t length = 0;
         const char *name = LLVMGetValueName2(sym, &length);
@@ -3421,9 +3855,11 @@ SCOPES_RESULT(ConstPointerRef) compile(const FunctionRef &fn, uint64_t flags) {
     }
 
 #if 1
-    for (auto sym : bindsyms) {
+    for (size_t i = 0; i < bindsyms.size(); ++i) {
+        auto &&sym = bindsyms[i];
         void *ptr = (void *)SCOPES_GET_RESULT(get_address(sym.c_str()));
         set_address_name(ptr, String::from(sym.c_str(), sym.size()));
+        set_function_anchor(ptr, bindanchors[i]);
     }
 #endif
 
@@ -11,6 +11,7 @@
 #include "valueref.inc"
 
 #include <stdint.h>
+#include <vector>
 
 namespace scopes {
 
@@ -24,6 +25,7 @@ struct Scope;
     T(CFK_ASM, "compiler-file-kind-asm") \
     T(CFK_BC, "compiler-file-kind-bc") \
     T(CFK_LLVM, "compiler-file-kind-llvm") \
+    T(CFK_ThinBC, "compiler-file-kind-thin-bc") \
 
 enum CompilerFileKind {
 #define T(NAME, KNAME) NAME,
@@ -33,6 +35,12 @@ SCOPES_COMPILER_FILE_KIND()
 
 SCOPES_RESULT(void) compile_object(const String *triple,
     CompilerFileKind kind, const String *path, const Scope *scope, uint64_t flags);
+// runs the thin LTO backend over bitcode files written with CFK_ThinBC and
+// writes one native object per input to the matching output path; only the
+// symbols named by the keys of `exports` remain visible to other objects
+SCOPES_RESULT(void) link_objects(const std::vector<const String *> &inputs,
+    const std::vector<const String *> &outputs, const Scope *exports,
+    uint64_t flags);
 SCOPES_RESULT(ConstPointerRef) compile(const FunctionRef &fn, uint64_t flags);
 
 } // namespace scopes
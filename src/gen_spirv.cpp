@@ -18,6 +18,8 @@
 #include "compiler_flags.hpp"
 #include "prover.hpp"
 #include "hash.hpp"
+#include "cache.hpp"
+#include "scopes/config.h"
 #include "qualifiers.hpp"
 #include "qualifier.inc"
 #include "verify_tools.inc"
@@ -32,6 +34,9 @@
 
 #include "dyn_cast.inc"
 
+#include <atomic>
+#include <thread>
+
 #pragma GCC diagnostic ignored "-Wvla-extension"
 
 namespace scopes {
@@ -178,11 +183,12 @@ static void format_spv_location(StyledStream &ss, const char* source,
     ss << ":" << Style_None << " ";
 }
 
-static SCOPES_RESULT(void) verify_spirv(spv_target_env env, std::vector<unsigned int> &contents) {
-    SCOPES_RESULT_TYPE(void);
+// validates a module and writes diagnostics to ss; touches no compiler
+// state, so that batches can be validated on worker threads.
+static bool validate_spirv(spv_target_env env,
+    const std::vector<unsigned int> &contents, StyledString &ss) {
     //spvtools::ValidatorOptions options;
 
-    StyledString ss;
     spvtools::SpirvTools tools(env);
     tools.SetMessageConsumer([&ss](spv_message_level_t level, const char* source,
                                 const spv_position_t& position,
@@ -210,8 +216,13 @@ static SCOPES_RESULT(void) verify_spirv(spv_target_env env, std::vector<unsigned
         }
     });
 
-    bool succeed = tools.Validate(contents);
-    if (!succeed) {
+    return tools.Validate(contents);
+}
+
+static SCOPES_RESULT(void) verify_spirv(spv_target_env env, std::vector<unsigned int> &contents) {
+    SCOPES_RESULT_TYPE(void);
+    StyledString ss;
+    if (!validate_spirv(env, contents, ss)) {
         disassemble_spirv(contents, true);
         SCOPES_CERR << ss._ss.str();
         SCOPES_ERROR(CGenBackendValidationFailed);
@@ -252,6 +263,8 @@ struct SPIRVGenerator {
     spv_target_env env;
     int version;
     bool use_combined_image_samplers = false;
+    // batches validate the module later on a worker thread
+    bool verify_output = true;
 
     spv::Id get_op_ex(Symbol name) {
         auto it = intrinsic_ops.find(name);
@@ -2367,7 +2380,9 @@ struct SPIRVGenerator {
         }
         builder.dump(version, result);
 
-        SCOPES_CHECK_RESULT(verify_spirv(env, result));
+        if (verify_output) {
+            SCOPES_CHECK_RESULT(verify_spirv(env, result));
+        }
 
         return {};
     }
@@ -2376,8 +2391,10 @@ struct SPIRVGenerator {
 
 //------------------------------------------------------------------------------
 
-SCOPES_RESULT(void) optimize_spirv(spv_target_env env, std::vector<unsigned int> &result, int opt_level) {
-    SCOPES_RESULT_TYPE(void);
+// runs the optimizer pass list and writes diagnostics to ss; like
+// validate_spirv, this is safe to call from worker threads.
+static bool run_spirv_optimizer(spv_target_env env,
+    std::vector<unsigned int> &result, int opt_level, StyledStream &ss) {
     spvtools::Optimizer optimizer(env);
     /*
     optimizer.SetMessageConsumer([](spv_message_level_t level, const char* source,
@@ -2386,7 +2403,6 @@ SCOPES_RESULT(void) optimize_spirv(spv_target_env env, std::vector<unsigned int>
     SCOPES_CERR << StringifyMessage(level, source, position, message)
     << std::endl;
     });*/
-    StyledStream ss(SCOPES_CERR);
     optimizer.SetMessageConsumer([&ss](spv_message_level_t level, const char*,
         const spv_position_t& position,
         const char* message) {
@@ -2439,7 +2455,13 @@ SCOPES_RESULT(void) optimize_spirv(spv_target_env env, std::vector<unsigned int>
 
     std::vector<unsigned int> oldresult = result;
     result.clear();
-    if (!optimizer.Run(oldresult.data(), oldresult.size(), &result)) {
+    return optimizer.Run(oldresult.data(), oldresult.size(), &result);
+}
+
+SCOPES_RESULT(void) optimize_spirv(spv_target_env env, std::vector<unsigned int> &result, int opt_level) {
+    SCOPES_RESULT_TYPE(void);
+    StyledStream ss(SCOPES_CERR);
+    if (!run_spirv_optimizer(env, result, opt_level, ss)) {
         SCOPES_ERROR(CGenBackendOptimizationFailed);
     }
 
@@ -2447,6 +2469,50 @@ SCOPES_RESULT(void) optimize_spirv(spv_target_env env, std::vector<unsigned int>
     return {};
 }
 
+//------------------------------------------------------------------------------
+
+// SPIR-V and GLSL output is cached on disk alongside the objects of the LLVM
+// backend. the key covers the unoptimized module, which serializes the
+// structure of the function, together with the backend, target, version and
+// the compiler flags that change the output, so that optimization,
+// validation and cross-compilation are skipped for known functions.
+static const String *shader_cache_key(const char *backend, int version,
+    Symbol target, uint64_t flags, const std::vector<unsigned int> &module) {
+    auto name = target.name();
+    uint64_t h = hash_bytes(backend, strlen(backend));
+    h = hash2(h, (uint64_t)version);
+    h = hash2(h, hash_bytes(name->data, name->count));
+    h = hash2(h, flags & SCOPES_CACHE_COMPILER_FLAGS);
+    return get_cache_key(h, (const char *)module.data(),
+        sizeof(unsigned int) * module.size());
+}
+
+static const String *load_shader_cache(const String *key) {
+#if SCOPES_ALLOW_CACHE
+    auto filepath = get_cache_file(key);
+    if (filepath) {
+        return load_cache(filepath);
+    }
+#endif
+    return nullptr;
+}
+
+static void store_shader_cache(const String *key, const String *content) {
+#if SCOPES_ALLOW_CACHE
+    set_cache(key, nullptr, 0, content->data, content->count);
+#endif
+}
+
+static int spirv_opt_level(uint64_t flags) {
+    if ((flags & CF_O3) == CF_O1)
+        return 1;
+    else if ((flags & CF_O3) == CF_O2)
+        return 2;
+    else if ((flags & CF_O3) == CF_O3)
+        return 3;
+    return 0;
+}
+
 SCOPES_RESULT(const String *) compile_spirv(int version, Symbol target, const FunctionRef &fn, uint64_t flags) {
     SCOPES_RESULT_TYPE(const String *);
     Timer sum_compile_time(TIMER_CompileSPIRV);
@@ -2466,16 +2532,19 @@ SCOPES_RESULT(const String *) compile_spirv(int version, Symbol target, const Fu
             ctx.generate(result, target, fn));
     }
 
+    auto key = shader_cache_key("spirv", version, target, flags, result);
+    auto cached = load_shader_cache(key);
+    if (cached && !(cached->count % sizeof(unsigned int))) {
+        if (flags & CF_DumpDisassembly) {
+            std::vector<unsigned int> words(cached->count / sizeof(unsigned int));
+            memcpy(&words[0], cached->data, cached->count);
+            disassemble_spirv(words);
+        }
+        return cached;
+    }
 
     if (flags & CF_O3) {
-        int level = 0;
-        if ((flags & CF_O3) == CF_O1)
-            level = 1;
-        else if ((flags & CF_O3) == CF_O2)
-            level = 2;
-        else if ((flags & CF_O3) == CF_O3)
-            level = 3;
-        SCOPES_CHECK_RESULT(optimize_spirv(env, result, level));
+        SCOPES_CHECK_RESULT(optimize_spirv(env, result, spirv_opt_level(flags)));
     }
 
     if (flags & CF_DumpModule) {
@@ -2487,7 +2556,9 @@ SCOPES_RESULT(const String *) compile_spirv(int version, Symbol target, const Fu
 
     size_t bytesize = sizeof(unsigned int) * result.size();
 
-    return String::from((char *)&result[0], bytesize);
+    auto binary = String::from((char *)&result[0], bytesize);
+    store_shader_cache(key, binary);
+    return binary;
 }
 
 const String *spirv_to_glsl(const String *binary) {
@@ -2511,21 +2582,56 @@ const String *spirv_to_glsl(const String *binary) {
     return String::from_stdstring(source);
 }
 
+static spv_target_env glsl_target_env(int version) {
+    switch (version) {
+    case 400: return SPV_ENV_OPENGL_4_0;
+    case 410: return SPV_ENV_OPENGL_4_1;
+    case 420: return SPV_ENV_OPENGL_4_2;
+    case 430: return SPV_ENV_OPENGL_4_3;
+    case 450: return SPV_ENV_OPENGL_4_5;
+    default: return SPV_ENV_OPENGL_4_5;
+    }
+}
+
+// translates a module to GLSL source; spirv_cross keeps no global state, so
+// this also runs on worker threads.
+static std::string cross_compile_glsl(std::vector<unsigned int> &&module, int version) {
+	spirv_cross::CompilerGLSL glsl(std::move(module));
+
+    /*
+    // The SPIR-V is now parsed, and we can perform reflection on it.
+    spirv_cross::ShaderResources resources = glsl.get_shader_resources();
+    // Get all sampled images in the shader.
+    for (auto &resource : resources.sampled_images)
+    {
+        unsigned set = glsl.get_decoration(resource.id, spv::DecorationDescriptorSet);
+        unsigned binding = glsl.get_decoration(resource.id, spv::DecorationBinding);
+        printf("Image %s at set = %u, binding = %u\n", resource.name.c_str(), set, binding);
+
+        // Modify the decoration to prepare it for GLSL.
+        glsl.unset_decoration(resource.id, spv::DecorationDescriptorSet);
+
+        // Some arbitrary remapping if we want.
+        glsl.set_decoration(resource.id, spv::DecorationBinding, set * 16 + binding);
+    }
+    */
+
+    // Set some options.
+    spirv_cross::CompilerGLSL::Options options;
+    options.version = (version <= 0)?450:version;
+    glsl.set_common_options(options);
+
+    // Compile to GLSL, ready to give to GL driver.
+    return glsl.compile();
+}
+
 SCOPES_RESULT(const String *) compile_glsl(int version, Symbol target, const FunctionRef &fn, uint64_t flags) {
     SCOPES_RESULT_TYPE(const String *);
     Timer sum_compile_time(TIMER_CompileSPIRV);
 
     //SCOPES_CHECK_RESULT(fn->verify_compilable());
 
-    spv_target_env env = SPV_ENV_OPENGL_4_5;
-    switch (version) {
-    case 400: env = SPV_ENV_OPENGL_4_0; break;
-    case 410: env = SPV_ENV_OPENGL_4_1; break;
-    case 420: env = SPV_ENV_OPENGL_4_2; break;
-    case 430: env = SPV_ENV_OPENGL_4_3; break;
-    case 450: env = SPV_ENV_OPENGL_4_5; break;
-    default: break;
-    }
+    spv_target_env env = glsl_target_env(version);
 
     SPIRVGenerator ctx(env, 0);
     if (flags & CF_NoDebugInfo) {
@@ -2539,54 +2645,184 @@ SCOPES_RESULT(const String *) compile_glsl(int version, Symbol target, const Fun
             ctx.generate(result, target, fn));
     }
 
+    auto key = shader_cache_key("glsl", version, target, flags, result);
+    auto cached = load_shader_cache(key);
+    if (cached) {
+        if (flags & (CF_DumpModule|CF_DumpFunction)) {
+            std::cout << cached->data << std::endl;
+        }
+        return cached;
+    }
+
     if (flags & CF_O3) {
-        int level = 0;
-        if ((flags & CF_O3) == CF_O1)
-            level = 1;
-        else if ((flags & CF_O3) == CF_O2)
-            level = 2;
-        else if ((flags & CF_O3) == CF_O3)
-            level = 3;
-        SCOPES_CHECK_RESULT(optimize_spirv(env, result, level));
+        SCOPES_CHECK_RESULT(optimize_spirv(env, result, spirv_opt_level(flags)));
     }
 
     if (flags & CF_DumpDisassembly) {
         disassemble_spirv(result);
     }
 
-	spirv_cross::CompilerGLSL glsl(std::move(result));
+    std::string source = cross_compile_glsl(std::move(result), version);
 
-    /*
-    // The SPIR-V is now parsed, and we can perform reflection on it.
-    spirv_cross::ShaderResources resources = glsl.get_shader_resources();
-    // Get all sampled images in the shader.
-    for (auto &resource : resources.sampled_images)
-    {
-        unsigned set = glsl.get_decoration(resource.id, spv::DecorationDescriptorSet);
-        unsigned binding = glsl.get_decoration(resource.id, spv::DecorationBinding);
-        printf("Image %s at set = %u, binding = %u\n", resource.name.c_str(), set, binding);
+    if (flags & (CF_DumpModule|CF_DumpFunction)) {
+        std::cout << source << std::endl;
+    }
 
-        // Modify the decoration to prepare it for GLSL.
-        glsl.unset_decoration(resource.id, spv::DecorationDescriptorSet);
+    auto text = String::from_stdstring(source);
+    store_shader_cache(key, text);
+    return text;
+}
 
-        // Some arbitrary remapping if we want.
-        glsl.set_decoration(resource.id, spv::DecorationBinding, set * 16 + binding);
-    }
-    */
+//------------------------------------------------------------------------------
+// BATCH COMPILATION
+//------------------------------------------------------------------------------
 
-    // Set some options.
-    spirv_cross::CompilerGLSL::Options options;
-    options.version = (version <= 0)?450:version;
-    glsl.set_common_options(options);
+enum ShaderBatchStatus {
+    SBS_Ok,
+    SBS_ValidationFailed,
+    SBS_OptimizationFailed,
+};
 
-    // Compile to GLSL, ready to give to GL driver.
-    std::string source = glsl.compile();
+// one function of a batch. the module is generated on the calling thread,
+// because the generator reads the prover's output and interns symbols and
+// strings; the remaining stages only touch the job itself.
+struct ShaderBatchJob {
+    std::vector<unsigned int> module;
+    const String *key = nullptr;
+    const String *cached = nullptr;
+    ShaderBatchStatus status = SBS_Ok;
+    std::string glsl;
+    std::string log;
+};
 
-    if (flags & (CF_DumpModule|CF_DumpFunction)) {
-        std::cout << source << std::endl;
+static void run_shader_batch_job(ShaderBatchJob &job, spv_target_env env,
+    int opt_level, bool to_glsl, int glsl_version) {
+    StyledString ss;
+    auto &module = job.module;
+    if (!validate_spirv(env, module, ss)) {
+        job.status = SBS_ValidationFailed;
+    } else if (opt_level
+        && !run_spirv_optimizer(env, module, opt_level, ss.out)) {
+        job.status = SBS_OptimizationFailed;
+    } else if (opt_level && !validate_spirv(env, module, ss)) {
+        job.status = SBS_ValidationFailed;
+    } else if (to_glsl) {
+        // spirv_cross is built with SPIRV_CROSS_EXCEPTIONS_TO_ASSERTIONS, so
+        // a failed translation aborts the process from the worker thread,
+        // as it does for compile_glsl
+        std::vector<unsigned int> words = module;
+        job.glsl = cross_compile_glsl(std::move(words), glsl_version);
+    }
+    job.log = ss._ss.str();
+}
+
+static SCOPES_RESULT(void) compile_shader_batch(const char *backend,
+    spv_target_env env, int spirv_version, bool to_glsl, int glsl_version,
+    const std::vector<Symbol> &targets, const std::vector<FunctionRef> &fns,
+    uint64_t flags, std::vector<const String *> &results) {
+    SCOPES_RESULT_TYPE(void);
+    Timer sum_compile_time(TIMER_CompileSPIRV);
+
+    assert(targets.size() == fns.size());
+    size_t count = fns.size();
+    int version = to_glsl?glsl_version:spirv_version;
+    std::vector<ShaderBatchJob> jobs(count);
+    {
+        Timer generate_timer(TIMER_GenerateSPIRV);
+        for (size_t i = 0; i < count; ++i) {
+            auto &job = jobs[i];
+            SPIRVGenerator ctx(env, spirv_version);
+            ctx.verify_output = false;
+            if (flags & CF_NoDebugInfo) {
+                ctx.use_debug_info = false;
+            }
+            SCOPES_CHECK_RESULT(ctx.generate(job.module, targets[i], fns[i]));
+            job.key = shader_cache_key(backend, version, targets[i], flags, job.module);
+            job.cached = load_shader_cache(job.key);
+            if (job.cached && !to_glsl
+                && (job.cached->count % sizeof(unsigned int))) {
+                job.cached = nullptr;
+            }
+        }
     }
 
-    return String::from_stdstring(source);
+    // validation, optimization and translation run on a pool of threads;
+    // the calling thread works along and the timer above measures the
+    // elapsed time of the whole stage.
+    int opt_level = (flags & CF_O3)?spirv_opt_level(flags):0;
+    std::atomic<size_t> next_job(0);
+    auto worker = [&]() {
+        while (true) {
+            size_t i = next_job.fetch_add(1);
+            if (i >= count)
+                break;
+            if (!jobs[i].cached) {
+                run_shader_batch_job(jobs[i], env, opt_level, to_glsl, glsl_version);
+            }
+        }
+    };
+    size_t numthreads = std::max(1u, std::thread::hardware_concurrency());
+    numthreads = std::min(numthreads, count);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numthreads; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &&thread : threads) {
+        thread.join();
+    }
+
+    // diagnostics and results are reported in order
+    results.clear();
+    for (auto &&job : jobs) {
+        if (job.cached) {
+            results.push_back(job.cached);
+            continue;
+        }
+        if (!job.log.empty()) {
+            SCOPES_CERR << job.log;
+        }
+        switch (job.status) {
+        case SBS_Ok: break;
+        case SBS_ValidationFailed: {
+            disassemble_spirv(job.module, true);
+            SCOPES_ERROR(CGenBackendValidationFailed);
+        } break;
+        case SBS_OptimizationFailed: {
+            SCOPES_ERROR(CGenBackendOptimizationFailed);
+        } break;
+        }
+        if (flags & CF_DumpDisassembly) {
+            disassemble_spirv(job.module);
+        }
+        const String *result = nullptr;
+        if (to_glsl) {
+            if (flags & (CF_DumpModule|CF_DumpFunction)) {
+                std::cout << job.glsl << std::endl;
+            }
+            result = String::from_stdstring(job.glsl);
+        } else {
+            result = String::from((char *)&job.module[0],
+                sizeof(unsigned int) * job.module.size());
+        }
+        store_shader_cache(job.key, result);
+        results.push_back(result);
+    }
+    return {};
+}
+
+SCOPES_RESULT(void) compile_spirv_batch(int version,
+    const std::vector<Symbol> &targets, const std::vector<FunctionRef> &fns,
+    uint64_t flags, std::vector<const String *> &results) {
+    return compile_shader_batch("spirv", SPV_ENV_VULKAN_1_1_SPIRV_1_4,
+        version, false, 0, targets, fns, flags, results);
+}
+
+SCOPES_RESULT(void) compile_glsl_batch(int version,
+    const std::vector<Symbol> &targets, const std::vector<FunctionRef> &fns,
+    uint64_t flags, std::vector<const String *> &results) {
+    return compile_shader_batch("glsl", glsl_target_env(version),
+        0, true, version, targets, fns, flags, results);
 }
 
 } // namespace scopes
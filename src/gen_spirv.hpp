@@ -21,6 +21,15 @@ struct Function;
 SCOPES_RESULT(const String *) compile_spirv(int version, Symbol target, const FunctionRef &fn, uint64_t flags);
 SCOPES_RESULT(const String *) compile_glsl(int version, Symbol target, const FunctionRef &fn, uint64_t flags);
 
+// compile several functions at once; validation, optimization and GLSL
+// translation of the generated modules run in parallel.
+SCOPES_RESULT(void) compile_spirv_batch(int version,
+    const std::vector<Symbol> &targets, const std::vector<FunctionRef> &fns,
+    uint64_t flags, std::vector<const String *> &results);
+SCOPES_RESULT(void) compile_glsl_batch(int version,
+    const std::vector<Symbol> &targets, const std::vector<FunctionRef> &fns,
+    uint64_t flags, std::vector<const String *> &results);
+
 const String *spirv_to_glsl(const String *binary);
 
 } // namespace scopes
@@ -31,6 +31,7 @@
 #include "quote.hpp"
 #include "boot.hpp"
 #include "execution.hpp"
+#include "profiler.hpp"
 #include "cache.hpp"
 #include "symbol_enum.inc"
 
@@ -103,6 +104,17 @@ static void init_values_arrayT(std::vector< T * > &dest, int numvalues, const sc
 static const Scope *globals = nullptr;
 static const Scope *original_globals = Scope::from(nullptr, nullptr);
 
+static SCOPES_RESULT(void) extract_shader_batch(int count,
+    const sc_symbol_t *targets, const sc_valueref_t *funcs,
+    std::vector<Symbol> &symbols, std::vector<FunctionRef> &fns) {
+    SCOPES_RESULT_TYPE(void);
+    for (int i = 0; i < count; ++i) {
+        symbols.push_back(targets[i]);
+        fns.push_back(SCOPES_GET_RESULT(extract_function_constant(funcs[i])));
+    }
+    return {};
+}
+
 //------------------------------------------------------------------------------
 
 #define CRESULT { return {_result.ok(), (_result.ok()?nullptr:_result.unsafe_error()), _result.unsafe_extract()}; }
@@ -296,6 +308,34 @@ sc_string_raises_t sc_compile_glsl(int version, sc_symbol_t target, sc_valueref_
     return convert_result(compile_glsl(version, target, result, flags));
 }
 
+sc_void_raises_t sc_compile_spirv_batch(int version, int count,
+    const sc_symbol_t *targets, const sc_valueref_t *funcs, uint64_t flags,
+    const sc_string_t **results) {
+    using namespace scopes;
+    SCOPES_RESULT_TYPE(void);
+    std::vector<Symbol> symbols;
+    std::vector<FunctionRef> fns;
+    SCOPES_C_CHECK_RESULT(extract_shader_batch(count, targets, funcs, symbols, fns));
+    std::vector<const String *> strings;
+    SCOPES_C_CHECK_RESULT(compile_spirv_batch(version, symbols, fns, flags, strings));
+    std::copy(strings.begin(), strings.end(), results);
+    return convert_result({});
+}
+
+sc_void_raises_t sc_compile_glsl_batch(int version, int count,
+    const sc_symbol_t *targets, const sc_valueref_t *funcs, uint64_t flags,
+    const sc_string_t **results) {
+    using namespace scopes;
+    SCOPES_RESULT_TYPE(void);
+    std::vector<Symbol> symbols;
+    std::vector<FunctionRef> fns;
+    SCOPES_C_CHECK_RESULT(extract_shader_batch(count, targets, funcs, symbols, fns));
+    std::vector<const String *> strings;
+    SCOPES_C_CHECK_RESULT(compile_glsl_batch(version, symbols, fns, flags, strings));
+    std::copy(strings.begin(), strings.end(), results);
+    return convert_result({});
+}
+
 const sc_string_t *sc_spirv_to_glsl(const sc_string_t *binary) {
     using namespace scopes;
     return spirv_to_glsl(binary);
@@ -312,6 +352,72 @@ sc_void_raises_t sc_compile_object(const sc_string_t *target_triple,
     return convert_result(compile_object(target_triple, (CompilerFileKind)file_kind, path, table, flags));
 }
 
+sc_void_raises_t sc_link_objects(int count, const sc_string_t **inputs,
+    const sc_string_t **outputs, const sc_scope_t *exports, uint64_t flags) {
+    using namespace scopes;
+    return convert_result(link_objects(
+        std::vector<const String *>(inputs, inputs + count),
+        std::vector<const String *>(outputs, outputs + count), exports, flags));
+}
+
+sc_void_raises_t sc_set_profile(const sc_string_t *path) {
+    using namespace scopes;
+    return convert_result(set_profile(path));
+}
+
+sc_void_raises_t sc_write_profile(const sc_string_t *path) {
+    using namespace scopes;
+    return convert_result(write_profile(path));
+}
+
+sc_void_raises_t sc_profiler_start(int frequency) {
+    using namespace scopes;
+    return convert_result(start_profiler(frequency));
+}
+
+void sc_profiler_stop() {
+    using namespace scopes;
+    stop_profiler();
+}
+
+sc_void_raises_t sc_profiler_write(const sc_string_t *path) {
+    using namespace scopes;
+    return convert_result(write_profiler_samples(path));
+}
+
+void *sc_alloc_profile_malloc(uint64_t size, const void *site) {
+    using namespace scopes;
+    return profile_malloc(size, (const Anchor *)site);
+}
+
+void sc_alloc_profile_free(void *ptr) {
+    using namespace scopes;
+    profile_free(ptr);
+}
+
+void sc_alloc_profile_print(int max_sites) {
+    using namespace scopes;
+    StyledStream ss(SCOPES_COUT);
+    print_alloc_profile(ss, max_sites);
+}
+
+void sc_alloc_profile_reset() {
+    using namespace scopes;
+    reset_alloc_profile();
+}
+
+sc_u64_u64_i64_tuple_t sc_alloc_profile_totals() {
+    using namespace scopes;
+    sc_u64_u64_i64_tuple_t result;
+    get_alloc_profile_totals(result._0, result._1, result._2);
+    return result;
+}
+
+void sc_alloc_profile_set_dump_interval(int milliseconds) {
+    using namespace scopes;
+    set_alloc_dump_interval(milliseconds);
+}
+
 void sc_enter_solver_cli () {
     using namespace scopes;
     //enable_specializer_step_debugger();
@@ -2391,9 +2497,21 @@ void init_globals(int argc, char *argv[]) {
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_compile, TYPE_ValueRef, TYPE_ValueRef, TYPE_U64);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_compile_spirv, TYPE_String, TYPE_I32, TYPE_Symbol, TYPE_ValueRef, TYPE_U64);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_compile_glsl, TYPE_String, TYPE_I32, TYPE_Symbol, TYPE_ValueRef, TYPE_U64);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_compile_spirv_batch, _void, TYPE_I32, TYPE_I32, native_ro_pointer_type(TYPE_Symbol), TYPE_ValuePP, TYPE_U64, native_pointer_type(TYPE_String));
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_compile_glsl_batch, _void, TYPE_I32, TYPE_I32, native_ro_pointer_type(TYPE_Symbol), TYPE_ValuePP, TYPE_U64, native_pointer_type(TYPE_String));
     DEFINE_EXTERN_C_FUNCTION(sc_spirv_to_glsl, TYPE_String, TYPE_String);
     DEFINE_EXTERN_C_FUNCTION(sc_default_target_triple, TYPE_String);
     DEFINE_RAISING_EXTERN_C_FUNCTION(sc_compile_object, _void, TYPE_String, TYPE_I32, TYPE_String, TYPE_Scope, TYPE_U64);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_set_profile, _void, TYPE_String);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_write_profile, _void, TYPE_String);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_profiler_start, _void, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_profiler_stop, _void);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_profiler_write, _void, TYPE_String);
+    DEFINE_EXTERN_C_FUNCTION(sc_alloc_profile_print, _void, TYPE_I32);
+    DEFINE_EXTERN_C_FUNCTION(sc_alloc_profile_reset, _void);
+    DEFINE_EXTERN_C_FUNCTION(sc_alloc_profile_totals, arguments_type({TYPE_U64, TYPE_U64, TYPE_I64}));
+    DEFINE_EXTERN_C_FUNCTION(sc_alloc_profile_set_dump_interval, _void, TYPE_I32);
+    DEFINE_RAISING_EXTERN_C_FUNCTION(sc_link_objects, _void, TYPE_I32, native_ro_pointer_type(TYPE_String), native_ro_pointer_type(TYPE_String), TYPE_Scope, TYPE_U64);
     DEFINE_EXTERN_C_FUNCTION(sc_enter_solver_cli, _void);
     DEFINE_EXTERN_C_FUNCTION(sc_launch_args, arguments_type({TYPE_I32,native_ro_pointer_type(rawstring)}));
     DEFINE_EXTERN_C_FUNCTION(sc_set_typecast_handler, _void, TYPE_typecast_func);
@@ -0,0 +1,654 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#include "profiler.hpp"
+#include "string.hpp"
+#include "anchor.hpp"
+#include "error.hpp"
+#include "styled_stream.hpp"
+
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <zlib.h>
+
+#if defined(__linux__) && (defined(__x86_64__) || defined(__aarch64__))
+#define SCOPES_PROFILER_SUPPORTED 1
+#include <signal.h>
+#include <ucontext.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#else
+#define SCOPES_PROFILER_SUPPORTED 0
+#endif
+
+namespace scopes {
+
+//------------------------------------------------------------------------------
+// SAMPLING PROFILER
+//------------------------------------------------------------------------------
+
+// every sample is stored as its depth, followed by the program counter and
+// the return addresses of its callers
+#define SCOPES_PROFILER_MAX_DEPTH 128
+#define SCOPES_PROFILER_BUFFER_SIZE (1 << 22)
+
+static uintptr_t *sample_buffer = nullptr;
+static std::atomic<size_t> sample_cursor(0);
+static std::atomic<size_t> dropped_samples(0);
+static uintptr_t stack_low = 0;
+static uintptr_t stack_high = 0;
+static bool frame_pointers = false;
+static bool running = false;
+static int sample_frequency = 0;
+static uint64_t start_time_ns = 0;
+static uint64_t duration_ns = 0;
+
+static std::unordered_map<const void *, const Anchor *> function_anchors;
+
+static uint64_t realtime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+bool profiler_frame_pointers() {
+    return frame_pointers;
+}
+
+void set_function_anchor(const void *ptr, const Anchor *anchor) {
+    function_anchors[ptr] = anchor;
+}
+
+#if SCOPES_PROFILER_SUPPORTED
+
+static timer_t profile_timer;
+static struct sigaction previous_action;
+
+static void on_sigprof(int sig, siginfo_t *info, void *context) {
+    int saved_errno = errno;
+    auto uc = (ucontext_t *)context;
+#if defined(__x86_64__)
+    uintptr_t pc = (uintptr_t)uc->uc_mcontext.gregs[REG_RIP];
+    uintptr_t fp = (uintptr_t)uc->uc_mcontext.gregs[REG_RBP];
+    uintptr_t sp = (uintptr_t)uc->uc_mcontext.gregs[REG_RSP];
+#else
+    uintptr_t pc = (uintptr_t)uc->uc_mcontext.pc;
+    uintptr_t fp = (uintptr_t)uc->uc_mcontext.regs[29];
+    uintptr_t sp = (uintptr_t)uc->uc_mcontext.sp;
+#endif
+    uintptr_t frames[SCOPES_PROFILER_MAX_DEPTH];
+    size_t depth = 0;
+    frames[depth++] = pc;
+    // follow the saved frame pointers for as long as they stay on the stack
+    // of the profiled thread and move towards its base; samples from other
+    // threads only record their program counter. the stack range reserved
+    // for the thread can contain unmapped pages, so the walk starts at the
+    // interrupted stack pointer, above which the stack is in use.
+    uintptr_t low = ((sp >= stack_low) && (sp < stack_high))?sp:stack_high;
+    while ((depth < SCOPES_PROFILER_MAX_DEPTH)
+        && (fp >= low)
+        && ((fp + 2 * sizeof(uintptr_t)) <= stack_high)
+        && !(fp & (sizeof(uintptr_t) - 1))) {
+        auto frame = (const uintptr_t *)fp;
+        uintptr_t ret = frame[1];
+        if (!ret)
+            break;
+        // point into the call instruction rather than past it
+        frames[depth++] = ret - 1;
+        uintptr_t next = frame[0];
+        if (next <= fp)
+            break;
+        fp = next;
+    }
+    size_t count = depth + 1;
+    size_t offset = sample_cursor.fetch_add(count);
+    if ((offset + count) > SCOPES_PROFILER_BUFFER_SIZE) {
+        dropped_samples++;
+    } else {
+        auto dest = sample_buffer + offset;
+        dest[0] = depth;
+        for (size_t i = 0; i < depth; ++i) {
+            dest[i + 1] = frames[i];
+        }
+    }
+    errno = saved_errno;
+}
+
+SCOPES_RESULT(void) start_profiler(int frequency) {
+    SCOPES_RESULT_TYPE(void);
+    if (running)
+        return {};
+    if (frequency <= 0) {
+        SCOPES_ERROR(RTProfilerFailed, "frequency must be positive");
+    }
+    if (!sample_buffer) {
+        sample_buffer = (uintptr_t *)calloc(SCOPES_PROFILER_BUFFER_SIZE,
+            sizeof(uintptr_t));
+        if (!sample_buffer) {
+            SCOPES_ERROR(RTProfilerFailed, strerror(errno));
+        }
+    }
+
+    pthread_attr_t attr;
+    if (!pthread_getattr_np(pthread_self(), &attr)) {
+        void *addr = nullptr;
+        size_t size = 0;
+        pthread_attr_getstack(&attr, &addr, &size);
+        pthread_attr_destroy(&attr);
+        stack_low = (uintptr_t)addr;
+        stack_high = (uintptr_t)addr + size;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = on_sigprof;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGPROF, &action, &previous_action)) {
+        SCOPES_ERROR(RTProfilerFailed, strerror(errno));
+    }
+
+    struct sigevent event;
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGPROF;
+    if (timer_create(CLOCK_PROCESS_CPUTIME_ID, &event, &profile_timer)) {
+        auto msg = strerror(errno);
+        sigaction(SIGPROF, &previous_action, nullptr);
+        SCOPES_ERROR(RTProfilerFailed, msg);
+    }
+    long interval = 1000000000l / frequency;
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = interval / 1000000000l;
+    spec.it_interval.tv_nsec = interval % 1000000000l;
+    spec.it_value = spec.it_interval;
+    if (timer_settime(profile_timer, 0, &spec, nullptr)) {
+        auto msg = strerror(errno);
+        timer_delete(profile_timer);
+        sigaction(SIGPROF, &previous_action, nullptr);
+        SCOPES_ERROR(RTProfilerFailed, msg);
+    }
+
+    sample_frequency = frequency;
+    frame_pointers = true;
+    running = true;
+    start_time_ns = realtime_ns();
+    return {};
+}
+
+void stop_profiler() {
+    if (!running)
+        return;
+    timer_delete(profile_timer);
+    sigaction(SIGPROF, &previous_action, nullptr);
+    duration_ns += realtime_ns() - start_time_ns;
+    running = false;
+}
+
+#else
+
+SCOPES_RESULT(void) start_profiler(int frequency) {
+    SCOPES_RESULT_TYPE(void);
+    SCOPES_ERROR(RTProfilerFailed, "unsupported on this platform");
+}
+
+void stop_profiler() {
+}
+
+#endif
+
+//------------------------------------------------------------------------------
+
+namespace {
+
+struct SymbolInfo {
+    std::string name;
+    std::string system_name;
+    const Anchor *anchor = nullptr;
+};
+
+struct Symbolizer {
+    // start addresses and names of JIT functions, sorted by address
+    std::vector< std::pair<const void *, const String *> > jit_functions;
+    std::unordered_map<uintptr_t, SymbolInfo> cache;
+
+    Symbolizer() : jit_functions(get_address_names()) {
+        std::sort(jit_functions.begin(), jit_functions.end());
+    }
+
+    const SymbolInfo &lookup(uintptr_t addr) {
+        auto it = cache.find(addr);
+        if (it != cache.end())
+            return it->second;
+        SymbolInfo info;
+#if SCOPES_PROFILER_SUPPORTED
+        Dl_info dl;
+        if (dladdr((void *)addr, &dl) && dl.dli_fname) {
+            // native code is named after the closest dynamic symbol
+            if (dl.dli_sname) {
+                info.name = dl.dli_sname;
+            } else {
+                const char *base = strrchr(dl.dli_fname, '/');
+                info.name = base ? (base + 1) : dl.dli_fname;
+            }
+            info.system_name = info.name;
+            return cache.insert({addr, info}).first->second;
+        }
+#endif
+        auto fit = std::upper_bound(jit_functions.begin(), jit_functions.end(),
+            std::pair<const void *, const String *>((const void *)addr, nullptr),
+            [](const std::pair<const void *, const String *> &a,
+                const std::pair<const void *, const String *> &b) {
+                return a.first < b.first;
+            });
+        if (fit != jit_functions.begin()) {
+            --fit;
+            info.system_name = std::string(fit->second->data, fit->second->count);
+            // drop the id that keeps specializations apart
+            auto end = info.system_name.rfind('>');
+            info.name = (end == std::string::npos)?info.system_name
+                :info.system_name.substr(0, end + 1);
+            auto ait = function_anchors.find(fit->first);
+            if (ait != function_anchors.end()) {
+                info.anchor = ait->second;
+            }
+        } else {
+            char buf[32];
+            snprintf(buf, sizeof(buf), "0x%llx", (unsigned long long)addr);
+            info.name = buf;
+            info.system_name = buf;
+        }
+        return cache.insert({addr, info}).first->second;
+    }
+};
+
+struct ProtoWriter {
+    std::string out;
+
+    void varint(uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back((char)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((char)value);
+    }
+
+    void field(int number, uint64_t value) {
+        varint(((uint64_t)number << 3) | 0);
+        varint(value);
+    }
+
+    void bytes(int number, const std::string &value) {
+        varint(((uint64_t)number << 3) | 2);
+        varint(value.size());
+        out += value;
+    }
+
+    void packed(int number, const std::vector<uint64_t> &values) {
+        ProtoWriter p;
+        for (auto value : values) {
+            p.varint(value);
+        }
+        bytes(number, p.out);
+    }
+};
+
+struct StringTable {
+    std::vector<std::string> strings;
+    std::unordered_map<std::string, uint64_t> indices;
+
+    StringTable() { get(""); }
+
+    uint64_t get(const std::string &s) {
+        auto it = indices.find(s);
+        if (it != indices.end())
+            return it->second;
+        auto index = strings.size();
+        strings.push_back(s);
+        indices.insert({s, index});
+        return index;
+    }
+};
+
+} // namespace
+
+// calls f with the frames of every complete sample, leaf first
+template<typename F>
+static void for_each_sample(const F &f) {
+    if (!sample_buffer)
+        return;
+    size_t end = std::min(sample_cursor.load(),
+        (size_t)SCOPES_PROFILER_BUFFER_SIZE);
+    size_t i = 0;
+    while (i < end) {
+        size_t depth = sample_buffer[i];
+        if (!depth || ((i + 1 + depth) > end))
+            break;
+        f(sample_buffer + i + 1, depth);
+        i += depth + 1;
+    }
+}
+
+static std::string frame_label(const SymbolInfo &info) {
+    if (!info.anchor)
+        return info.name;
+    char buf[32];
+    snprintf(buf, sizeof(buf), ":%i", info.anchor->lineno);
+    return info.name + " [" + info.anchor->path.name()->data + buf + "]";
+}
+
+static std::string folded_stacks(Symbolizer &symbolizer) {
+    std::map<std::string, size_t> stacks;
+    for_each_sample([&](const uintptr_t *frames, size_t depth) {
+        std::string stack;
+        for (size_t i = depth; i-- > 0;) {
+            if (!stack.empty())
+                stack += ";";
+            stack += frame_label(symbolizer.lookup(frames[i]));
+        }
+        stacks[stack]++;
+    });
+    std::string out;
+    for (auto &&it : stacks) {
+        out += it.first + " " + std::to_string(it.second) + "\n";
+    }
+    return out;
+}
+
+static std::string pprof_profile(Symbolizer &symbolizer) {
+    StringTable strings;
+    uint64_t period = 1000000000ull / (sample_frequency?sample_frequency:1);
+    std::map< std::vector<uint64_t>, uint64_t > stacks;
+    std::unordered_map<uintptr_t, uint64_t> location_ids;
+    std::vector<uintptr_t> locations;
+    for_each_sample([&](const uintptr_t *frames, size_t depth) {
+        std::vector<uint64_t> ids;
+        for (size_t i = 0; i < depth; ++i) {
+            auto result = location_ids.insert({frames[i], locations.size() + 1});
+            if (result.second) {
+                locations.push_back(frames[i]);
+            }
+            ids.push_back(result.first->second);
+        }
+        stacks[ids]++;
+    });
+
+    ProtoWriter profile;
+    {
+        ProtoWriter type;
+        type.field(1, strings.get("samples"));
+        type.field(2, strings.get("count"));
+        profile.bytes(1, type.out);
+    }
+    {
+        ProtoWriter type;
+        type.field(1, strings.get("cpu"));
+        type.field(2, strings.get("nanoseconds"));
+        profile.bytes(1, type.out);
+    }
+    for (auto &&it : stacks) {
+        ProtoWriter sample;
+        sample.packed(1, it.first);
+        sample.packed(2, { it.second, it.second * period });
+        profile.bytes(2, sample.out);
+    }
+    std::unordered_map<std::string, uint64_t> function_ids;
+    std::vector<const SymbolInfo *> functions;
+    for (size_t i = 0; i < locations.size(); ++i) {
+        auto &&info = symbolizer.lookup(locations[i]);
+        auto result = function_ids.insert({info.system_name, functions.size() + 1});
+        if (result.second) {
+            functions.push_back(&info);
+        }
+        ProtoWriter line;
+        line.field(1, result.first->second);
+        if (info.anchor) {
+            line.field(2, info.anchor->lineno);
+        }
+        ProtoWriter location;
+        location.field(1, i + 1);
+        location.field(3, locations[i]);
+        location.bytes(4, line.out);
+        profile.bytes(4, location.out);
+    }
+    for (size_t i = 0; i < functions.size(); ++i) {
+        auto info = functions[i];
+        ProtoWriter function;
+        function.field(1, i + 1);
+        function.field(2, strings.get(info->name));
+        function.field(3, strings.get(info->system_name));
+        if (info->anchor) {
+            function.field(4, strings.get(info->anchor->path.name()->data));
+            function.field(5, info->anchor->lineno);
+        }
+        profile.bytes(5, function.out);
+    }
+    for (auto &&s : strings.strings) {
+        profile.bytes(6, s);
+    }
+    profile.field(9, start_time_ns);
+    profile.field(10, duration_ns + (running?(realtime_ns() - start_time_ns):0));
+    {
+        ProtoWriter type;
+        type.field(1, strings.get("cpu"));
+        type.field(2, strings.get("nanoseconds"));
+        profile.bytes(11, type.out);
+    }
+    profile.field(12, period);
+    return profile.out;
+}
+
+//------------------------------------------------------------------------------
+// ALLOCATION PROFILER
+//------------------------------------------------------------------------------
+
+// the number of sites that periodic dumps print
+#define SCOPES_ALLOC_DUMP_SITES 20
+
+struct AllocSite {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    int64_t live_bytes = 0;
+};
+
+struct AllocBlock {
+    const Anchor *site;
+    uint64_t size;
+};
+
+static std::mutex alloc_mutex;
+static std::unordered_map<const Anchor *, AllocSite> alloc_sites;
+// blocks are tracked on the side, since memory from the hooks may still be
+// released by code that was not instrumented, and the other way around
+static std::unordered_map<void *, AllocBlock> alloc_blocks;
+static int alloc_dump_interval = 0;
+static std::chrono::steady_clock::time_point last_alloc_dump;
+static int alloc_profile_env = -1;
+
+bool alloc_profile_everything() {
+    if (alloc_profile_env < 0) {
+        // the value optionally sets the dump interval in milliseconds
+        auto env = getenv("SCOPES_PROFILE_ALLOC");
+        alloc_profile_env = env?1:0;
+        if (env && (atoi(env) > 0)) {
+            set_alloc_dump_interval(atoi(env));
+        }
+    }
+    return alloc_profile_env;
+}
+
+void set_alloc_dump_interval(int milliseconds) {
+    std::lock_guard<std::mutex> lock(alloc_mutex);
+    alloc_dump_interval = std::max(milliseconds, 0);
+    last_alloc_dump = std::chrono::steady_clock::now();
+}
+
+static void maybe_dump_alloc_profile() {
+    {
+        std::lock_guard<std::mutex> lock(alloc_mutex);
+        if (!alloc_dump_interval)
+            return;
+        auto now = std::chrono::steady_clock::now();
+        if ((now - last_alloc_dump)
+            < std::chrono::milliseconds(alloc_dump_interval))
+            return;
+        last_alloc_dump = now;
+    }
+    StyledStream ss(SCOPES_CERR);
+    print_alloc_profile(ss, SCOPES_ALLOC_DUMP_SITES);
+}
+
+void *profile_malloc(uint64_t size, const Anchor *site) {
+    void *ptr = malloc(size);
+    if (ptr) {
+        std::lock_guard<std::mutex> lock(alloc_mutex);
+        auto &&entry = alloc_sites[site];
+        entry.count++;
+        entry.bytes += size;
+        entry.live_bytes += size;
+        auto it = alloc_blocks.find(ptr);
+        if (it != alloc_blocks.end()) {
+            // the block was released by code that was not instrumented, and
+            // malloc handed out the same address again
+            alloc_sites[it->second.site].live_bytes -= it->second.size;
+            it->second = { site, size };
+        } else {
+            alloc_blocks.insert({ ptr, { site, size } });
+        }
+    }
+    maybe_dump_alloc_profile();
+    return ptr;
+}
+
+void profile_free(void *ptr) {
+    if (ptr) {
+        std::lock_guard<std::mutex> lock(alloc_mutex);
+        auto it = alloc_blocks.find(ptr);
+        if (it != alloc_blocks.end()) {
+            alloc_sites[it->second.site].live_bytes -= it->second.size;
+            alloc_blocks.erase(it);
+        }
+    }
+    free(ptr);
+}
+
+void print_alloc_profile(StyledStream &ss, int max_sites) {
+    std::vector< std::pair<const Anchor *, AllocSite> > sites;
+    {
+        std::lock_guard<std::mutex> lock(alloc_mutex);
+        sites.assign(alloc_sites.begin(), alloc_sites.end());
+    }
+    std::sort(sites.begin(), sites.end(),
+        [](const std::pair<const Anchor *, AllocSite> &a,
+            const std::pair<const Anchor *, AllocSite> &b) {
+            return a.second.bytes > b.second.bytes;
+        });
+    if ((max_sites > 0) && (sites.size() > (size_t)max_sites)) {
+        sites.resize(max_sites);
+    }
+    ss << "allocations by site:" << std::endl;
+    char line[80];
+    snprintf(line, sizeof(line), "%12s %16s %16s  ", "count", "bytes", "live bytes");
+    ss << line << "site" << std::endl;
+    for (auto &&it : sites) {
+        snprintf(line, sizeof(line), "%12llu %16llu %16lld  ",
+            (unsigned long long)it.second.count,
+            (unsigned long long)it.second.bytes,
+            (long long)it.second.live_bytes);
+        ss << line;
+        if (it.first) {
+            ss << it.first;
+        } else {
+            ss << "<unknown>";
+        }
+        ss << std::endl;
+    }
+}
+
+void get_alloc_profile_totals(uint64_t &count, uint64_t &bytes,
+    int64_t &live_bytes) {
+    std::lock_guard<std::mutex> lock(alloc_mutex);
+    count = 0;
+    bytes = 0;
+    live_bytes = 0;
+    for (auto &&it : alloc_sites) {
+        count += it.second.count;
+        bytes += it.second.bytes;
+        live_bytes += it.second.live_bytes;
+    }
+}
+
+void reset_alloc_profile() {
+    std::lock_guard<std::mutex> lock(alloc_mutex);
+    alloc_sites.clear();
+    alloc_blocks.clear();
+}
+
+//------------------------------------------------------------------------------
+
+SCOPES_RESULT(void) write_profiler_samples(const String *path) {
+    SCOPES_RESULT_TYPE(void);
+#if SCOPES_PROFILER_SUPPORTED
+    // samples of this thread can not be written while the buffer is read
+    sigset_t mask, oldmask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGPROF);
+    pthread_sigmask(SIG_BLOCK, &mask, &oldmask);
+#endif
+    Symbolizer symbolizer;
+    const char *suffix = ".pb.gz";
+    auto suffix_size = strlen(suffix);
+    bool pprof = (path->count >= suffix_size)
+        && !strcmp(path->data + path->count - suffix_size, suffix);
+    bool failed = false;
+    if (pprof) {
+        auto data = pprof_profile(symbolizer);
+        auto f = gzopen(path->data, "wb");
+        if (f) {
+            failed = (gzwrite(f, data.data(), data.size()) != (int)data.size());
+            gzclose(f);
+        } else {
+            failed = true;
+        }
+    } else {
+        auto data = folded_stacks(symbolizer);
+        auto f = fopen(path->data, "w");
+        if (f) {
+            failed = (fwrite(data.data(), 1, data.size(), f) != data.size());
+            fclose(f);
+        } else {
+            failed = true;
+        }
+    }
+    auto saved_errno = errno;
+#if SCOPES_PROFILER_SUPPORTED
+    pthread_sigmask(SIG_SETMASK, &oldmask, nullptr);
+#endif
+    if (failed) {
+        SCOPES_ERROR(RTProfilerFailed, strerror(saved_errno));
+    }
+    if (dropped_samples) {
+        StyledStream ss(SCOPES_CERR);
+        ss << "profiler: buffer full, dropped " << dropped_samples.load()
+            << " samples" << std::endl;
+    }
+    return {};
+}
+
+} // namespace scopes
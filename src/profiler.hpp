@@ -0,0 +1,59 @@
+/*
+    The Scopes Compiler Infrastructure
+    This file is distributed under the MIT License.
+    See LICENSE.md for details.
+*/
+
+#ifndef SCOPES_PROFILER_HPP
+#define SCOPES_PROFILER_HPP
+
+#include "result.hpp"
+
+#include <stdint.h>
+
+namespace scopes {
+
+struct String;
+struct Anchor;
+struct StyledStream;
+
+//------------------------------------------------------------------------------
+// SAMPLING PROFILER
+//------------------------------------------------------------------------------
+
+// samples the stack of the calling thread `frequency` times per second of
+// process CPU time. functions compiled from then on keep their frame pointers,
+// so that their callers can be found.
+SCOPES_RESULT(void) start_profiler(int frequency);
+void stop_profiler();
+// writes the samples taken so far as gzipped pprof protobuf if the path ends
+// in .pb.gz, and as folded stacks for flamegraph tools otherwise
+SCOPES_RESULT(void) write_profiler_samples(const String *path);
+// true if generated functions have to keep frame pointers
+bool profiler_frame_pointers();
+// source location reported for samples in the JIT function at ptr
+void set_function_anchor(const void *ptr, const Anchor *anchor);
+
+//------------------------------------------------------------------------------
+// ALLOCATION PROFILER
+//------------------------------------------------------------------------------
+
+// CF_ProfileAlloc routes the Malloc and Free instructions of JIT functions
+// through these hooks, which count allocations per source anchor
+void *profile_malloc(uint64_t size, const Anchor *site);
+void profile_free(void *ptr);
+// prints allocation count, bytes and live bytes of the `max_sites` sites that
+// allocated the most bytes, or of all sites if max_sites is 0
+void print_alloc_profile(StyledStream &ss, int max_sites);
+void reset_alloc_profile();
+// sums the counters of all sites
+void get_alloc_profile_totals(uint64_t &count, uint64_t &bytes,
+    int64_t &live_bytes);
+// prints the report to stderr from the hooks every `milliseconds`; 0 disables
+void set_alloc_dump_interval(int milliseconds);
+// true if SCOPES_PROFILE_ALLOC asks to instrument every JIT function
+bool alloc_profile_everything();
+
+} // namespace scopes
+
+#endif // SCOPES_PROFILER_HPP
@@ -348,6 +348,11 @@ void set_address_name(const void *ptr, const String *name) {
 }
 #endif
 
+std::vector< std::pair<const void *, const String *> > get_address_names() {
+    return std::vector< std::pair<const void *, const String *> >(
+        address_names.begin(), address_names.end());
+}
+
 void stream_address(StyledStream &ss, const void *ptr) {
     auto it = address_names.find(ptr);
     if (it != address_names.end()) {
@@ -12,6 +12,8 @@
 #include "valueref.inc"
 
 #include <iostream>
+#include <vector>
+#include <utility>
 
 namespace scopes {
 
@@ -160,6 +162,7 @@ StyledStream& operator<<(StyledStream& ost, TValueRef<T> value) {
 void stream_uid(StyledStream &ss, uint64_t uid);
 void stream_address(StyledStream &ss, const void *ptr);
 void set_address_name(const void *ptr, const String *name);
+std::vector< std::pair<const void *, const String *> > get_address_names();
 
 } // namespace scopes
 
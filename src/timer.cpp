@@ -7,6 +7,7 @@
 #include "timer.hpp"
 
 #include <unordered_map>
+#include <stdio.h>
 
 namespace scopes {
 
@@ -60,4 +61,17 @@ void Timer::print_timers() {
     ss << "cumulative user: " << (real_sum - non_user_sum) << "ms" << std::endl;
 }
 
+void Timer::write_summary(const char *path) {
+    double real_sum = 0.0;
+    double non_user_sum = timers[TIMER_Main].time;
+    for (auto &&it : timers) {
+        real_sum += it.second.time;
+    }
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return;
+    fprintf(f, "%f %f\n", real_sum - non_user_sum, non_user_sum);
+    fclose(f);
+}
+
 } // namespace scopes
@@ -30,6 +30,9 @@ struct Timer {
     void resume();
 
     static void print_timers();
+    // writes the time spent in the compiler and the remaining time in
+    // milliseconds, separated by a space, to the file at path
+    static void write_summary(const char *path);
 };
 
 } // namespace scopes
@@ -0,0 +1,423 @@
+# micro-benchmarks for the runtime containers in lib/scopes
+
+    usage: scopes bench_containers.sc [max-exponent]
+
+    every benchmark runs at n = 10^3 .. 10^max-exponent elements (the default
+    maximum exponent is 7) and is followed by the equivalent operation on the
+    C++ standard library container as a reference line.
+
+using import Array
+using import Map
+using import Set
+using import String
+using import Rc
+using import struct
+using import benchmark
+using import C.stdlib
+
+vvv bind stdref
+include
+    extern "C++"
+    options "-O2"
+    """"#include <stddef.h>
+        #include <stdint.h>
+        #include <pthread.h>
+        #include <algorithm>
+        #include <memory>
+        #include <string>
+        #include <unordered_map>
+        #include <unordered_set>
+        #include <vector>
+
+        typedef std::unordered_map<int64_t, int64_t> umap_t;
+        typedef std::unordered_set<int64_t> uset_t;
+        typedef std::vector<int64_t> vector_t;
+        typedef std::vector< std::shared_ptr<int64_t> > shared_vector_t;
+
+        extern "C" {
+
+        void *stdref_umap_new () { return new umap_t(); }
+        void stdref_umap_delete (void *m) { delete (umap_t *)m; }
+        void stdref_umap_insert (void *m, const int64_t *keys, size_t n) {
+            umap_t &map = *(umap_t *)m;
+            for (size_t i = 0; i < n; ++i)
+                map[keys[i]] = keys[i];
+        }
+        int64_t stdref_umap_lookup (void *m, const int64_t *keys, size_t n) {
+            umap_t &map = *(umap_t *)m;
+            int64_t sum = 0;
+            for (size_t i = 0; i < n; ++i) {
+                auto it = map.find(keys[i]);
+                if (it != map.end())
+                    sum += it->second;
+            }
+            return sum;
+        }
+        int64_t stdref_umap_iterate (void *m) {
+            int64_t sum = 0;
+            for (auto &&it : *(umap_t *)m)
+                sum += it.second;
+            return sum;
+        }
+        void stdref_umap_erase (void *m, const int64_t *keys, size_t n) {
+            umap_t &map = *(umap_t *)m;
+            for (size_t i = 0; i < n; ++i)
+                map.erase(keys[i]);
+        }
+
+        void *stdref_uset_new () { return new uset_t(); }
+        void stdref_uset_delete (void *s) { delete (uset_t *)s; }
+        void stdref_uset_insert (void *s, const int64_t *keys, size_t n) {
+            uset_t &set = *(uset_t *)s;
+            for (size_t i = 0; i < n; ++i)
+                set.insert(keys[i]);
+        }
+        int64_t stdref_uset_lookup (void *s, const int64_t *keys, size_t n) {
+            uset_t &set = *(uset_t *)s;
+            int64_t hits = 0;
+            for (size_t i = 0; i < n; ++i)
+                hits += (int64_t)set.count(keys[i]);
+            return hits;
+        }
+        int64_t stdref_uset_iterate (void *s) {
+            int64_t sum = 0;
+            for (auto &&it : *(uset_t *)s)
+                sum += it;
+            return sum;
+        }
+        void stdref_uset_erase (void *s, const int64_t *keys, size_t n) {
+            uset_t &set = *(uset_t *)s;
+            for (size_t i = 0; i < n; ++i)
+                set.erase(keys[i]);
+        }
+
+        void *stdref_vector_new () { return new vector_t(); }
+        void stdref_vector_delete (void *v) { delete (vector_t *)v; }
+        void stdref_vector_append (void *v, const int64_t *keys, size_t n) {
+            vector_t &vec = *(vector_t *)v;
+            for (size_t i = 0; i < n; ++i)
+                vec.push_back(keys[i]);
+        }
+        int64_t stdref_vector_iterate (void *v) {
+            int64_t sum = 0;
+            for (auto &&it : *(vector_t *)v)
+                sum += it;
+            return sum;
+        }
+        void stdref_vector_sort (void *v) {
+            vector_t &vec = *(vector_t *)v;
+            std::sort(vec.begin(), vec.end());
+        }
+
+        void *stdref_string_new () { return new std::string(); }
+        void stdref_string_delete (void *s) { delete (std::string *)s; }
+        void stdref_string_append (void *s, size_t n) {
+            std::string &str = *(std::string *)s;
+            for (size_t i = 0; i < n; ++i)
+                str.push_back('x');
+        }
+        size_t stdref_string_concat (size_t n) {
+            std::string prefix("0123456789abcdef");
+            size_t total = 0;
+            for (size_t i = 0; i < n; ++i) {
+                std::string joined = prefix + "0123456789abcdef";
+                total += joined.size();
+            }
+            return total;
+        }
+
+        void *stdref_shared_new (size_t n) {
+            shared_vector_t *v = new shared_vector_t();
+            v->reserve(n);
+            return v;
+        }
+        void stdref_shared_fill (void *v, size_t n) {
+            shared_vector_t &vec = *(shared_vector_t *)v;
+            for (size_t i = 0; i < n; ++i)
+                vec.push_back(std::make_shared<int64_t>((int64_t)i));
+        }
+        void stdref_shared_clear (void *v) { ((shared_vector_t *)v)->clear(); }
+        void stdref_shared_delete (void *v) { delete (shared_vector_t *)v; }
+        int64_t stdref_shared_clone (size_t n) {
+            std::shared_ptr<int64_t> shared = std::make_shared<int64_t>(1);
+            int64_t sum = 0;
+            for (size_t i = 0; i < n; ++i) {
+                std::shared_ptr<int64_t> c = shared;
+                sum += c.use_count();
+            }
+            return sum;
+        }
+
+        void stdref_run_threads (void *(*f)(void *), void *arg, size_t n) {
+            pthread_t threads[64];
+            if (n > 64) n = 64;
+            for (size_t i = 0; i < n; ++i)
+                pthread_create(&threads[i], NULL, f, arg);
+            for (size_t i = 0; i < n; ++i)
+                pthread_join(threads[i], NULL);
+        }
+        struct shared_clone_task {
+            std::shared_ptr<int64_t> shared;
+            size_t n;
+        };
+        static void *shared_clone_worker (void *arg) {
+            shared_clone_task *task = (shared_clone_task *)arg;
+            for (size_t i = 0; i < task->n; ++i) {
+                std::shared_ptr<int64_t> c = task->shared;
+                (void)c;
+            }
+            return NULL;
+        }
+        void stdref_shared_clone_threads (size_t n, size_t nthreads) {
+            shared_clone_task task = { std::make_shared<int64_t>(1), n / nthreads };
+            stdref_run_threads(shared_clone_worker, &task, nthreads);
+        }
+
+        } // extern "C"
+
+using stdref.extern filter "^stdref_.*$"
+
+let Keys = (Array i64)
+# number of threads sharing a reference count in the contention benchmarks
+let ContentionThreads = 4:usize
+
+fn random-keys (n)
+    """"Returns `n` distinct pseudo-random keys generated by xorshift64.
+    local keys : Keys
+    'reserve keys n
+    loop (i x = 0:usize 88172645463325252:u64)
+        if (i == n)
+            break;
+        let x = (x ^ (x << 13:u64))
+        let x = (x ^ (x >> 7:u64))
+        let x = (x ^ (x << 17:u64))
+        'append keys (x as i64)
+        _ (i + 1:usize) x
+    keys
+
+fn bench-map (keys)
+    let n = (countof keys)
+    local map : (Map i64 i64)
+    bench "Map insert" n
+        inline ()
+            for k in keys
+                'set map k k
+    bench "Map lookup" n
+        inline ()
+            local sum = 0:i64
+            for k in keys
+                sum += ('getdefault map k 0:i64)
+            consume sum
+    bench "Map iterate" n
+        inline ()
+            local sum = 0:i64
+            for k v in map
+                sum += v
+            consume sum
+    bench "Map erase" n
+        inline ()
+            for k in keys
+                'discard map k
+
+    let stdmap = (stdref_umap_new)
+    bench "std::unordered_map insert" n
+        inline ()
+            stdref_umap_insert stdmap keys n
+    bench "std::unordered_map lookup" n
+        inline ()
+            consume (stdref_umap_lookup stdmap keys n)
+    bench "std::unordered_map iterate" n
+        inline ()
+            consume (stdref_umap_iterate stdmap)
+    bench "std::unordered_map erase" n
+        inline ()
+            stdref_umap_erase stdmap keys n
+    stdref_umap_delete stdmap
+
+fn bench-set (keys)
+    let n = (countof keys)
+    local set : (Set i64)
+    bench "Set insert" n
+        inline ()
+            for k in keys
+                'insert set k
+    bench "Set lookup" n
+        inline ()
+            local hits = 0:usize
+            for k in keys
+                if ('in? set k)
+                    hits += 1:usize
+            consume hits
+    bench "Set iterate" n
+        inline ()
+            local sum = 0:i64
+            for k in set
+                sum += k
+            consume sum
+    bench "Set erase" n
+        inline ()
+            for k in keys
+                'discard set k
+
+    let stdset = (stdref_uset_new)
+    bench "std::unordered_set insert" n
+        inline ()
+            stdref_uset_insert stdset keys n
+    bench "std::unordered_set lookup" n
+        inline ()
+            consume (stdref_uset_lookup stdset keys n)
+    bench "std::unordered_set iterate" n
+        inline ()
+            consume (stdref_uset_iterate stdset)
+    bench "std::unordered_set erase" n
+        inline ()
+            stdref_uset_erase stdset keys n
+    stdref_uset_delete stdset
+
+fn bench-array (keys)
+    let n = (countof keys)
+    local values : (Array i64)
+    bench "Array append" n
+        inline ()
+            for k in keys
+                'append values k
+    bench "Array iterate" n
+        inline ()
+            local sum = 0:i64
+            for v in values
+                sum += v
+            consume sum
+    bench "Array sort" n
+        inline ()
+            'sort values
+    bench "Array sort (sorted input)" n
+        inline ()
+            'sort values
+
+    let vec = (stdref_vector_new)
+    bench "std::vector append" n
+        inline ()
+            stdref_vector_append vec keys n
+    bench "std::vector iterate" n
+        inline ()
+            consume (stdref_vector_iterate vec)
+    bench "std::sort" n
+        inline ()
+            stdref_vector_sort vec
+    bench "std::sort (sorted input)" n
+        inline ()
+            stdref_vector_sort vec
+    stdref_vector_delete vec
+
+fn bench-string (n)
+    local str : String
+    bench "String append" n
+        inline ()
+            for i in (range n)
+                'append str 120:char
+    bench "String concatenation" n
+        inline ()
+            let prefix = (String "0123456789abcdef")
+            local total = 0:usize
+            for i in (range n)
+                let joined = (prefix .. "0123456789abcdef")
+                total += (countof joined)
+            consume total
+
+    let stdstr = (stdref_string_new)
+    bench "std::string append" n
+        inline ()
+            stdref_string_append stdstr n
+    bench "std::string concatenation" n
+        inline ()
+            consume (stdref_string_concat n)
+    stdref_string_delete stdstr
+
+fn bench-rc (n)
+    let RcType = (Rc i64)
+    local values : (Array RcType)
+    'reserve values n
+    bench "Rc new" n
+        inline ()
+            for i in (range n)
+                'append values (RcType (i as i64))
+    bench "Rc drop" n
+        inline ()
+            'clear values
+    let shared = (RcType 1)
+    bench "Rc clone/drop" n
+        inline ()
+            for i in (range n)
+                let c = (copy shared)
+                consume (Rc.strong-count c)
+
+    let shared-values = (stdref_shared_new n)
+    bench "std::shared_ptr new" n
+        inline ()
+            stdref_shared_fill shared-values n
+    bench "std::shared_ptr drop" n
+        inline ()
+            stdref_shared_clear shared-values
+    bench "std::shared_ptr clone/drop" n
+        inline ()
+            consume (stdref_shared_clone n)
+    stdref_shared_delete shared-values
+
+let ArcI64 = (Arc i64)
+
+struct ArcCloneTask plain
+    shared : (pointer ArcI64)
+    count : usize
+
+fn arc-clone-worker (arg)
+    let task = (@ (bitcast arg (pointer ArcCloneTask)))
+    let shared = (@ task.shared)
+    for i in (range task.count)
+        let c = (copy shared)
+        ;
+    null as voidstar
+
+fn bench-arc (n)
+    local values : (Array ArcI64)
+    'reserve values n
+    bench "Arc new" n
+        inline ()
+            for i in (range n)
+                'append values (ArcI64 (i as i64))
+    bench "Arc drop" n
+        inline ()
+            'clear values
+    local shared = (ArcI64 1)
+    bench "Arc clone/drop" n
+        inline ()
+            for i in (range n)
+                let c = (copy shared)
+                ;
+    local task = (ArcCloneTask (& shared) (n // ContentionThreads))
+    bench (.. "Arc clone/drop, " (tostring ContentionThreads) " threads") n
+        inline ()
+            stdref_run_threads (static-typify arc-clone-worker voidstar)
+                \ (bitcast (& task) voidstar) ContentionThreads
+
+    bench (.. "std::shared_ptr clone/drop, " (tostring ContentionThreads) " threads") n
+        inline ()
+            stdref_shared_clone_threads n ContentionThreads
+
+fn main (max-exponent)
+    loop (e n = 3 1000:usize)
+        if (e > max-exponent)
+            break;
+        header (.. "n = " (tostring n))
+        let keys = (random-keys n)
+        bench-map keys
+        bench-set keys
+        bench-array keys
+        bench-string n
+        bench-rc n
+        bench-arc n
+        _ (e + 1) (n * 10:usize)
+
+let source argc argv = (script-launch-args)
+main
+    if (argc > 0) (max (atoi (argv @ 0)) 3)
+    else 7
@@ -0,0 +1,236 @@
+# loopback echo benchmark for the eventloop module
+
+    usage: scopes bench_echo.sc [clients] [requests]
+
+    a TCP echo server and `clients` connections (the default is 16) share a
+    single event loop; every client sends a 64-byte request, waits for the
+    echo and sends the next one, until `requests` round trips (the default
+    is 200000) have completed. a second run echoes datagrams in batches of
+    32 with recvmmsg and sendmmsg. every run reports requests per second and
+    the 50th and 99th percentile of the round trip latency.
+
+using import Array
+using import struct
+using import eventloop
+using import benchmark
+using import C.socket
+using import C.stdlib
+
+let printf = (extern 'printf (function i32 rawstring ...))
+
+let MessageSize = 64
+let BatchSize = 32
+
+struct Shared plain
+    loop : (mutable pointer EventLoop)
+    latencies : (mutable pointer (Array u64))
+    completed : usize
+    target : usize
+
+struct Client plain
+    shared : (mutable pointer Shared)
+    fd : i32
+    sent-at : u64
+    received : i32
+
+global request : (array char MessageSize)
+
+fn send-request (client)
+    client.sent-at = (clock-ns)
+    write-some client.fd (& (request @ 0)) MessageSize
+    ;
+
+fn complete (shared sent-at count)
+    """"Records `count` requests answered with a round trip that started at
+        `sent-at` and returns true while more requests are wanted.
+    if (shared.completed < shared.target)
+        'append (@ shared.latencies) ((clock-ns) - sent-at)
+    shared.completed += count
+    if (shared.completed >= shared.target)
+        'stop (@ shared.loop)
+        false
+    else true
+
+fn print-results (name requests ns latencies)
+    """"Prints the throughput of `requests` answered in `ns` nanoseconds and
+        percentiles of the round trip `latencies`.
+    let count = (countof latencies)
+    'sort latencies
+    inline percentile (p)
+        latencies @ (min ((count * p) // 100:usize) (count - 1:usize))
+    printf "%-30s %10.0f req/s   p50 %8.2f us   p99 %8.2f us\n" (name as rawstring)
+        (requests as f64) * 1e9:f64 / (ns as f64)
+        ((percentile 50:usize) as f64) / 1000.0:f64
+        ((percentile 99:usize) as f64) / 1000.0:f64
+    ;
+
+#-------------------------------------------------------------------------------
+# TCP
+#-------------------------------------------------------------------------------
+
+fn on-server-data (fd events context)
+    local buf : (array char 4096)
+    loop ()
+        let n = (read-some fd (& (buf @ 0)) 4096)
+        if (n <= 0)
+            if ((n == 0) or (not (would-block?)))
+                'remove (@ (bitcast context (mutable pointer EventLoop))) fd
+                close fd
+            break;
+        write-some fd (& (buf @ 0)) n
+        repeat;
+    ;
+
+fn on-accept (fd events loop)
+    loop ()
+        let conn = (accept-nonblocking fd)
+        if (conn < 0)
+            break;
+        'add (@ loop) conn EventRead on-server-data (bitcast loop voidstar)
+        repeat;
+    ;
+
+fn on-client-data (fd events client)
+    let client = (@ client)
+    let shared = (@ client.shared)
+    local buf : (array char MessageSize)
+    loop ()
+        let n = (read-some fd (& (buf @ 0)) MessageSize)
+        if (n <= 0)
+            break;
+        client.received += (n as i32)
+        if (client.received >= MessageSize)
+            client.received -= MessageSize
+            if (not (complete shared client.sent-at 1:usize))
+                break;
+            send-request client
+        repeat;
+    ;
+
+fn run-tcp (clients count)
+    local loop = (EventLoop)
+    let server = (listen-tcp 0 1024)
+    assert (server >= 0) "listen failed"
+    let port = (local-port server)
+    'add loop server EventRead on-accept (& loop)
+
+    local latencies : (Array u64)
+    'reserve latencies count
+    local shared = (Shared (& loop) (& latencies) 0:usize count)
+    let states = (malloc-array Client clients)
+    for i in (range clients)
+        let fd = (connect-tcp port)
+        assert (fd >= 0) "connect failed"
+        states @ i = (Client (& shared) fd 0:u64 0)
+        'add loop fd EventRead on-client-data (getelementptr states i)
+
+    let t0 = (clock-ns)
+    for i in (range clients)
+        send-request (states @ i)
+    'run loop
+    let t1 = (clock-ns)
+    print-results
+        .. "tcp, " (tostring clients) " clients"
+        shared.completed
+        t1 - t0
+        latencies
+
+    for i in (range clients)
+        let client = (states @ i)
+        'remove loop client.fd
+        close client.fd
+    free states
+    'remove loop server
+    close server
+
+#-------------------------------------------------------------------------------
+# UDP with batched system calls
+#-------------------------------------------------------------------------------
+
+struct Peer plain
+    shared : (mutable pointer Shared)
+    batch : (mutable pointer MessageBatch)
+    fd : i32
+    server-port : u16
+    sent-at : u64
+    received : usize
+
+fn on-datagrams (fd events batch)
+    let batch = (@ batch)
+    loop ()
+        let n = ('receive batch fd)
+        if (n <= 0)
+            break;
+        'send batch fd n
+        repeat;
+    ;
+
+fn send-all (peer)
+    let batch = (@ peer.batch)
+    for i in (range BatchSize)
+        'set-peer batch i peer.server-port
+        'set-length batch i MessageSize
+    peer.sent-at = (clock-ns)
+    peer.received = 0:usize
+    'send batch peer.fd BatchSize
+    ;
+
+fn on-replies (fd events peer)
+    let peer = (@ peer)
+    loop ()
+        let n = ('receive (@ peer.batch) fd)
+        if (n <= 0)
+            break;
+        peer.received += (n as usize)
+        if (peer.received >= (BatchSize as usize))
+            if (not (complete (@ peer.shared) peer.sent-at (BatchSize as usize)))
+                break;
+            send-all peer
+        repeat;
+    ;
+
+fn run-udp (count)
+    local loop = (EventLoop)
+    let server = (bind-udp 0)
+    let client = (bind-udp 0)
+    assert ((server >= 0) and (client >= 0)) "bind failed"
+
+    local server-batch = (MessageBatch BatchSize MessageSize)
+    local client-batch = (MessageBatch BatchSize MessageSize)
+    'add loop server EventRead on-datagrams (& server-batch)
+
+    # latencies are measured per batch
+    local latencies : (Array u64)
+    'reserve latencies (count // (BatchSize as usize) + 1:usize)
+    local shared = (Shared (& loop) (& latencies) 0:usize count)
+    local peer =
+        Peer (& shared) (& client-batch) client (local-port server) 0:u64 0:usize
+    'add loop client EventRead on-replies (& peer)
+
+    let t0 = (clock-ns)
+    send-all peer
+    'run loop
+    let t1 = (clock-ns)
+    print-results
+        .. "udp, batches of " (tostring BatchSize)
+        shared.completed
+        t1 - t0
+        latencies
+
+    'remove loop server
+    'remove loop client
+    close server
+    close client
+
+fn main (clients count)
+    for i in (range MessageSize)
+        request @ i = ((97 + (i % 26)) as char)
+    run-tcp clients count
+    run-udp count
+
+let source argc argv = (script-launch-args)
+main
+    if (argc > 0) ((max (atoi (argv @ 0)) 1) as usize)
+    else 16:usize
+    if (argc > 1) ((max (atoi (argv @ 1)) 1) as usize)
+    else 200000:usize
@@ -0,0 +1,84 @@
+# micro-benchmarks for the format module
+
+    usage: scopes bench_format.sc [count]
+
+    every benchmark formats the same line `count` times (the default is one
+    million) into a buffer, once with `format-buffer` and once with the
+    stb_sprintf implementation vendored in external/ as a reference line.
+
+using import format
+using import benchmark
+using import C.stdlib
+
+vvv bind stbref
+include
+    options "-O2" (.. "-I" compiler-dir "/external")
+    """"#include <stdint.h>
+        #define STB_SPRINTF_IMPLEMENTATION
+        #define STB_SPRINTF_STATIC
+        #include "stb_sprintf.h"
+
+        int stbref_format_ints (char *buf, int size, int a, int64_t b, int c) {
+            return stbsp_snprintf(buf, size, "item %d of %lld: %d", a, (long long)b, c);
+        }
+        int stbref_format_mixed (char *buf, int size, const char *name, int id, double x) {
+            return stbsp_snprintf(buf, size, "%s #%d = %.11f", name, id, x);
+        }
+        int stbref_format_string (char *buf, int size, const char *a, const char *b) {
+            return stbsp_snprintf(buf, size, "[%s] %s", a, b);
+        }
+
+let BufferSize = 256
+
+fn main (count)
+    local buf : (array char BufferSize)
+    let buf = (& (buf @ 0))
+    header "formatting into a buffer"
+    bench "format-buffer integers" count
+        inline ()
+            for i in (range count)
+                consume
+                    format-buffer buf BufferSize "item {} of {}: {}"
+                        \ (i as i32) (count as i64) (-1 - (i as i32))
+    bench "stb_sprintf integers" count
+        inline ()
+            for i in (range count)
+                consume
+                    stbref.extern.stbref_format_ints buf BufferSize
+                        \ (i as i32) (count as i64) (-1 - (i as i32))
+    bench "format-buffer mixed" count
+        inline ()
+            for i in (range count)
+                consume
+                    format-buffer buf BufferSize "{} #{} = {}"
+                        \ "sample" (i as i32) ((i as f64) * 0.25:f64)
+    bench "stb_sprintf mixed" count
+        inline ()
+            for i in (range count)
+                consume
+                    stbref.extern.stbref_format_mixed buf BufferSize
+                        \ "sample" (i as i32) ((i as f64) * 0.25:f64)
+    bench "format-buffer strings" count
+        inline ()
+            for i in (range count)
+                consume
+                    format-buffer buf BufferSize "[{}] {}" "info" "a log message"
+    bench "stb_sprintf strings" count
+        inline ()
+            for i in (range count)
+                consume
+                    stbref.extern.stbref_format_string buf BufferSize
+                        \ "info" "a log message"
+    header "formatting into a String"
+    bench "format" count
+        inline ()
+            for i in (range count)
+                let s =
+                    format "item {} of {}: {}"
+                        \ (i as i32) (count as i64) (-1 - (i as i32))
+                consume (countof s)
+
+let source argc argv = (script-launch-args)
+main
+    if (argc > 0) ((max (atoi (argv @ 0)) 1) as usize)
+    else 1000000:usize
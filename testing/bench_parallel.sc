@@ -0,0 +1,78 @@
+# scaling benchmarks for the parallel module
+
+    usage: scopes bench_parallel.sc [max-threads]
+
+    every benchmark runs with 1, 2, 4 .. max-threads worker threads (the
+    default is the number of online processors), so that the ns/op column
+    shows how the run time shrinks as threads are added.
+
+using import Array
+using import Capture
+using import parallel
+using import benchmark
+using import C.stdlib
+
+let N = 1000000:usize
+
+fn bench-for (pool threads values)
+    capture scale (x) {}
+        x = x * 3:i64 + 1:i64
+    bench (.. "parallel-for, " (tostring threads) " threads") N
+        inline ()
+            parallel-for pool values scale
+    consume (values @ 0)
+
+fn bench-reduce (pool threads values)
+    bench (.. "parallel-reduce, " (tostring threads) " threads") N
+        inline ()
+            consume
+                parallel-reduce pool values 0:i64
+                    inline (sum x) (sum + x)
+
+fn bench-map (pool threads)
+    bench (.. "parallel-map, " (tostring threads) " threads") N
+        inline ()
+            let squares =
+                parallel-map pool N
+                    inline (i) ((i * i) as i64)
+            consume (squares @ 0)
+
+fn bench-spawn (pool threads)
+    let count = (N // 100:usize)
+    local futures : (Array (Future i64))
+    'reserve futures count
+    bench (.. "spawn/wait, " (tostring threads) " threads") count
+        inline ()
+            for i in (range count)
+                capture task () {i}
+                    (i * i) as i64
+                'append futures ('spawn pool task)
+            for f in futures
+                consume ('wait f)
+            'clear futures
+
+fn main (max-threads)
+    local values : (Array i64)
+    for i in (range N)
+        'append values (i as i64)
+    header "sequential"
+    bench "for loop, 1 thread" N
+        inline ()
+            for x in values
+                x = x * 3:i64 + 1:i64
+    consume (values @ 0)
+    loop (threads = 1)
+        if (threads > max-threads)
+            break;
+        local pool = (ThreadPool threads)
+        header (.. (tostring threads) " threads")
+        bench-for pool threads values
+        bench-reduce pool threads values
+        bench-map pool threads
+        bench-spawn pool threads
+        threads * 2
+
+let source argc argv = (script-launch-args)
+main
+    if (argc > 0) (max (atoi (argv @ 0)) 1)
+    else ((hardware-concurrency) as i32)
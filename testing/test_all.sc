@@ -35,6 +35,7 @@ test-modules
     .test_enums
     .test_extraparams
     .test_feature_matrix
+    .test_flatmap
     .test_fnchain
     .test_folding
     .test_format
@@ -69,6 +70,7 @@ test-modules
     .test_operators
     .test_option
     .test_overload
+    .test_parallel
     .test_parser
     .test_pointer
     .test_print
@@ -102,3 +104,13 @@ test-modules
     .test_vector
     .test_wasm
     .test_while
+
+# modules that depend on operating system specific interfaces
+static-if (operating-system == 'linux)
+    test-modules
+        .test_eventloop
+        .test_profiler
+
+static-if (operating-system != 'windows)
+    test-modules
+        .test_io
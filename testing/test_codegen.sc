@@ -7,4 +7,172 @@ fn elidable (x)
 compile (static-typify elidable (tuple i32 i32)) 'dump-function 'dump-disassembly
 compile (static-typify elidable (tuple i32 i32)) 'dump-function 'dump-disassembly
 
-;
\ No newline at end of file
+using import io
+
+fn contains? (text pattern)
+    let size = (countof pattern)
+    loop (i = 0:usize)
+        if ((i + size) > (countof text))
+            break false
+        if (('slice text i (i + size)) == pattern)
+            break true
+        i + 1:usize
+
+# reference arguments are nonnull, and accesses to distinct local
+  allocations are placed in alias scopes that exclude each other
+do
+    fn accumulate (total x)
+        total += x
+
+    fn main ()
+        local total = 1
+        local step = 2
+        accumulate total step
+        step = (total * 2)
+        total + step
+
+    let path = (module-dir .. "/_test_codegen.ll")
+    compile-object
+        default-target-triple
+        compiler-file-kind-llvm
+        path
+        'bind-symbols (Scope)
+            main = (static-typify main)
+        'no-debug-info
+
+    let ir = (FileView path)
+    test ('valid? ir)
+    test (contains? ir "nonnull align 4")
+    test (not (contains? ir "dereferenceable"))
+    test (contains? ir "!alias.scope")
+    test (contains? ir "!noalias")
+
+# loop hints end up on the backedge of their loop
+do
+    fn scale (values count)
+        for i in (range count)
+            loop-hint 'vectorize true
+            loop-hint 'vectorize-width 8
+            loop-hint 'unroll-count 2
+            values @ i = ((values @ i) * 2.0)
+
+    let path = (module-dir .. "/_test_codegen_loop.ll")
+    compile-object
+        default-target-triple
+        compiler-file-kind-llvm
+        path
+        'bind-symbols (Scope)
+            scale = (static-typify scale (mutable pointer f32) i32)
+        'no-debug-info
+
+    let ir = (FileView path)
+    test (contains? ir "!llvm.loop")
+    test (contains? ir "!\"llvm.loop.vectorize.enable\", i1 true")
+    test (contains? ir "!\"llvm.loop.vectorize.width\", i32 8")
+    test (contains? ir "!\"llvm.loop.unroll.count\", i32 2")
+
+# C bitcode is linked into the Scopes functions that call it and inlined there
+do
+    let C =
+        include
+            options "--link-bitcode"
+            """"static inline int c_square (int x) { return x * x; }
+                int c_cube (int x) { return c_square(x) * x; }
+    let c_square c_cube = C.extern.c_square C.extern.c_cube
+
+    fn cubes (x)
+        (c_cube x) + (c_square x)
+
+    test ((cubes 3) == 36)
+
+    let path = (module-dir .. "/_test_codegen_c.ll")
+    compile-object
+        default-target-triple
+        compiler-file-kind-llvm
+        path
+        'bind-symbols (Scope)
+            cubes = (static-typify cubes i32)
+        'no-debug-info
+        'O3
+
+    let ir = (FileView path)
+    test (not (contains? ir "call i32 @c_cube"))
+    test (not (contains? ir "call i32 @c_square"))
+
+# scopes compiled separately to thin bitcode are linked into native objects
+do
+    fn square (x)
+        x * x
+    let square-extern = (extern 'square (function i32 i32))
+    fn main (x)
+        (square-extern x) + 1
+
+    let square-path = (module-dir .. "/_test_codegen_square.bc")
+    let main-path = (module-dir .. "/_test_codegen_main.bc")
+    compile-object
+        default-target-triple
+        compiler-file-kind-thin-bc
+        square-path
+        'bind-symbols (Scope)
+            square = (static-typify square i32)
+        'no-debug-info
+        'O2
+    compile-object
+        default-target-triple
+        compiler-file-kind-thin-bc
+        main-path
+        'bind-symbols (Scope)
+            main = (static-typify main i32)
+        'no-debug-info
+        'O2
+
+    local inputs = (arrayof string square-path main-path)
+    local outputs =
+        arrayof string
+            module-dir .. "/_test_codegen_square.o"
+            module-dir .. "/_test_codegen_main.o"
+    link-objects 2 (& (inputs @ 0)) (& (outputs @ 0))
+        'bind-symbols (Scope)
+            main = main
+        'O2
+    for i in (range 2)
+        let obj = (FileView (outputs @ i))
+        test ('valid? obj)
+        test ((countof obj) > 0)
+
+# instrumented functions write their counters to an indexed profile that
+  later compilations apply
+do
+    fn classify (x)
+        if (x < 10) 1
+        else 2
+
+    let f = (compile (static-typify classify i32) 'profile-generate 'O1)
+    let f = (f as (pointer (function i32 i32)))
+    local sum = 0
+    for i in (range 100)
+        sum += (f i)
+    test (sum == 190)
+
+    let path = (module-dir .. "/_test_codegen.profdata")
+    write-profile path
+    test ((countof (FileView path)) > 0)
+    set-profile! path
+    let g = (compile (static-typify classify i32) 'profile-use 'O2)
+    let g = (g as (pointer (function i32 i32)))
+    test ((g 3) == 1)
+    test ((g 30) == 2)
+
+    # objects are instrumented with the lowering of the profile runtime
+    let ir-path = (module-dir .. "/_test_codegen_profile.ll")
+    compile-object
+        default-target-triple
+        compiler-file-kind-llvm
+        ir-path
+        'bind-symbols (Scope)
+            classify = (static-typify classify i32)
+        'no-debug-info
+        'profile-generate
+    test (contains? (FileView ir-path) "__profc_classify")
+
+;
@@ -0,0 +1,125 @@
+
+using import testing
+using import eventloop
+using import String
+using import struct
+using import C.socket
+
+local loop = (EventLoop)
+
+do
+    # a one-shot timeout stops the loop
+    fn on-timeout (fd events loop)
+        'stop (@ loop)
+    'add-timeout loop 1 on-timeout (& loop)
+    'run loop
+
+    # a periodic timer fires until it is cancelled
+    struct Ticks plain
+        loop : (mutable pointer EventLoop)
+        count : i32
+    fn on-tick (fd events ticks)
+        let ticks = (@ ticks)
+        ticks.count += 1
+        if (ticks.count == 3)
+            'cancel-timer (@ ticks.loop) fd
+            'stop (@ ticks.loop)
+    local ticks = (Ticks (& loop) 0)
+    'add-timer loop 1 on-tick (& ticks)
+    'run loop
+    test (ticks.count == 3)
+
+do
+    # echo a message over a loopback connection
+    let server = (listen-tcp 0 16)
+    test (server >= 0)
+    let port = (local-port server)
+    test (port != 0:u16)
+
+    struct Echo plain
+        loop : (mutable pointer EventLoop)
+        conn : i32
+        received : i32
+        reply : (array char 64)
+
+    fn on-data (fd events echo)
+        local buf : (array char 64)
+        loop ()
+            let n = (read-some fd (& (buf @ 0)) 64)
+            if (n <= 0)
+                break;
+            write-some fd (& (buf @ 0)) n
+            repeat;
+        ;
+
+    fn on-accept (fd events echo)
+        let state = (@ echo)
+        loop ()
+            let conn = (accept-nonblocking fd)
+            if (conn < 0)
+                break;
+            state.conn = conn
+            'add (@ state.loop) conn EventRead on-data echo
+            repeat;
+        ;
+
+    fn on-reply (fd events echo)
+        let echo = (@ echo)
+        let n =
+            read-some fd (& (echo.reply @ echo.received)) (64 - echo.received)
+        if (n > 0)
+            echo.received += (n as i32)
+        if (echo.received >= 5)
+            'stop (@ echo.loop)
+
+    local echo = (Echo (& loop) -1 0)
+    'add loop server EventRead on-accept (& echo)
+    let client = (connect-tcp port)
+    test (client >= 0)
+    'add loop client EventRead on-reply (& echo)
+    test ((write-some client ("hello" as rawstring) 5) == 5)
+    'run loop
+    test (echo.received == 5)
+    test ((StringView (bitcast (& (echo.reply @ 0)) rawstring) 5:usize) == "hello")
+
+    # nothing is left to read on a drained socket
+    local buf : (array char 8)
+    test ((read-some client (& (buf @ 0)) 8) < 0)
+    test (would-block?)
+
+    'remove loop client
+    'remove loop echo.conn
+    'remove loop server
+    close client
+    close echo.conn
+    close server
+
+do
+    # datagrams are sent and echoed back in batches
+    let a = (bind-udp 0)
+    let b = (bind-udp 0)
+    test ((a >= 0) and (b >= 0))
+    local outgoing = (MessageBatch 8 64)
+    local incoming = (MessageBatch 8 64)
+    test (('capacity outgoing) == 8)
+    for i in (range 4)
+        let dest = ('buffer outgoing i)
+        dest @ 0 = ((48 + i) as char)
+        'set-length outgoing i 1
+        'set-peer outgoing i (local-port a)
+    test (('send outgoing b 4) == 4)
+
+    # the receiver learns the peers and sends the same batch back
+    test (('receive incoming a) == 4)
+    test (('message incoming 2) == "2")
+    test (('send incoming a 4) == 4)
+    test (('receive outgoing b) == 4)
+    test (('message outgoing 3) == "3")
+
+    # an empty socket reports that it would block
+    test (('receive incoming a) < 0)
+    test (would-block?)
+    close a
+    close b
+
+;
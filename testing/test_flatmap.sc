@@ -0,0 +1,163 @@
+using import FlatMap
+using import testing
+
+local map : (FlatMap Symbol i32)
+inline iter-pairs1 (f)
+    f 'A 101
+    f 'B 303
+    f 'C 606
+    f 'D 909
+    f 'E 11
+    f 'F 22
+    f 'G 33
+    f 'H 44
+inline iter-pairs2 (f)
+    f 'I 111
+    f 'J 333
+    f 'K 666
+    f 'L 999
+    f 'M 1111
+    f 'N 2222
+    f 'O 3333
+    f 'P 4444
+inline iter-pairs (f)
+    iter-pairs1 f
+    iter-pairs2 f
+
+iter-pairs
+    inline (key value)
+        'set map key value
+'dump map
+
+test ('D in map)
+test ((countof map) == 16)
+# 16 entries exceed the 7/8 load factor of a single group
+test (('capacity map) > 16:u64)
+
+for k v in map
+    print k v
+
+iter-pairs
+    inline (key value)
+        if (('getdefault map key -1) == -1)
+            print key value
+            error "key missing"
+iter-pairs1
+    inline (key value)
+        'discard map key
+iter-pairs1
+    inline (key value)
+        if (('getdefault map key -1) != -1)
+            print key value
+            error "key not deleted"
+iter-pairs2
+    inline (key value)
+        if (('getdefault map key -1) == -1)
+            print key value
+            error "key missing"
+test ((countof map) == 8)
+test (('pop map 'I) == 111)
+test (not ('I in map))
+iter-pairs2
+    inline (key value)
+        'discard map key
+iter-pairs2
+    inline (key value)
+        if (('getdefault map key -1) != -1)
+            print key value
+            error "key not deleted"
+test (not map)
+
+do
+    # hashed variants use the same hash as the plain ones
+    local m : (FlatMap i32 i32)
+    let h = ('hash-key m 7)
+    'set-hashed m 7 h 49
+    test ('in-hashed? m 7 h)
+    test (('get-hashed m 7 h) == 49)
+    test (('get m 7) == 49)
+    test-error ('get m 8)
+
+do
+    # churn through many inserts and erases so that tombstones accumulate and
+    # the table has to be rehashed in place
+    local m : (FlatMap i32 i32)
+    'reserve m 1000
+    let capacity = ('capacity m)
+    test ((capacity - capacity // 8:u64) >= 1000:u64)
+    for i in (range 1000)
+        'set m i (i * 2)
+    test (('capacity m) == capacity)
+    for i in (range 1000 20000)
+        'discard m (i - 1000)
+        'set m i (i * 2)
+    test ((countof m) == 1000)
+    for i in (range 19000 20000)
+        test (('get m i) == (i * 2))
+    for i in (range 0 19000 97)
+        test (not ('in? m i))
+
+    let c = (copy m)
+    test ((countof c) == 1000)
+    for k v in m
+        test (('get c k) == v)
+    'clear m
+    test ((countof m) == 0)
+    test ((countof c) == 1000)
+
+do
+    # ensure keys coerce correctly and don't hash in surprising ways, leading
+    # to unexpected "key not found" situations
+    local m : (FlatMap i32 i32)
+    'set m 10 1
+    if (not ('in? m 10:u8))
+        error "key hashed incorrectly"
+
+#------------------------------------------------------------------------------
+
+using import FlatSet
+
+local set : (FlatSet i32)
+iter-pairs
+    inline (key value)
+        'insert set value
+'dump set
+
+test (909 in set)
+test (909:i16 in set)
+
+for val in set
+    print val
+iter-pairs
+    inline (key value)
+        if (not ('in? set value))
+            print value
+            error "value missing"
+iter-pairs1
+    inline (key value)
+        'discard set value
+iter-pairs1
+    inline (key value)
+        if ('in? set value)
+            print value
+            error "value not discarded"
+iter-pairs2
+    inline (key value)
+        if (not ('in? set value))
+            print value
+            error "value missing"
+
+do
+    local s : (FlatSet i32)
+    for i in (range 100)
+        'insert s i
+    test ((countof s) == 100)
+    test ('in-hashed? s 42 ('hash-key s 42))
+    let k = ('pop s)
+    test (not ('in? s k))
+    test ((countof s) == 99)
+    let c = (copy s)
+    test ((countof c) == 99)
+    for k in s
+        test ('in? c k)
+;
@@ -35,6 +35,37 @@ test
             .. (format "\{\} \{\} \{\}" "test" "test2" "test3")
         "{} {} {}"
 
+do
+    # numbers are written directly, in the format of tostring
+    test ((format "{} {} {}" 42 -7 18446744073709551615:u64) == "42 -7 18446744073709551615")
+    test ((format "{} {}" true false) == "true false")
+    test ((format "{}" 1.5) == (tostring 1.5))
+    test ((format "{}" -0.25:f64) == (tostring -0.25:f64))
+    test ((format "{}" 3:f64) == (tostring 3:f64))
+    test ((format "{}" 0.1:f64) == (tostring 0.1:f64))
+    local x = 2.75
+    test ((format "x = {}" x) == "x = 2.75")
+
+    # other values go through tostring
+    test ((format "{}" 'sym) == (tostring 'sym))
+
+    # constant strings fold to a constant string
+    let folded = (format "{0}-{1}-{0}" "a" "b")
+    static-assert (constant? folded)
+    test (folded == "a-b-a")
+
+    # formatting into a buffer truncates like snprintf
+    local buf : (array char 8)
+    let n = (format-buffer (& (buf @ 0)) 8 "{}-{}" "abc" 12345)
+    test (n == 9)
+    test ((string (& (buf @ 0))) == "abc-123")
+    let n = (format-buffer (& (buf @ 0)) 8 "{}" 7)
+    test (n == 1)
+    test ((string (& (buf @ 0))) == "7")
+
+    # writing to a file descriptor
+    test ((format-fd 1 "{} to stdout\n" "written") == 18)
+
 test-compiler-error
     format "{test"
 test-compiler-error
@@ -264,4 +264,37 @@ do
         static-compile-glsl 420 'vertex (static-typify vertex)
 
 
+# compiling a function again loads the cached output without a cache miss
+  and produces the same result
+do
+    using import testing
+    let a = (compile-glsl 0 'vertex (typify vertex-shader))
+    # reading the counter resets it
+    sc_cache_misses;
+    let b = (compile-glsl 0 'vertex (typify vertex-shader))
+    test ((sc_cache_misses) == 0)
+    test (a == b)
+    let a = (compile-spirv 0 'vertex (typify vertex-shader))
+    sc_cache_misses;
+    let b = (compile-spirv 0 'vertex (typify vertex-shader))
+    test ((sc_cache_misses) == 0)
+    test (a == b)
+
+# a batch produces the same output as compiling each function on its own
+do
+    using import testing
+    local targets = (arrayof Symbol 'vertex 'fragment 'compute)
+    local funcs =
+        arrayof Value
+            typify vertex-shader
+            typify fragment-shader
+            typify compute-shader
+    local results : (array string 3)
+    compile-glsl-batch 0 3 (& (targets @ 0)) (& (funcs @ 0)) (& (results @ 0))
+    test ((results @ 0) == (compile-glsl 0 'vertex (typify vertex-shader)))
+    test ((results @ 1) == (compile-glsl 0 'fragment (typify fragment-shader)))
+    test ((results @ 2) == (compile-glsl 0 'compute (typify compute-shader)))
+    compile-spirv-batch 0 3 (& (targets @ 0)) (& (funcs @ 0)) (& (results @ 0)) 'O3
+    test ((results @ 1) == (compile-spirv 0 'fragment (typify fragment-shader) 'O3))
+
 ;
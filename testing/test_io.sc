@@ -0,0 +1,112 @@
+
+using import testing
+using import io
+using import String
+using import itertools
+using import Array
+
+let unlink = (extern 'unlink (function i32 rawstring))
+let lseek = (extern 'lseek (function i64 i32 i64 i32))
+
+let path = (module-dir .. "/test_io.tmp")
+let copy-path = (module-dir .. "/test_io_copy.tmp")
+
+do
+    # write through a buffer that is smaller than some of the writes
+    let fd = (open-write path)
+    test (fd >= 0)
+    local writer = (BufferedWriter fd 16)
+    'write writer "first line\n"
+    'write writer "\n"
+    'write writer (StringView "a line that is longer than the buffer\n")
+    'write writer ("last" as rawstring) 4
+    test (('buffered writer) == 4)
+    test ('flush writer)
+    test (('buffered writer) == 0)
+    test (not ('failed? writer))
+    drop writer
+    close-file fd
+
+do
+    # map the file and iterate its lines without copying
+    let view = (FileView path)
+    test ('valid? view)
+    test ((countof view) == 54)
+    test (('slice view 0 5) == "first")
+    test (('slice view 50 100) == "last")
+    local count = 0
+    for i line in (enumerate (lines view))
+        if (i == 0)
+            test (line == "first line")
+        elseif (i == 1)
+            test ((countof line) == 0)
+        elseif (i == 3)
+            test (line == "last")
+        count += 1
+    test (count == 4)
+
+    # the generator feeds into itertools
+    let long =
+        ->> (lines view)
+            filter (inline (line) ((countof line) > 10:usize))
+            reduce 0 (inline (n line) (n + 1))
+    test (long == 1)
+
+    # records with other delimiters, from a string
+    local fields : (Array StringView)
+    for field in (records "a,b,,c" c",")
+        'append fields field
+    test ((countof fields) == 4)
+    test ((fields @ 2) == "")
+    test ((fields @ 3) == "c")
+
+do
+    # read records through a buffer that has to grow for the long line
+    let fd = (open-read path)
+    local reader = (BufferedReader fd 8)
+    local lengths : (Array usize)
+    for line in (lines reader)
+        'append lengths (countof line)
+    test ((countof lengths) == 4)
+    test ((lengths @ 0) == 10)
+    test ((lengths @ 2) == 37)
+    test ((lengths @ 3) == 4)
+    test ('eof? reader)
+    close-file fd
+
+do
+    # buffered reads and explicit buffer control
+    let fd = (open-read path)
+    local reader = (BufferedReader fd 32)
+    test (('fill reader) == 32)
+    test (('buffered reader) == "first line\n\na line that is longe")
+    'consume reader 6
+    local buf : (array char 8)
+    test (('read reader (& (buf @ 0)) 4) == 4)
+    test ((StringView (bitcast (& (buf @ 0)) rawstring) 4:usize) == "line")
+    close-file fd
+
+do
+    # copy between file descriptors inside the kernel
+    let src = (open-read path)
+    let dest = (open-write copy-path)
+    test ((copy-file-range dest src 1000) == 54)
+    close-file dest
+    lseek src 0 0
+    let dest = (open-write copy-path)
+    test ((send-file dest src 11) == 11)
+    close-file dest
+    close-file src
+    let view = (FileView copy-path)
+    test ((countof view) == 11)
+    test (('view view) == "first line\n")
+
+# missing files can not be mapped
+let missing = (FileView (module-dir .. "/test_io_missing.tmp"))
+test (not ('valid? missing))
+test ((countof missing) == 0)
+
+unlink (path as rawstring)
+unlink (copy-path as rawstring)
+
+;
@@ -179,4 +179,53 @@ do
         print i
 
 
+do
+    # chunked iteration
+    using import Array
+    using import String
+
+    local values : (Array i32)
+    for i in (range 1003)
+        'append values i
+
+    # vector batches, including a partial tail
+    let total =
+        ->> (chunked 8 values)
+            chunk-reduce (vector.smear 0 8) +
+    test (total == 502503)
+
+    let total =
+        ->> (chunked 4 values)
+            chunk-map (inline (v) (v * (vector.smear 2 4)))
+            chunk-reduce (vector.smear 0 4) +
+    test (total == 1005006)
+
+    # the tail must not see lanes past the end
+    let largest =
+        ->> (chunked 16 3 20)
+            chunk-reduce (vector.smear -1 16) max
+    test (largest == 19)
+
+    # filtered and unchunked lanes feed into scalar collectors
+    local evens : (Array i32)
+    ->> (chunked 8 values)
+        chunk-filter
+            inline (v) ((v & (vector.smear 1 8)) == (vector.smear 0 8))
+        evens
+    test ((countof evens) == 502)
+    test ((evens @ 501) == 1002)
+
+    let count =
+        ->> (chunked 8 100)
+            unchunk
+            reduce 0 (inline (n x) (n + 1))
+    test (count == 100)
+
+    local s = (String "chunked iteration")
+    let spaces =
+        ->> (chunked 16 s)
+            chunk-filter (inline (v) (v == (vector.smear (" " @ 0) 16)))
+            reduce 0 (inline (n c) (n + 1))
+    test (spaces == 1)
+
 ;
\ No newline at end of file
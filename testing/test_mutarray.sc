@@ -186,6 +186,87 @@ fn test-one ()
 test-one;
 One.test-refcount-balanced;
 
+fn test-sort-patterns ()
+    # inputs that are known to degrade naive quicksorts
+    inline verify-sorted (a)
+        for i in (range 1 (countof a))
+            test ((a @ (i - 1)) <= (a @ i))
+    inline test-pattern (name f)
+        report "sorting" name
+        local a : i32Array
+        let N = 10000
+        for i in (range N)
+            'append a (f i N)
+        'sort a
+        verify-sorted a
+        for i in (range N)
+            a @ i = (f i N)
+        'stable-sort a
+        verify-sorted a
+    test-pattern "sorted" (inline (i N) i)
+    test-pattern "reversed" (inline (i N) (N - i))
+    test-pattern "all equal" (inline (i N) 7)
+    test-pattern "few distinct" (inline (i N) (i % 3))
+    test-pattern "organ pipe"
+        inline (i N)
+            if (i < (N // 2)) i
+            else (N - i)
+    test-pattern "sawtooth" (inline (i N) (i % 97))
+    test-pattern "pseudorandom" (inline (i N) ((i * 7919) % 10007))
+
+test-sort-patterns;
+
+fn test-stable-sort ()
+    # sort by the tens, and expect the ones to stay in insertion order
+    local a : i32Array
+    let N = 1000
+    for i in (range N)
+        'append a (((N - i) % 10) * 10 + (i % 10))
+    'stable-sort a (inline (x) (x // 10))
+    for i in (range 1 N)
+        let x0 = (a @ (i - 1))
+        let x1 = (a @ i)
+        if ((x0 // 10) == (x1 // 10))
+            test ((x0 % 10) <= (x1 % 10))
+        else
+            test ((x0 // 10) < (x1 // 10))
+    'predicated-stable-sort a (inline (a b) (a > b))
+    for i in (range 1 N)
+        test ((a @ (i - 1)) >= (a @ i))
+
+test-stable-sort;
+
+fn test-stable-sort-one ()
+    One.test-refcount-balanced;
+
+    local a : (Array One)
+    let N = 1000
+    for i in (range N)
+        'append a (One ((i * 7919) % 1009))
+    'stable-sort a
+    for i in (range 1 N)
+        test (('value (a @ (i - 1))) <= ('value (a @ i)))
+    ;
+
+test-stable-sort-one;
+One.test-refcount-balanced;
+
+fn test-parallel-sort ()
+    local a : i32Array
+    let N = 1000000
+    for i in (range N)
+        'append a ((i * 7919) % 1000003)
+    report "parallel sorting big array..."
+    'parallel-sort a
+    report "done."
+    for i in (range 1 N)
+        test ((a @ (i - 1)) <= (a @ i))
+    'predicated-parallel-sort a (inline (a b) (a > b))
+    for i in (range 1 N)
+        test ((a @ (i - 1)) >= (a @ i))
+
+test-parallel-sort;
+
 # removal of elements
 fn test-remove ()
     One.test-refcount-balanced;
@@ -274,4 +355,58 @@ fn test-copy ()
 test-copy;
 One.test-refcount-balanced;
 
+fn test-small-array ()
+    One.test-refcount-balanced;
+
+    local a : (SmallArray One 4)
+    test ('inline? a)
+    for i in (range 4)
+        'append a (One i)
+    test ('inline? a)
+    test (('capacity a) == 4)
+    # exceeding the inline capacity moves the elements to the heap
+    for i in (range 4 10)
+        'append a (One i)
+    test (not ('inline? a))
+    test ((countof a) == 10)
+    test ((One.refcount) == 10)
+    for i in (range 10)
+        test (('value (a @ i)) == i)
+    local b = (copy a)
+    test ((One.refcount) == 20)
+    'sort b (inline (x) (- ('value x)))
+    test (('value (b @ 0)) == 9)
+    drop b
+    test ((One.refcount) == 10)
+    'remove a 0
+    test (('value (a @ 0)) == 1)
+
+    local c = ((SmallArray i32 8) 1 2 3)
+    test ((countof c) == 3)
+    test ('inline? c)
+    test ((c @ 2) == 3)
+    ;
+
+test-small-array;
+One.test-refcount-balanced;
+
+fn test-arena-array ()
+    using import Allocator
+
+    local arena : (Arena 256)
+    let ArenaArray = (GrowingArray i32 ArenaAllocator)
+    local a = (ArenaArray (allocator = (ArenaAllocator arena)))
+    local b = (ArenaArray 1 2 3 (allocator = (ArenaAllocator arena)))
+    for i in (range 1000)
+        'append a i
+    test ((countof a) == 1000)
+    for i in (range 1000)
+        test ((a @ i) == i)
+    test ((b @ 2) == 3)
+    let c = (copy b)
+    test ((c @ 0) == 1)
+    ;
+
+test-arena-array;
+
 ;
@@ -0,0 +1,147 @@
+
+using import testing
+using import parallel
+using import Capture
+using import Array
+using import itertools
+
+local pool = (ThreadPool 4)
+test (('worker-count pool) == 4)
+
+do
+    # every index is visited exactly once
+    local hits : (Array i32)
+    'resize hits 10000 0
+    capture count-hit (i) {&hits}
+        hits @ i += 1
+    parallel-for pool (countof hits) count-hit (grain = 16)
+    for x in hits
+        test (x == 1)
+
+    # elements of an array are passed by reference
+    capture square (x) {}
+        x = x * x
+    parallel-for pool hits square
+    test ((hits @ 0) == 1)
+
+    # empty ranges do nothing
+    parallel-for pool 0 count-hit
+    test ((hits @ 0) == 1)
+
+do
+    # reduce over indices and elements
+    let total =
+        parallel-reduce pool 100001 0:u64
+            inline (sum i) (sum + (i as u64))
+    test (total == 5000050000:u64)
+
+    local values : (Array i64)
+    for i in (range 1000)
+        'append values (i as i64)
+    let total =
+        parallel-reduce pool values 0:i64
+            inline (sum x) (sum + x)
+    test (total == 499500:i64)
+
+    # partial results can be combined with a different function
+    let maxval =
+        parallel-reduce pool values 0:i64
+            inline (m x) (max m x)
+            max
+    test (maxval == 999:i64)
+
+    let total = (parallel-reduce pool 0 0:i64 (inline (sum i) (sum + 1:i64)))
+    test (total == 0:i64)
+
+do
+    # map over a count, an array and a generator
+    let squares =
+        parallel-map pool 100
+            inline (i) ((i * i) as i64)
+    test ((countof squares) == 100)
+    test ((squares @ 99) == 9801:i64)
+
+    let doubled =
+        parallel-map pool squares
+            inline (x) (x * 2:i64)
+    test ((doubled @ 99) == 19602:i64)
+
+    let odd =
+        parallel-map pool
+            ->> (range 10) (filter (inline (x) ((x & 1) == 1)))
+            inline (x) (x * 10)
+    test ((countof odd) == 5)
+    test ((odd @ 0) == 10)
+    test ((odd @ 4) == 90)
+
+    # the result feeds back into itertools
+    let sum =
+        ->> odd
+            reduce 0 (inline (a b) (a + b))
+    test (sum == 250)
+
+do
+    # futures return the result of their task
+    let offset = 12
+    capture compute () {offset}
+        fold (sum = offset) for i in (range 100)
+            sum + i
+    let f = ('spawn pool compute)
+    test (('wait f) == 4962)
+    test ('done? f)
+    # a finished task can not be cancelled
+    test (not ('cancel f))
+
+    # many small futures
+    local futures : (Array (Future i32))
+    for i in (range 64)
+        capture task () {i}
+            i * 2
+        'append futures ('spawn pool task)
+    for i f in (enumerate futures)
+        test (('wait f) == i * 2)
+
+    # tasks without a result
+    local ran = 0
+    capture mark () {&ran}
+        ran = 1
+    let f = ('spawn pool mark)
+    'wait f
+    test (ran == 1)
+
+do
+    # join waits for all tasks submitted to the pool
+    local counter = 0:i64
+    local futures : (Array (Future (tuple)))
+    for i in (range 32)
+        capture bump () {&counter}
+            atomicrmw add (& counter) 1:i64
+            ;
+        'append futures ('spawn pool bump)
+    'join pool
+    test (counter == 32:i64)
+    for f in futures
+        test ('done? f)
+
+do
+    # nested parallel operations run on the waiting threads
+    local totals : (Array i64)
+    'resize totals 8 0:i64
+    capture outer (k) {&totals &pool}
+        totals @ k =
+            parallel-reduce pool 1000 0:i64
+                inline (sum i) (sum + (i as i64))
+    parallel-for pool 8 outer (grain = 1)
+    for x in totals
+        test (x == 499500:i64)
+
+# a pool with a single worker still makes progress while the caller waits
+local single = (ThreadPool 1)
+let f =
+    'spawn single
+        inline () 303
+test (('wait f) == 303)
+drop f
+drop single
+
+;
@@ -0,0 +1,68 @@
+
+using import testing
+using import io
+using import benchmark
+
+let unlink = (extern 'unlink (function i32 rawstring))
+
+fn contains? (text pattern)
+    let size = (countof pattern)
+    loop (i = 0:usize)
+        if ((i + size) > (countof text))
+            break false
+        if (('slice text i (i + size)) == pattern)
+            break true
+        i + 1:usize
+
+fn busy (ns)
+    let t0 = (clock-ns)
+    local x = 0:u64
+    loop ()
+        if (((clock-ns) - t0) > ns)
+            break x
+        x = x * 6364136223846793005:u64 + 1:u64
+        repeat;
+
+profiler-start 1000
+busy 100000000:u64
+profiler-stop;
+
+# samples are written as folded stacks, or as pprof for .pb.gz paths
+let folded-path = (module-dir .. "/_test_profiler.folded")
+profiler-write folded-path
+let folded = (FileView folded-path)
+test ((countof folded) > 0)
+# busy ran for the whole sampling period, so it is on the sampled stacks
+test (contains? folded "busy")
+
+let pprof-path = (module-dir .. "/_test_profiler.pb.gz")
+profiler-write pprof-path
+test ((countof (FileView pprof-path)) > 0)
+
+unlink (folded-path as rawstring)
+unlink (pprof-path as rawstring)
+
+# malloc and free of functions compiled with 'profile-alloc are counted by site
+fn churn (n)
+    let keep = (malloc-array i32 n)
+    for i in (range n)
+        let p = (malloc i32)
+        store i p
+        keep @ i = (load p)
+        free p
+    let x = (keep @ (n - 1))
+    free keep
+    x
+
+alloc-profile-reset;
+let f = (compile (static-typify churn i32) 'profile-alloc)
+let f = (f as (pointer (function i32 i32)))
+test ((f 100) == 99)
+let count bytes live-bytes = (alloc-profile-totals)
+# one array and one i32 per iteration, all of which were freed
+test (count == 101:u64)
+test (bytes == 800:u64)
+test (live-bytes == 0:i64)
+alloc-profile-print 10
+
+;
@@ -90,6 +90,55 @@ do
 
 One.test-refcount-balanced;
 
+# atomic reference counting
+do
+    let a = (Arc.wrap (One 303))
+    let b = (Arc.new One 303)
+    'check a
+
+    let k = ((Arc i32) 3)
+    test (k == k)
+    test (k != ((Arc i32) 3))
+    do
+        test ((Arc.strong-count k) == 1)
+        let k2 = (copy k)
+        test ((Arc.strong-count k) == 2)
+    test ((Arc.strong-count k) == 1)
+    test (k * 2 == 6)
+    k = 12
+    test (k == 12)
+
+    let c = ((Arc vec3) 1 2 3)
+    test ((Arc.strong-count c) == 1)
+    test ((Arc.weak-count c) == 0)
+
+    let nullweak = ((AtomicWeak vec3))
+    test ((Arc.strong-count nullweak) == 0)
+    test ((Arc.weak-count nullweak) == 1)
+    test-error ('upgrade nullweak)
+
+    let w = (c as AtomicWeak)
+    test ((Arc.strong-count w) == 1)
+    test ((Arc.weak-count w) == 1)
+
+    let v = ('force-upgrade w)
+    test ((Arc.strong-count c) == 2)
+    let w2 = (copy w)
+    test ((Arc.weak-count c) == 2)
+    drop w2
+    test ((Arc.weak-count c) == 1)
+
+    test (c.xz == (vec2 1 3))
+    drop c
+    drop v
+
+    test ((Arc.strong-count w) == 0)
+    test ((Arc.weak-count w) == 1)
+    test-error ('upgrade w)
+    ;
+
+One.test-refcount-balanced;
+
 # recursive declarations
 do
     using import struct
@@ -154,4 +154,77 @@ do
             local dst : String "foo"
     test (dst == "footst")
 
-;
\ No newline at end of file
+
+do
+    # small strings store their contents inline until they outgrow it
+    local s : (SmallString 8)
+    test ('inline? s)
+    'append s "hello"
+    test ('inline? s)
+    test (s == "hello")
+    'append s " world"
+    test (not ('inline? s))
+    test (s == "hello world")
+    test (((s as rawstring) @ (countof s)) == 0:char)
+    local t = (copy s)
+    'append t "!"
+    test (t == "hello world!")
+    test (s == "hello world")
+    let u = ((SmallString 16) "abc" "def")
+    test (u == "abcdef")
+    test ('inline? u)
+
+do
+    # strings taking their memory from an arena
+    using import Allocator
+    local arena : Arena
+    let ArenaString = (GrowingString char ArenaAllocator)
+    local s = (ArenaString "hello" (allocator = (ArenaAllocator arena)))
+    for i in (range 100)
+        'append s " world"
+    test ((countof s) == 605)
+    test (((s as rawstring) @ (countof s)) == 0:char)
+
+do
+    # string views refer to characters without copying them
+    local s = (String "hello world")
+    let v = (StringView s)
+    test ((countof v) == 11)
+    test (v == "hello world")
+    test (v == s)
+    let word = (rslice v 6)
+    test (word == "world")
+    test ((lslice v 5) == "hello")
+    test ((slice v 3 5) == "lo")
+    test ((word @ 0) == c"w")
+    test ((word as string) == "world")
+    test ((hash word) == (hash (StringView "world")))
+    # views are accepted by the String APIs
+    local t = (String "say ")
+    'append t word
+    test (t == "say world")
+    test (t != word)
+    test ((.. (String "big ") word) == "big world")
+
+do
+    # string builders concatenate without intermediate copies
+    local sb : StringBuilder
+    local name = (String "world")
+    'append sb "hello " name "! " 42 c"."
+    test ((countof sb) == 16)
+    local result = ('to-string sb)
+    test (result == "hello world! 42.")
+    do
+        local tmp = (String "copied")
+        'append-copy sb tmp
+    test (('to-string sb) == "hello world! 42.copied")
+    'clear sb
+    test ((countof sb) == 0)
+    # flushing writes all segments at once
+    for i in (range 2000)
+        'append sb "."
+    'append sb "\n"
+    test ('flush sb 1)
+    test ((countof sb) == 0)
+
+;
@@ -28,3 +28,48 @@ test (dststr == srcstr)
 
 test ((UTF-8.char32 "?") == 63)
 
+do
+    # bulk conversion
+    let text =
+        .. "ASCII only, long enough to fill a few blocks of sixteen bytes. "
+            srcstr " ∀x∈ℝ: x² ≥ 0 "
+    let data = (text as rawstring)
+    let count = (countof text)
+    test ((UTF-8.validate data count) == count)
+    test (UTF-8.valid? data count)
+
+    let codepoints = (UTF-8.count-codepoints data count)
+    let decoded =
+        ->> text UTF-8.decoder
+            reduce 0:usize (inline (n cp) (n + 1:usize))
+    test (codepoints == decoded)
+
+    let utf32 = (malloc-array i32 count)
+    let n = (UTF-8.decode data count utf32)
+    test (n == codepoints)
+    let utf8 = (malloc-array char (n * 4:usize))
+    let m = (UTF-8.encode utf32 n utf8)
+    test (m == count)
+    test ((string utf8 m) == text)
+
+    # ill-formed input
+    inline check-ill-formed (bad offset)
+        let data = (bad as rawstring)
+        let count = (countof bad)
+        test (not (UTF-8.valid? data count))
+        test ((UTF-8.validate data count) == offset)
+        # invalid bytes survive a round trip
+        let n = (UTF-8.decode data count utf32)
+        test ((utf32 @ (n - 1:usize)) < 0)
+        let m = (UTF-8.encode utf32 n utf8)
+        test ((string utf8 m) == bad)
+    # surrogate
+    check-ill-formed "ab\xed\xa0\x80" 2:usize
+    # overlong encoding
+    check-ill-formed "abc\xc0\xaf" 3:usize
+    # truncated sequence
+    check-ill-formed "abcd\xe2\x82" 4:usize
+    # stray continuation byte
+    check-ill-formed "abcde\x80" 5:usize
+    free utf32
+    free utf8